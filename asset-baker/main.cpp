@@ -0,0 +1,377 @@
+#include <print>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <optional>
+#include <typeinfo>
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <string_view>
+
+#include <cctype>
+
+#include "../support/error.hpp"
+
+#include "../main/texture.hpp"
+#include "../main/loadobj.hpp"
+#include "../main/mesh_cache.hpp"
+#include "../main/baked_assets.hpp"
+#include "../main/texture_cache.hpp"
+#include "../main/texture_compress.hpp"
+#include "../main/terrain_tiles.hpp"
+
+/* asset-baker
+ *
+ * Offline preprocessing of the runtime assets. For each source asset in the
+ * input directory (default: assets/cw2), a runtime-ready file is written to
+ * the "baked" subdirectory:
+ *
+ *  - *.obj (+ referenced *.mtl): welded, indexed mesh, optimized for the
+ *    vertex cache and overdraw, with a LOD chain and packed vertices (see
+ *    mesh_cache.hpp, mesh_optimize.hpp, mesh_simplify.hpp and
+ *    vertex_format.hpp)
+ *  - terrain *.obj (see --terrain): tile set instead of a single mesh (see
+ *    terrain_tiles.hpp)
+ *  - *.jpeg, *.jpg, *.png: complete sRGB-correct mip chain, BC7 compressed
+ *    (see texture_cache.hpp and texture_compress.hpp)
+ *
+ * Baking is incremental: each baked file records the size and modification
+ * time of its sources, and is only rebuilt if those change (or if the file
+ * format version changes). Pass --force to rebuild everything.
+ *
+ * Usage: asset-baker [--force] [--bc1] [--terrain <name>]... [input-dir]
+ *
+ * --bc1 stores opaque textures as BC1 instead of BC7, which halves their size
+ * at some cost in quality. Textures with alpha always use BC7.
+ *
+ * --terrain names an OBJ file in the input directory that is baked as a
+ * terrain tile set. If not given, parlahti.obj is the only terrain.
+ */
+
+namespace
+{
+	namespace fs = std::filesystem;
+
+	struct Options_
+	{
+		bool force = false;
+		bool bc1 = false;
+		fs::path inputDir = "assets/cw2";
+		std::vector<std::string> terrains;
+	};
+
+	enum class BakeResult_
+	{
+		upToDate,
+		baked,
+		failed
+	};
+
+	Options_ parse_options_( int, char** );
+
+	bool is_mesh_source_( fs::path const& );
+	bool is_texture_source_( fs::path const& );
+
+	BakeResult_ bake_mesh_( fs::path const&, bool aForce );
+	BakeResult_ bake_terrain_( fs::path const&, bool aForce );
+	BakeResult_ bake_texture_( fs::path const&, bool aForce, bool aBC1 );
+}
+
+int main( int aArgc, char** aArgv )
+try
+{
+	auto const options = parse_options_( aArgc, aArgv );
+
+	if( !fs::is_directory( options.inputDir ) )
+		throw Error( "Input directory '{}' does not exist", options.inputDir.string() );
+
+	fs::create_directories( options.inputDir / "baked" );
+
+	// Process sources in a stable order so that the output is reproducible
+	std::vector<fs::path> sources;
+	for( auto const& entry : fs::directory_iterator( options.inputDir ) )
+	{
+		if( entry.is_regular_file() )
+			sources.emplace_back( entry.path() );
+	}
+	std::sort( sources.begin(), sources.end() );
+
+	std::size_t baked = 0, upToDate = 0, failed = 0;
+	for( auto const& source : sources )
+	{
+		BakeResult_ res;
+		bool const isTerrain = options.terrains.end() != std::find( options.terrains.begin(), options.terrains.end(), source.filename().string() );
+
+		if( is_mesh_source_( source ) && isTerrain )
+			res = bake_terrain_( source, options.force );
+		else if( is_mesh_source_( source ) )
+			res = bake_mesh_( source, options.force );
+		else if( is_texture_source_( source ) )
+			res = bake_texture_( source, options.force, options.bc1 );
+		else
+			continue;
+
+		switch( res )
+		{
+			case BakeResult_::upToDate: ++upToDate; break;
+			case BakeResult_::baked: ++baked; break;
+			case BakeResult_::failed: ++failed; break;
+		}
+	}
+
+	std::print( "asset-baker: {} baked, {} up to date, {} failed\n", baked, upToDate, failed );
+	return failed ? 1 : 0;
+}
+catch( std::exception const& eErr )
+{
+	std::print( stderr, "Top-level Exception ({}):\n", typeid(eErr).name() );
+	std::print( stderr, "{}\n", eErr.what() );
+	std::print( stderr, "Bye.\n" );
+	return 1;
+}
+
+namespace
+{
+	Options_ parse_options_( int aArgc, char** aArgv )
+	{
+		Options_ ret;
+
+		bool haveInput = false;
+		for( int i = 1; i < aArgc; ++i )
+		{
+			std::string_view const arg( aArgv[i] );
+			if( "--force" == arg )
+				ret.force = true;
+			else if( "--bc1" == arg )
+				ret.bc1 = true;
+			else if( "--terrain" == arg && i+1 < aArgc )
+				ret.terrains.emplace_back( aArgv[++i] );
+			else if( !haveInput && !arg.starts_with( "--" ) )
+			{
+				ret.inputDir = arg;
+				haveInput = true;
+			}
+			else
+				throw Error( "Unknown argument '{}'\nUsage: asset-baker [--force] [--bc1] [--terrain <name>]... [input-dir]", arg );
+		}
+
+		if( ret.terrains.empty() )
+			ret.terrains.emplace_back( "parlahti.obj" );
+
+		return ret;
+	}
+
+	std::string lower_extension_( fs::path const& aPath )
+	{
+		auto ext = aPath.extension().string();
+		std::transform( ext.begin(), ext.end(), ext.begin(), [] (unsigned char aC) { return char(std::tolower(aC)); } );
+		return ext;
+	}
+
+	bool is_mesh_source_( fs::path const& aPath )
+	{
+		return ".obj" == lower_extension_( aPath );
+	}
+	bool is_texture_source_( fs::path const& aPath )
+	{
+		auto const ext = lower_extension_( aPath );
+		return ".jpeg" == ext || ".jpg" == ext || ".png" == ext;
+	}
+
+	// The baked mesh depends on the OBJ and on every material library it
+	// references. Combine them into a single key: the total size and the
+	// newest modification time.
+	std::optional<AssetSourceKey> mesh_dependency_key_( fs::path const& aObjPath )
+	{
+		auto key = asset_source_key( aObjPath.string().c_str() );
+		if( !key )
+			return {};
+
+		std::ifstream fin( aObjPath );
+		for( std::string line; std::getline( fin, line ); )
+		{
+			if( !line.starts_with( "mtllib" ) )
+				continue;
+
+			std::string_view name( line );
+			name.remove_prefix( 6 );
+			while( !name.empty() && (' ' == name.front() || '\t' == name.front()) )
+				name.remove_prefix( 1 );
+			while( !name.empty() && std::isspace( (unsigned char)name.back() ) )
+				name.remove_suffix( 1 );
+
+			auto const mtlPath = aObjPath.parent_path() / name;
+			if( auto const mtlKey = asset_source_key( mtlPath.string().c_str() ) )
+			{
+				key->size += mtlKey->size;
+				key->modTime = std::max( key->modTime, mtlKey->modTime );
+			}
+		}
+
+		return key;
+	}
+
+	// Flags of baked meshes. These must match the flags that the runtime
+	// requests from load_wavefront_obj_cached().
+	constexpr std::uint32_t kBakedMeshFlags_ = kMeshFlagWeld | kMeshFlagOptimize | kMeshFlagLods | kMeshFlagPacked;
+
+	BakeResult_ bake_mesh_( fs::path const& aSource, bool aForce )
+	{
+		auto const sourcePath = aSource.generic_string();
+		auto const bakedPath = baked_asset_path( sourcePath.c_str(), kBakedMeshExtension );
+
+		auto const key = mesh_dependency_key_( aSource );
+		if( !key )
+		{
+			std::print( stderr, "  {}: unable to query source\n", sourcePath );
+			return BakeResult_::failed;
+		}
+
+		MeshFileHeader header;
+		if( !aForce && open_mesh_file( bakedPath.c_str(), &header ) )
+		{
+			if( kBakedMeshFlags_ == header.flags && *key == AssetSourceKey{ header.sourceSize, header.sourceModTime } )
+				return BakeResult_::upToDate;
+		}
+
+		try
+		{
+			MeshOptimizeReport report{};
+			auto const mesh = build_mesh( sourcePath.c_str(), kBakedMeshFlags_, &report );
+
+			if( !write_mesh_file( bakedPath.c_str(), sourcePath, *key, kBakedMeshFlags_, mesh ) )
+				return BakeResult_::failed;
+
+			std::print( "  {} -> {} ({} vertices, {} indices)\n", sourcePath, bakedPath, vertex_count( mesh ), mesh.indices.size() );
+			std::print( "    ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr );
+			for( std::size_t i = 1; i < mesh.lods.size(); ++i )
+				std::print( "    LOD {}: {} triangles, error {:.4f}\n", i, mesh.lods[i].indexCount / 3, mesh.lods[i].error );
+		}
+		catch( std::exception const& eErr )
+		{
+			std::print( stderr, "  {}: {}\n", sourcePath, eErr.what() );
+			return BakeResult_::failed;
+		}
+
+		return BakeResult_::baked;
+	}
+
+	BakeResult_ bake_terrain_( fs::path const& aSource, bool aForce )
+	{
+		auto const sourcePath = aSource.generic_string();
+		auto const bakedPath = baked_asset_path( sourcePath.c_str(), kBakedTileSetExtension );
+
+		auto const key = mesh_dependency_key_( aSource );
+		if( !key )
+		{
+			std::print( stderr, "  {}: unable to query source\n", sourcePath );
+			return BakeResult_::failed;
+		}
+
+		if( !aForce )
+		{
+			if( auto const existing = open_tile_set( bakedPath.c_str() ) )
+			{
+				auto const& header = existing->header;
+				if( kTileMeshFlags == header.meshFlags && kTerrainTilesPerSide == header.tilesX && kTerrainTilesPerSide == header.tilesZ
+					&& *key == AssetSourceKey{ header.sourceSize, header.sourceModTime } )
+				{
+					return BakeResult_::upToDate;
+				}
+			}
+		}
+
+		try
+		{
+			auto const mesh = load_wavefront_obj( sourcePath.c_str(), true );
+			if( !write_tile_set( bakedPath.c_str(), sourcePath, *key, mesh, kTerrainTilesPerSide ) )
+				return BakeResult_::failed;
+
+			auto const tileSet = open_tile_set( bakedPath.c_str() );
+			if( !tileSet )
+				return BakeResult_::failed;
+
+			std::uint64_t totalBytes = 0, maxBytes = 0;
+			for( auto const& tile : tileSet->tiles )
+			{
+				totalBytes += tile.residentBytes;
+				maxBytes = std::max( maxBytes, tile.residentBytes );
+			}
+
+			std::print( "  {} -> {} ({} vertices, {} indices)\n", sourcePath, bakedPath, vertex_count( mesh ), mesh.indices.size() );
+			std::print( "    {}x{} grid, {} tiles, {:.1f} MiB total, {:.1f} MiB largest tile\n",
+				kTerrainTilesPerSide, kTerrainTilesPerSide, tileSet->tiles.size(), totalBytes / (1024.0*1024.0), maxBytes / (1024.0*1024.0) );
+		}
+		catch( std::exception const& eErr )
+		{
+			std::print( stderr, "  {}: {}\n", sourcePath, eErr.what() );
+			return BakeResult_::failed;
+		}
+
+		return BakeResult_::baked;
+	}
+
+	BakeResult_ bake_texture_( fs::path const& aSource, bool aForce, bool aBC1 )
+	{
+		auto const sourcePath = aSource.generic_string();
+		auto const bakedPath = baked_asset_path( sourcePath.c_str(), kBakedTextureExtension );
+
+		auto const key = asset_source_key( sourcePath.c_str() );
+		if( !key )
+		{
+			std::print( stderr, "  {}: unable to query source\n", sourcePath );
+			return BakeResult_::failed;
+		}
+
+		// The format depends on the image's alpha if BC1 is enabled, so an
+		// existing BC7 file may need the image to decide
+		std::optional<ImageRGBA8> image;
+		try
+		{
+			if( !aForce )
+			{
+				auto const existing = open_texture_file( bakedPath.c_str() );
+				if( existing && *key == AssetSourceKey{ existing->header.sourceSize, existing->header.sourceModTime } )
+				{
+					auto const format = existing->header.format;
+					if( TextureFileFormat::bc7_srgb == format && !aBC1 )
+						return BakeResult_::upToDate;
+					if( TextureFileFormat::bc1_srgb == format && aBC1 )
+						return BakeResult_::upToDate;
+
+					if( TextureFileFormat::bc7_srgb == format && aBC1 )
+					{
+						image = load_image_rgba8( sourcePath.c_str() );
+						if( !image_is_opaque( *image ) )
+							return BakeResult_::upToDate;
+					}
+				}
+			}
+
+			if( !image )
+				image = load_image_rgba8( sourcePath.c_str() );
+
+			auto const format = aBC1 && image_is_opaque( *image ) ? TextureFileFormat::bc1_srgb : TextureFileFormat::bc7_srgb;
+			// (Offline, so use the sharper, more expensive filter)
+			auto const chain = generate_mip_chain( std::move(*image), MipFilter::kaiser );
+			auto const levels = encode_mip_chain( chain, format );
+			if( !write_texture_file( bakedPath.c_str(), *key, format, levels ) )
+				return BakeResult_::failed;
+
+			std::uint64_t bytes = 0;
+			for( auto const& level : levels )
+				bytes += level.data.size();
+
+			std::print( "  {} -> {} ({}x{}, {} levels, {}, {:.1f} MiB)\n", sourcePath, bakedPath, chain.front().width, chain.front().height, chain.size(),
+				TextureFileFormat::bc1_srgb == format ? "BC1" : "BC7", bytes / (1024.0*1024.0) );
+		}
+		catch( std::exception const& eErr )
+		{
+			std::print( stderr, "  {}: {}\n", sourcePath, eErr.what() );
+			return BakeResult_::failed;
+		}
+
+		return BakeResult_::baked;
+	}
+}
@@ -1,36 +1,85 @@
 #version 430
 
 // Inputs from Vertex Shader
-in vec3 v2fColor;
+flat in uint v2fMaterial;
 in vec3 v2fNormal;
 in vec3 v2fPos;
-in float vShininess;
 
 // Uniform inputs (unchanging per draw call)
-layout(location = 0) uniform mat4 uProjCameraWorld;
-layout(location = 1) uniform mat3 uNormalMatrix;
-layout(location = 3) uniform vec3 uLightDir; 
-layout(location = 4) uniform vec3 uLightDiffuse; 
-layout(location = 5) uniform vec3 uSceneAmbient;
-layout(location = 6) uniform bool uDirLightEnabled;
-layout(location = 7) uniform vec3 uCameraPos;
 layout(location = 8) uniform float uShininess; // Overwrite shininess value (-1 to use MTL value)
 
-// Point light struct for array
-struct PointLight {
+// Material table of the mesh being drawn (see main/material.hpp)
+struct Material {
+    vec3 diffuse;
+    float shininess;
+};
+
+layout(std140, binding = 0) uniform Materials {
+    Material uMaterials[256];
+};
+
+// Lighting, shared by all programs and updated once per frame (see main/frame_uniforms.hpp)
+layout(std140, binding = 1) uniform FrameData {
+    vec3 uLightDir;
+    bool uDirLightEnabled;
+    vec3 uLightDiffuse;
+    vec3 uSceneAmbient;
+};
+
+// Camera of the view being drawn (see main/frame_uniforms.hpp)
+layout(std140, binding = 2) uniform ViewData {
+    mat4 uProjCamera;
+    vec3 uCameraPos;
+};
+
+// Point lights, assigned to clusters of the view (see main/light_clusters.hpp)
+struct ClusterLight {
     vec3 position;
+    float radius;
     vec3 color;
-    bool enabled;
 };
 
-// Point light array for all 3 lights, each light will take up 3 consecutive uniform locations
-layout(location = 9) uniform PointLight uPointLights[3];
+layout(std430, binding = 5) readonly buffer ClusterLights {
+    ClusterLight uLights[];
+};
+layout(std430, binding = 6) readonly buffer ClusterGrid {
+    uvec2 uClusters[]; // first index and count of each cluster
+};
+layout(std430, binding = 7) readonly buffer ClusterIndices {
+    uint uLightIndices[];
+};
+
+layout(std140, binding = 3) uniform ClusterData {
+    vec4 uClusterViewport; // origin (pixels), tiles per pixel
+    vec4 uClusterDepth;    // near, far, slice scale, slice bias
+    uint uClusterTilesX;
+    uint uClusterTilesY;
+    uint uClusterSlices;
+};
 
 // Output (per pixel colour)
 out vec3 oColor;
 
+// Cluster of this fragment
+uint cluster_index()
+{
+    vec2 tile = (gl_FragCoord.xy - uClusterViewport.xy) * uClusterViewport.zw;
+
+    // Distance in front of the camera, from the window space depth
+    float zNear = uClusterDepth.x;
+    float zFar = uClusterDepth.y;
+    float depth = 2.0 * zNear * zFar / (zFar + zNear - (2.0 * gl_FragCoord.z - 1.0) * (zFar - zNear));
+    float slice = log(depth) * uClusterDepth.z + uClusterDepth.w;
+
+    uvec3 cluster = uvec3(max(vec3(tile, slice), vec3(0.0)));
+    cluster = min(cluster, uvec3(uClusterTilesX, uClusterTilesY, uClusterSlices) - 1u);
+    return (cluster.z * uClusterTilesY + cluster.y) * uClusterTilesX + cluster.x;
+}
+
 void main()
 {
+    Material material = uMaterials[v2fMaterial];
+
     vec3 normal = normalize(v2fNormal);
     vec3 viewDir = normalize(uCameraPos - v2fPos);
     
@@ -44,34 +93,38 @@ void main()
         finalColor += (nDotL * uLightDiffuse);
     }
 
-    // Itterate over each point light and add its contribution to final colour if enabled
-    for (int i = 0; i < 3; i++)
+    // Add the contribution of each point light that reaches this fragment's cluster
+    uvec2 cluster = uClusters[cluster_index()];
+    for (uint i = cluster.x; i < cluster.x + cluster.y; i++)
     {
-        if (uPointLights[i].enabled)
+        ClusterLight light = uLights[uLightIndices[i]];
+
+        vec3 lightDirRaw = light.position - v2fPos;
+        float dist = length(lightDirRaw);
+        if (dist < light.radius)
         {
-            vec3 lightDirRaw = uPointLights[i].position - v2fPos;
-            float dist = length(lightDirRaw);
-            vec3 lightDir = normalize(lightDirRaw);
+            vec3 lightDir = lightDirRaw / dist;
 
-            // Attenuation (1 / r^2)
-            float attenuation = 1.0 / (dist * dist);
+            // Attenuation (1 / r^2), windowed to reach zero at the light's radius
+            float window = clamp(1.0 - pow(dist / light.radius, 4.0), 0.0, 1.0);
+            float attenuation = window * window / (dist * dist);
 
             // Diffuse
             float nDotL = max(0.0, dot(normal, lightDir));
-            vec3 diffuse = uPointLights[i].color * nDotL;
+            vec3 diffuse = light.color * nDotL;
 
             // Specular
             vec3 halfVec = normalize(lightDir + viewDir);
             float nDotH = max(0.0, dot(normal, halfVec));
-            float actualShininess = (uShininess >= 0.0) ? uShininess : vShininess; // If a overwrite shine value is defined use it, otherwise use MTL
+            float actualShininess = (uShininess >= 0.0) ? uShininess : material.shininess; // If a overwrite shine value is defined use it, otherwise use MTL
             float specularFactor = pow(nDotH, actualShininess);
-            vec3 specular = uPointLights[i].color * specularFactor; // Multiply specular factor by the colour of light
+            vec3 specular = light.color * specularFactor; // Multiply specular factor by the colour of light
 
             // Accumulate
             finalColor += (diffuse + specular) * attenuation;
         }
     }
 
-    // Multiply the final colour by the colour received from vertex shader (for untextured objects)
-    oColor = finalColor * v2fColor; 
+    // Multiply the final colour by the material's colour (for untextured objects)
+    oColor = finalColor * material.diffuse; 
 }
\ No newline at end of file
@@ -1,31 +1,37 @@
 #version 430
 
-// Inputs - Position, Colour & Normal
+// Inputs - Position, Material index & Normal
 layout(location = 0) in vec3 iPosition;
-layout(location = 1) in vec3 iColor;
+layout(location = 1) in uint iMaterial;
 layout(location = 2) in vec3 iNormal;
-layout(location = 4) in float iShininess;
 
-// Uniform Inputs (unchanging per draw call) - Projection * Camera * World matrix, Normal Matrix & Model Matrix (required for lighting calculations)
-layout(location = 0) uniform mat4 uProjCameraWorld;
-layout(location = 1) uniform mat3 uNormalMatrix;
-layout(location = 2) uniform mat4 uModelMatrix;
+// Per instance input - Model matrix (uses locations 4 to 7; see instance_batcher.hpp)
+layout(location = 4) in mat4 iModelMatrix;
 
-// Outputs (to fragment) - Colour, Normal & Position (in world space)
-out vec3 v2fColor;
+// Uniform Inputs (unchanging per draw call) - The mesh's position dequantization (identity for unquantized meshes)
+layout(location = 2) uniform mat4 uPositionDequant;
+
+// Camera of the view being drawn (see main/frame_uniforms.hpp)
+layout(std140, binding = 2) uniform ViewData {
+    mat4 uProjCamera;
+    vec3 uCameraPos;
+};
+
+// Outputs (to fragment) - Material index, Normal & Position (in world space)
+flat out uint v2fMaterial;
 out vec3 v2fNormal;
 out vec3 v2fPos;
-out float vShininess;
 
 void main()
 {
-    v2fColor = iColor;
+    v2fMaterial = iMaterial;
 
-    vShininess = iShininess;
-    
-    v2fNormal = normalize(uNormalMatrix * iNormal);
+    // The normal matrix ignores the dequantization, as the normals are not quantized
+    mat3 normalMatrix = transpose(inverse(mat3(iModelMatrix)));
+    v2fNormal = normalize(normalMatrix * iNormal);
 
-    v2fPos = vec3(uModelMatrix * vec4(iPosition, 1.0));
+    vec4 worldPos = iModelMatrix * (uPositionDequant * vec4(iPosition, 1.0));
+    v2fPos = worldPos.xyz;
 
-    gl_Position = uProjCameraWorld * vec4(iPosition, 1.0);
+    gl_Position = uProjCamera * worldPos;
 }
\ No newline at end of file
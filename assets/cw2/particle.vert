@@ -7,6 +7,10 @@ layout(location = 1) in float iLife;
 // Just the MVP matrix, no model matrix needed since we simulate in world space
 layout(location = 0) uniform mat4 uProjCameraWorld;
 
+// Sprite size in pixels of the render target: x at distance one, y at most
+// (see particle_compositor.hpp)
+layout(location = 3) uniform vec2 uPointSize;
+
 out float vLife;
 
 void main()
@@ -17,8 +21,8 @@ void main()
     // Scale the point sprite based on how far away it is, gl_Position.w is the depth 
     float dist = gl_Position.w;
 
-    // 500 is just an arbitrary size
-    gl_PointSize = 500.0 / dist; 
+    // Clamped, so that close-ups don't turn into huge additive sprites
+    gl_PointSize = min(uPointSize.x / dist, uPointSize.y);
 
     // Pass life to frag shader so we can fade alpha over time
     vLife = iLife;
@@ -0,0 +1,14 @@
+#version 430
+
+in vec2 vTexCoord;
+
+// Accumulated particle colour (linear), filtered bilinearly when upsampling
+layout(location = 1) uniform sampler2D uParticles;
+
+out vec4 oColor;
+
+void main()
+{
+    // Added to the scene (additive blending)
+    oColor = vec4(texture(uParticles, vTexCoord).rgb, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 430
+
+// Full-viewport triangle for compositing the offscreen particle target. No
+// vertex attributes; the corners come from gl_VertexID.
+
+out vec2 vTexCoord;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+
+    vTexCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
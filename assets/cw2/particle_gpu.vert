@@ -0,0 +1,35 @@
+#version 430
+
+// Particle vertex shader for the GPU simulated particles. There are no
+// vertex attributes: vertex i draws the i-th particle on the alive list.
+
+struct Particle
+{
+    vec4 positionLife;     // xyz: position, w: remaining life (s)
+    vec4 velocityMaxLife;  // xyz: velocity, w: initial life (s)
+};
+
+layout(std430, binding = 0) readonly buffer Particles { Particle particles[]; };
+layout(std430, binding = 1) readonly buffer Alive { uint alive[]; };
+
+// Just the MVP matrix, no model matrix needed since we simulate in world space
+layout(location = 0) uniform mat4 uProjCameraWorld;
+
+// Sprite size, see particle.vert
+layout(location = 3) uniform vec2 uPointSize;
+
+out float vLife;
+
+void main()
+{
+    Particle particle = particles[alive[gl_VertexID]];
+
+    // Transform to clip space
+    gl_Position = uProjCameraWorld * vec4(particle.positionLife.xyz, 1.0);
+
+    // Same sprite size as particle.vert
+    gl_PointSize = min(uPointSize.x / gl_Position.w, uPointSize.y);
+
+    // Pass life to frag shader so we can fade alpha over time
+    vLife = particle.positionLife.w / particle.velocityMaxLife.w;
+}
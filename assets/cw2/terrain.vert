@@ -3,8 +3,14 @@ layout(location = 0) in vec3 iPosition;
 layout(location = 2) in vec3 iNormal;
 layout(location = 3) in vec2 iTexCoord;
 
-layout(location = 0) uniform mat4 uProjCameraWorld;
 layout(location = 1) uniform mat3 uNormalMatrix;
+layout(location = 18) uniform mat4 uModelMatrix;
+
+// Camera of the view being drawn (see main/frame_uniforms.hpp)
+layout(std140, binding = 2) uniform ViewData {
+    mat4 uProjCamera;
+    vec3 uCameraPos;
+};
 
 out vec3 vNormal;
 out vec2 vTexCoord;
@@ -14,6 +20,7 @@ void main()
 {
     vNormal = normalize(uNormalMatrix * iNormal);
     vTexCoord = iTexCoord;
-    v2fPos = iPosition;
-    gl_Position = uProjCameraWorld * vec4(iPosition, 1.0);
+    vec4 worldPos = uModelMatrix * vec4(iPosition, 1.0);
+    v2fPos = worldPos.xyz;
+    gl_Position = uProjCamera * worldPos;
 }
\ No newline at end of file
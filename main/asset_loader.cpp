@@ -0,0 +1,98 @@
+#include "asset_loader.hpp"
+
+#include <print>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+namespace
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	std::size_t loader_threads_( std::size_t aThreadCount )
+	{
+		if( 0 != aThreadCount )
+			return aThreadCount;
+
+		return std::max( 2u, std::thread::hardware_concurrency() );
+	}
+}
+
+AssetLoader::AssetLoader( std::size_t aThreadCount )
+	: mPool( loader_threads_( aThreadCount ) )
+{}
+
+AssetLoader::~AssetLoader() = default;
+
+std::size_t AssetLoader::poll()
+{
+	std::vector<Completed_> completed;
+	{
+		std::lock_guard lock( mMutex );
+		completed.swap( mCompleted );
+	}
+
+	return upload_( std::move(completed) );
+}
+
+void AssetLoader::finish()
+{
+	auto const start = Clock_::now();
+
+	while( poll() > 0 )
+	{
+		std::unique_lock lock( mMutex );
+		mDone.wait( lock, [this] { return !mCompleted.empty(); } );
+	}
+
+	auto const waitMs = std::chrono::duration<double, std::milli>( Clock_::now() - start ).count();
+	std::print( "Note: loaded {} assets (slowest: '{}', {:.1f} ms; waited {:.1f} ms)\n", mLoaded, mSlowest, mSlowestMs, waitMs );
+}
+
+void AssetLoader::submit_( std::string aName, std::function<std::function<void()>()> aLoad )
+{
+	++mOutstanding;
+
+	mPool.submit( [this, name = std::move(aName), load = std::move(aLoad)] () mutable {
+		Completed_ done{ std::move(name), {}, {}, 0.0 };
+
+		auto const start = Clock_::now();
+		try
+		{
+			done.upload = load();
+		}
+		catch( ... )
+		{
+			done.error = std::current_exception();
+		}
+		done.loadMs = std::chrono::duration<double, std::milli>( Clock_::now() - start ).count();
+
+		{
+			std::lock_guard lock( mMutex );
+			mCompleted.emplace_back( std::move(done) );
+		}
+		mDone.notify_one();
+	} );
+}
+
+std::size_t AssetLoader::upload_( std::vector<Completed_> aCompleted )
+{
+	for( auto& done : aCompleted )
+	{
+		--mOutstanding;
+
+		if( done.error )
+			std::rethrow_exception( done.error );
+
+		done.upload();
+
+		++mLoaded;
+		if( done.loadMs > mSlowestMs )
+		{
+			mSlowestMs = done.loadMs;
+			mSlowest = std::move(done.name);
+		}
+	}
+
+	return mOutstanding;
+}
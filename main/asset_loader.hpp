@@ -0,0 +1,111 @@
+#ifndef ASSET_LOADER_HPP_9F4C2A17_E05B_4D83_B6A1_72D8E3C05B94
+#define ASSET_LOADER_HPP_9F4C2A17_E05B_4D83_B6A1_72D8E3C05B94
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+#include <cstddef>
+
+#include "../support/thread_pool.hpp"
+
+/* Concurrent asset loading
+ *
+ * Each asset is loaded in two steps: a load step (file I/O, parsing,
+ * decoding) that runs on one of the loader's worker threads, and an upload
+ * step (GL calls) that runs on the thread that owns the GL context. The
+ * context thread is free to do other work (e.g., compile shaders) while the
+ * loads are running, and calls poll() or finish() to upload whatever has
+ * completed.
+ *
+ * Example:
+ *
+ *	AssetLoader loader;
+ *	GLuint texture = 0;
+ *	loader.add( "texture",
+ *		[] { return read_texture_2d( "a.png" ); },
+ *		[&] (TextureSource aSource) { texture = upload_texture_2d( aSource ); }
+ *	);
+ *	... // compile shaders etc
+ *	loader.finish();
+ *
+ * The load step must only touch data that it owns; its result is passed to
+ * the upload step by value.
+ */
+class AssetLoader final
+{
+	public:
+		// Zero threads means one per hardware thread, but at least two, since
+		// loading is partly I/O bound.
+		explicit AssetLoader( std::size_t aThreadCount = 0 );
+
+		// Waits for outstanding loads; their results are discarded.
+		~AssetLoader();
+
+		AssetLoader( AssetLoader const& ) = delete;
+		AssetLoader& operator= (AssetLoader const&) = delete;
+
+	public:
+		// Start loading an asset. aLoad() is called on a worker thread;
+		// aUpload( result ) is called later from poll() or finish().
+		template< typename tLoad, typename tUpload >
+		void add( std::string aName, tLoad&& aLoad, tUpload&& aUpload );
+
+		// Upload all assets that have finished loading, without waiting for
+		// the others. Returns the number of assets that are still loading.
+		// Rethrows the exception if a load has failed.
+		std::size_t poll();
+
+		// Upload assets as they finish loading, until all are done. Prints
+		// a summary of the load times.
+		void finish();
+
+	private:
+		struct Completed_
+		{
+			std::string name;
+			std::function<void()> upload;
+			std::exception_ptr error;
+			double loadMs;
+		};
+
+		// aLoad() returns the upload step, bound to the loaded data
+		void submit_( std::string aName, std::function<std::function<void()>()> aLoad );
+
+		std::size_t upload_( std::vector<Completed_> );
+
+		std::mutex mMutex;
+		std::condition_variable mDone;
+		std::vector<Completed_> mCompleted; // guarded by mMutex
+
+		std::size_t mOutstanding = 0;
+		std::size_t mLoaded = 0;
+		double mSlowestMs = 0.0;
+		std::string mSlowest;
+
+		// Destroyed first, which waits for the workers
+		ThreadPool mPool;
+};
+
+template< typename tLoad, typename tUpload >
+void AssetLoader::add( std::string aName, tLoad&& aLoad, tUpload&& aUpload )
+{
+	using Result_ = std::invoke_result_t<std::decay_t<tLoad>&>;
+
+	// std::function requires copyable targets, so move-only results (e.g.,
+	// mapped files) are passed through a shared_ptr.
+	submit_( std::move(aName), [load = std::forward<tLoad>(aLoad), upload = std::forward<tUpload>(aUpload)] () mutable {
+		auto result = std::make_shared<Result_>( load() );
+		return std::function<void()>( [upload = std::move(upload), result] () mutable {
+			upload( std::move(*result) );
+		} );
+	} );
+}
+
+#endif // ASSET_LOADER_HPP_9F4C2A17_E05B_4D83_B6A1_72D8E3C05B94
@@ -0,0 +1,27 @@
+#include "baked_assets.hpp"
+
+#include <filesystem>
+
+std::string baked_asset_path( char const* aSourcePath, char const* aExtension )
+{
+	std::filesystem::path const source( aSourcePath );
+
+	auto name = source.filename().string();
+	name += aExtension;
+
+	return (source.parent_path() / "baked" / name).generic_string();
+}
+
+std::optional<AssetSourceKey> asset_source_key( char const* aPath )
+{
+	std::error_code ec;
+	auto const size = std::filesystem::file_size( aPath, ec );
+	if( ec )
+		return {};
+
+	auto const time = std::filesystem::last_write_time( aPath, ec );
+	if( ec )
+		return {};
+
+	return AssetSourceKey{ std::uint64_t(size), std::int64_t(time.time_since_epoch().count()) };
+}
@@ -0,0 +1,36 @@
+#ifndef BAKED_ASSETS_HPP_47D1C0E2_9B3A_4F65_8C2E_1A6F5D93B7E0
+#define BAKED_ASSETS_HPP_47D1C0E2_9B3A_4F65_8C2E_1A6F5D93B7E0
+
+#include <string>
+#include <optional>
+
+#include <cstdint>
+
+/* Baked assets
+ *
+ * The asset-baker tool preprocesses source assets (OBJ/MTL meshes, JPEG/PNG
+ * textures) into runtime-ready files. For a source asset "<dir>/<name>", the
+ * baked output lives in "<dir>/baked/<name><extension>". When a baked file
+ * exists, the runtime loads it instead of the source asset.
+ */
+constexpr char const* kBakedMeshExtension = ".mesh";
+constexpr char const* kBakedTextureExtension = ".tex";
+
+std::string baked_asset_path( char const* aSourcePath, char const* aExtension );
+
+// Identifies the version of a source asset. Baked and cached files store the
+// key of the source they were created from, so that stale files can be
+// detected.
+struct AssetSourceKey
+{
+	std::uint64_t size;
+	std::int64_t modTime;
+
+	bool operator== (AssetSourceKey const&) const = default;
+};
+
+// Size and modification time of the given file. Returns an empty optional if
+// the file cannot be queried.
+std::optional<AssetSourceKey> asset_source_key( char const* aPath );
+
+#endif // BAKED_ASSETS_HPP_47D1C0E2_9B3A_4F65_8C2E_1A6F5D93B7E0
@@ -0,0 +1,50 @@
+#ifndef COUNTER_RNG_HPP_5A0E7C3B_82D6_4F19_A4B7_C1E93D06F258
+#define COUNTER_RNG_HPP_5A0E7C3B_82D6_4F19_A4B7_C1E93D06F258
+
+#include <array>
+
+#include <cstdint>
+
+// Counter-based random numbers (Philox4x32-10; Salmon et al., "Parallel
+// random numbers: as easy as 1, 2, 3", SC'11).
+//
+// The output is a pure function of a key and a counter, so there is no
+// generator state to share between threads or to advance in order: the n-th
+// number of stream k is philox4x32( {n,...}, k ) on whichever thread needs
+// it. Results are therefore the same for any number of threads.
+using PhiloxCounter = std::array<std::uint32_t,4>;
+using PhiloxKey = std::array<std::uint32_t,2>;
+
+constexpr
+PhiloxCounter philox4x32( PhiloxCounter aCounter, PhiloxKey aKey ) noexcept
+{
+	constexpr std::uint32_t kM0 = 0xD2511F53u, kM1 = 0xCD9E8D57u;
+	constexpr std::uint32_t kW0 = 0x9E3779B9u, kW1 = 0xBB67AE85u;
+
+	for( int round = 0; round < 10; ++round )
+	{
+		std::uint64_t const p0 = std::uint64_t(kM0) * aCounter[0];
+		std::uint64_t const p1 = std::uint64_t(kM1) * aCounter[2];
+
+		aCounter = {
+			std::uint32_t(p1 >> 32) ^ aCounter[1] ^ aKey[0],
+			std::uint32_t(p1),
+			std::uint32_t(p0 >> 32) ^ aCounter[3] ^ aKey[1],
+			std::uint32_t(p0)
+		};
+
+		aKey[0] += kW0;
+		aKey[1] += kW1;
+	}
+
+	return aCounter;
+}
+
+// Uniform float in [0,1) from the top 24 bits of aBits
+constexpr
+float uniform_float( std::uint32_t aBits ) noexcept
+{
+	return float(aBits >> 8) * (1.f / 16777216.f);
+}
+
+#endif // COUNTER_RNG_HPP_5A0E7C3B_82D6_4F19_A4B7_C1E93D06F258
@@ -51,7 +51,9 @@ SimpleMeshData make_cube( Vec3f aColor, Mat44f aPreTransform )
         n = normalize(t);
     }
 
-    std::vector col( pos.size(), aColor );
-
-    return SimpleMeshData{ std::move(pos), std::move(col), std::move(normals) };
+    SimpleMeshData ret;
+    ret.positions = std::move(pos);
+    ret.normals = std::move(normals);
+    set_material(ret, Material{ aColor, 0.f });
+    return ret;
 }
\ No newline at end of file
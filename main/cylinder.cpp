@@ -79,7 +79,9 @@ SimpleMeshData make_cylinder( bool aCapped, std::size_t aSubdivs, Vec3f aColor,
         n = normalize(t);
     }
 
-    std::vector col( pos.size(), aColor );
-
-    return SimpleMeshData{ std::move(pos), std::move(col), std::move(normals) };
+    SimpleMeshData ret;
+    ret.positions = std::move(pos);
+    ret.normals = std::move(normals);
+    set_material(ret, Material{ aColor, 0.f });
+    return ret;
 }
\ No newline at end of file
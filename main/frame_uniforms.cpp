@@ -0,0 +1,65 @@
+#include "frame_uniforms.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+ViewUniforms make_view_uniforms( Mat44f const& aProjCamera, Vec3f aCameraPos ) noexcept
+{
+	ViewUniforms ret;
+	ret.set<kViewProjCamera>( aProjCamera );
+	ret.set<kViewCameraPos>( aCameraPos );
+	return ret;
+}
+
+FrameUniformBuffers::FrameUniformBuffers( std::size_t aMaxViews )
+	: mMaxViews( std::max<std::size_t>( aMaxViews, 1 ) )
+{
+	GLint alignment = 1;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	alignment = std::max( alignment, 1 );
+
+	mViewStride = (ViewUniforms::size() + std::size_t(alignment) - 1) / std::size_t(alignment) * std::size_t(alignment);
+
+	glGenBuffers( 1, &mFrame );
+	glBindBuffer( GL_UNIFORM_BUFFER, mFrame );
+	glBufferData( GL_UNIFORM_BUFFER, FrameUniforms::size(), nullptr, GL_DYNAMIC_DRAW );
+
+	glGenBuffers( 1, &mViews );
+	glBindBuffer( GL_UNIFORM_BUFFER, mViews );
+	glBufferData( GL_UNIFORM_BUFFER, GLsizeiptr(mViewStride * mMaxViews), nullptr, GL_DYNAMIC_DRAW );
+
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+FrameUniformBuffers::~FrameUniformBuffers()
+{
+	glDeleteBuffers( 1, &mViews );
+	glDeleteBuffers( 1, &mFrame );
+}
+
+void FrameUniformBuffers::set_frame( FrameUniforms const& aFrame )
+{
+	glBindBuffer( GL_UNIFORM_BUFFER, mFrame );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, FrameUniforms::size(), aFrame.data() );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+	glBindBufferBase( GL_UNIFORM_BUFFER, kFrameBlockBinding, mFrame );
+}
+
+void FrameUniformBuffers::set_view( std::size_t aView, ViewUniforms const& aViewData )
+{
+	assert( aView < mMaxViews );
+
+	glBindBuffer( GL_UNIFORM_BUFFER, mViews );
+	glBufferSubData( GL_UNIFORM_BUFFER, GLintptr(aView * mViewStride), ViewUniforms::size(), aViewData.data() );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+	select_view( aView );
+}
+
+void FrameUniformBuffers::select_view( std::size_t aView ) const
+{
+	assert( aView < mMaxViews );
+	glBindBufferRange( GL_UNIFORM_BUFFER, kViewBlockBinding, mViews, GLintptr(aView * mViewStride), ViewUniforms::size() );
+}
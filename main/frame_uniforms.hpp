@@ -0,0 +1,107 @@
+#ifndef FRAME_UNIFORMS_HPP_6B1E0C93_A47D_4F28_B5E6_2D93C71F048A
+#define FRAME_UNIFORMS_HPP_6B1E0C93_A47D_4F28_B5E6_2D93C71F048A
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+#include "../vmlib/gpu_layout.hpp"
+
+/* Per-frame and per-view uniform blocks
+ *
+ * Lighting and camera data that all programs share live in two uniform
+ * buffers, bound to fixed binding points, instead of being set on each
+ * program separately. default.frag and terrain.frag (and the vertex
+ * shaders, for the view) declare
+ *
+ *   layout(std140, binding = 1) uniform FrameData
+ *   {
+ *       vec3 uLightDir;
+ *       bool uDirLightEnabled;
+ *       vec3 uLightDiffuse;
+ *       vec3 uSceneAmbient;
+ *   };
+ *
+ *   layout(std140, binding = 2) uniform ViewData
+ *   {
+ *       mat4 uProjCamera;
+ *       vec3 uCameraPos;
+ *   };
+ *
+ * The blocks are described with the std140 templates in vmlib/gpu_layout.hpp,
+ * so the offsets are derived (and checked below) instead of padded by hand.
+ * The frame data is uploaded once per frame, as a single copy; each view has
+ * its own range of the view buffer, so the views' data can be uploaded
+ * together and selected with select_view(). (Point lights are not part of
+ * the frame data; they are clustered, see light_clusters.hpp.)
+ */
+constexpr GLuint kFrameBlockBinding = 1;
+constexpr GLuint kViewBlockBinding = 2;
+
+using FrameUniforms = GpuBlock<GpuLayout::std140, GpuStruct<
+	Vec3f,   // uLightDir
+	bool,    // uDirLightEnabled
+	Vec3f,   // uLightDiffuse
+	Vec3f    // uSceneAmbient
+>>;
+
+using ViewUniforms = GpuBlock<GpuLayout::std140, GpuStruct<
+	Mat44f,  // uProjCamera
+	Vec3f    // uCameraPos
+>>;
+
+// Member indices, for FrameUniforms::set<>() etc.
+enum FrameUniformMember : std::size_t
+{
+	kFrameLightDir,
+	kFrameDirLightEnabled,
+	kFrameLightDiffuse,
+	kFrameSceneAmbient
+};
+enum ViewUniformMember : std::size_t
+{
+	kViewProjCamera,
+	kViewCameraPos
+};
+
+static_assert( 12 == FrameUniforms::offset<kFrameDirLightEnabled> );
+static_assert( 32 == FrameUniforms::offset<kFrameSceneAmbient> );
+static_assert( 48 == FrameUniforms::size() );
+static_assert( 64 == ViewUniforms::offset<kViewCameraPos> );
+static_assert( 80 == ViewUniforms::size() );
+
+// View uniforms for a view-projection matrix (row major, as Mat44f)
+ViewUniforms make_view_uniforms( Mat44f const& aProjCamera, Vec3f aCameraPos ) noexcept;
+
+class FrameUniformBuffers final
+{
+	public:
+		// Requires a current GL context
+		explicit FrameUniformBuffers( std::size_t aMaxViews = 2 );
+		~FrameUniformBuffers();
+
+		FrameUniformBuffers( FrameUniformBuffers const& ) = delete;
+		FrameUniformBuffers& operator= (FrameUniformBuffers const&) = delete;
+
+	public:
+		// Upload the frame data, and bind it to kFrameBlockBinding
+		void set_frame( FrameUniforms const& );
+
+		// Upload the data of view aView (< aMaxViews), and bind it to
+		// kViewBlockBinding
+		void set_view( std::size_t aView, ViewUniforms const& );
+
+		// Bind the data of view aView to kViewBlockBinding
+		void select_view( std::size_t aView ) const;
+
+	private:
+		GLuint mFrame = 0;
+		GLuint mViews = 0;
+
+		std::size_t mMaxViews;
+		std::size_t mViewStride; // multiple of the UBO offset alignment
+};
+
+#endif // FRAME_UNIFORMS_HPP_6B1E0C93_A47D_4F28_B5E6_2D93C71F048A
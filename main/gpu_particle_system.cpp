@@ -0,0 +1,197 @@
+#include "gpu_particle_system.hpp"
+
+#include <cmath>
+#include <iterator>
+#include <algorithm>
+
+#include <cstddef>
+
+#include "render_queue.hpp"
+
+namespace
+{
+	// Buffer binding points, see the particle_*.comp shaders
+	constexpr GLuint kParticlesBinding_ = 0;
+	constexpr GLuint kAliveCurrentBinding_ = 1;
+	constexpr GLuint kAliveNextBinding_ = 2;
+	constexpr GLuint kDeadBinding_ = 3;
+	constexpr GLuint kCountersBinding_ = 4;
+
+	// Local sizes of the compute shaders
+	constexpr std::uint32_t kResetGroupSize_ = 256;
+	constexpr std::uint32_t kSpawnGroupSize_ = 64;
+
+	// Layout (std430) of the counters buffer
+	struct DrawArraysIndirectCommand_
+	{
+		std::uint32_t count;
+		std::uint32_t instanceCount;
+		std::uint32_t first;
+		std::uint32_t baseInstance;
+	};
+	struct Counters_
+	{
+		DrawArraysIndirectCommand_ draws[2];
+		std::uint32_t dispatchUpdate[4];
+		std::int32_t deadCount;
+	};
+
+	constexpr std::size_t kParticleBytes_ = 2 * 4 * sizeof(float);
+
+	GLuint create_storage_( std::size_t aBytes )
+	{
+		GLuint buffer = 0;
+		glGenBuffers( 1, &buffer );
+		glBindBuffer( GL_SHADER_STORAGE_BUFFER, buffer );
+		glBufferData( GL_SHADER_STORAGE_BUFFER, GLsizeiptr(aBytes), nullptr, GL_DYNAMIC_COPY );
+		return buffer;
+	}
+}
+
+GpuParticleSystem::GpuParticleSystem( GpuParticleConfig const& aConfig )
+	: mConfig( aConfig )
+	, mResetProg( { { GL_COMPUTE_SHADER, "assets/cw2/particle_reset.comp" } } )
+	, mSpawnProg( { { GL_COMPUTE_SHADER, "assets/cw2/particle_spawn.comp" } } )
+	, mPrepareProg( { { GL_COMPUTE_SHADER, "assets/cw2/particle_prepare.comp" } } )
+	, mUpdateProg( { { GL_COMPUTE_SHADER, "assets/cw2/particle_update.comp" } } )
+{
+	auto const capacity = std::size_t(mConfig.capacity);
+
+	mParticles = create_storage_( capacity * kParticleBytes_ );
+	mAlive[0] = create_storage_( capacity * sizeof(std::uint32_t) );
+	mAlive[1] = create_storage_( capacity * sizeof(std::uint32_t) );
+	mDead = create_storage_( capacity * sizeof(std::uint32_t) );
+	mCounters = create_storage_( sizeof(Counters_) );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	// No vertex attributes, but core profile draws need a VAO
+	glGenVertexArrays( 1, &mVao );
+
+	clear();
+}
+
+GpuParticleSystem::~GpuParticleSystem()
+{
+	glDeleteVertexArrays( 1, &mVao );
+
+	GLuint const buffers[] = { mParticles, mAlive[0], mAlive[1], mDead, mCounters };
+	glDeleteBuffers( GLsizei(std::size(buffers)), buffers );
+}
+
+void GpuParticleSystem::init( ShaderProgram* aShader, GLuint aTexture )
+{
+	mShader = aShader;
+	mTexture = aTexture;
+}
+
+void GpuParticleSystem::update( float aDt, Vec3f aEmitterPos, bool aActive )
+{
+	// Spawn at a fixed rate; carry fractions over to the next update
+	std::uint32_t spawnCount = 0;
+	if( aActive )
+	{
+		mSpawnDebt += mConfig.spawnPerSecond * aDt;
+		auto const whole = std::floor( mSpawnDebt );
+		mSpawnDebt -= whole;
+		spawnCount = std::uint32_t(std::min( whole, float(mConfig.capacity) ));
+	}
+
+	if( mEmpty && 0 == spawnCount )
+		return;
+
+	mEmpty = false;
+	++mFrame;
+
+	bind_buffers_();
+
+	if( spawnCount > 0 )
+	{
+		glUseProgram( mSpawnProg.programId() );
+		glUniform1ui( 0, spawnCount );
+		glUniform3f( 1, aEmitterPos.x, aEmitterPos.y, aEmitterPos.z );
+		glUniform1ui( 2, mFrame );
+		glUniform1ui( 3, mCurrent );
+		glDispatchCompute( (spawnCount + kSpawnGroupSize_ - 1) / kSpawnGroupSize_, 1, 1 );
+		glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT );
+	}
+
+	glUseProgram( mPrepareProg.programId() );
+	glUniform1ui( 0, mCurrent );
+	glDispatchCompute( 1, 1, 1 );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+
+	glUseProgram( mUpdateProg.programId() );
+	glUniform1f( 0, aDt );
+	glUniform1ui( 1, mCurrent );
+	glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, mCounters );
+	glDispatchComputeIndirect( GLintptr(offsetof(Counters_, dispatchUpdate)) );
+	glBindBuffer( GL_DISPATCH_INDIRECT_BUFFER, 0 );
+
+	// (The indirect draw reads the new alive count, the vertex shader the
+	// particles.)
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+
+	mCurrent = 1 - mCurrent;
+	glUseProgram( 0 );
+}
+
+void GpuParticleSystem::clear()
+{
+	if( mEmpty )
+		return;
+
+	bind_buffers_();
+
+	glUseProgram( mResetProg.programId() );
+	glUniform1ui( 0, mConfig.capacity );
+	glDispatchCompute( (mConfig.capacity + kResetGroupSize_ - 1) / kResetGroupSize_, 1, 1 );
+	glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT );
+	glUseProgram( 0 );
+
+	mCurrent = 0;
+	mSpawnDebt = 0.f;
+	mEmpty = true;
+}
+
+void GpuParticleSystem::submit( RenderQueue& aQueue, Mat44f const& aViewProj, ParticleSpriteSize const& aSprite )
+{
+	if( !mShader || mEmpty )
+		return;
+
+	// Same uniforms and pass as ParticleSystem::submit()
+	GLuint const program = mShader->programId();
+	glProgramUniformMatrix4fv( program, 0, 1, GL_TRUE, aViewProj.v );
+	glProgramUniform4f( program, 2, 1.0f, 0.4f, 0.2f, 1.0f );
+	glProgramUniform2f( program, 3, aSprite.scale, aSprite.maxSize );
+	glProgramUniform1i( program, 1, 0 );
+
+	RenderDraw draw;
+	draw.mode = GL_POINTS;
+	draw.indirectBuffer = mCounters;
+	draw.indirectOffset = mCurrent * sizeof(DrawArraysIndirectCommand_);
+	draw.prepare = &bind_draw_buffers_;
+	draw.prepareData = this;
+
+	aQueue.submit( { RenderPass::additive, program, 0, mTexture, mVao }, 0.f, draw );
+}
+
+std::uint32_t GpuParticleSystem::capacity() const noexcept
+{
+	return mConfig.capacity;
+}
+
+void GpuParticleSystem::bind_draw_buffers_( void const* aSelf )
+{
+	auto const& self = *static_cast<GpuParticleSystem const*>(aSelf);
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kParticlesBinding_, self.mParticles );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kAliveCurrentBinding_, self.mAlive[self.mCurrent] );
+}
+
+void GpuParticleSystem::bind_buffers_() const
+{
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kParticlesBinding_, mParticles );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kAliveCurrentBinding_, mAlive[mCurrent] );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kAliveNextBinding_, mAlive[1 - mCurrent] );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kDeadBinding_, mDead );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kCountersBinding_, mCounters );
+}
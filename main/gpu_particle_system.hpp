@@ -0,0 +1,99 @@
+#ifndef GPU_PARTICLE_SYSTEM_HPP_7B1D4E92_C6A0_4F53_9E28_3A5C0D81F6B4
+#define GPU_PARTICLE_SYSTEM_HPP_7B1D4E92_C6A0_4F53_9E28_3A5C0D81F6B4
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+#include "../support/program.hpp"
+
+#include "particle_compositor.hpp"
+
+class RenderQueue;
+
+struct GpuParticleConfig
+{
+	// Number of particle slots. Spawning stops while all are in use.
+	std::uint32_t capacity = 1u << 18;
+
+	// Particles spawned per second of simulated time, while active (same
+	// default as ParticleEmitter)
+	float spawnPerSecond = 120.f;
+};
+
+/* Particle system simulated in compute shaders
+ *
+ * Particles are spawned and moved by the same rules as ParticleSystem's
+ * (particle_system.hpp), at the rate from GpuParticleConfig, but from a
+ * different random sequence. The particle state lives in shader storage
+ * buffers and never leaves the GPU:
+ *
+ *  - particle_spawn.comp takes free slots from a dead list and appends them
+ *    to the current alive list (atomic counters),
+ *  - particle_prepare.comp sizes the update dispatch from the alive count,
+ *  - particle_update.comp moves the live particles, appends survivors to the
+ *    next alive list and returns expired slots to the dead list.
+ *
+ * The two alive lists are swapped every update. Each alive list's count is
+ * the vertex count of an indirect draw command, so submit() draws with
+ * glDrawArraysIndirect() without reading anything back; particle_gpu.vert
+ * fetches the particles by gl_VertexID.
+ *
+ * No particle data is uploaded per frame; only uniforms are set. Requires GL
+ * 4.3 (compute shaders, SSBOs).
+ */
+class GpuParticleSystem final
+{
+	public:
+		// Compiles the compute shaders. Throws Error on failure.
+		explicit GpuParticleSystem( GpuParticleConfig const& = {} );
+		~GpuParticleSystem();
+
+		GpuParticleSystem( GpuParticleSystem const& ) = delete;
+		GpuParticleSystem& operator= (GpuParticleSystem const&) = delete;
+
+	public:
+		// Program for drawing (particle_gpu.vert + particle.frag) and texture
+		void init( ShaderProgram* aShader, GLuint aTexture );
+
+		// Spawn new particles (if active) and run the simulation
+		void update( float aDt, Vec3f aEmitterPos, bool aActive );
+
+		// Kill all particles
+		void clear();
+
+		// Queue drawing the particles (additive pass). aSprite: see
+		// ParticleCompositor::begin()
+		void submit( RenderQueue&, Mat44f const& aViewProj, ParticleSpriteSize const& aSprite );
+
+		std::uint32_t capacity() const noexcept;
+
+	private:
+		void bind_buffers_() const;
+		static void bind_draw_buffers_( void const* aSelf );
+
+		GpuParticleConfig mConfig;
+
+		ShaderProgram mResetProg;
+		ShaderProgram mSpawnProg;
+		ShaderProgram mPrepareProg;
+		ShaderProgram mUpdateProg;
+
+		ShaderProgram* mShader = nullptr;
+		GLuint mTexture = 0;
+
+		GLuint mParticles = 0;
+		GLuint mAlive[2] = {};
+		GLuint mDead = 0;
+		GLuint mCounters = 0;
+		GLuint mVao = 0;
+
+		std::uint32_t mCurrent = 0; // alive list with the live particles
+		std::uint32_t mFrame = 0;
+		float mSpawnDebt = 0.f;     // fractional particles not spawned yet
+		bool mEmpty = false;
+};
+
+#endif // GPU_PARTICLE_SYSTEM_HPP_7B1D4E92_C6A0_4F53_9E28_3A5C0D81F6B4
@@ -0,0 +1,153 @@
+#include "instance_batcher.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+
+#include "render_queue.hpp"
+
+namespace
+{
+	// One instance: the model matrix, column by column (as a mat4 attribute
+	// is read)
+	constexpr std::size_t kInstanceBytes_ = 16 * sizeof(float);
+
+	void write_columns_( Mat44f const& aModel, float* aOut ) noexcept
+	{
+		for( std::size_t col = 0; col < 4; ++col )
+		{
+			for( std::size_t row = 0; row < 4; ++row )
+				aOut[col*4 + row] = aModel[row, col];
+		}
+	}
+
+	void set_mesh_uniforms_( void const* aMesh )
+	{
+		auto const& mesh = *static_cast<InstancedMesh const*>(aMesh);
+		glUniformMatrix4fv( 2, 1, GL_TRUE, mesh.dequant.v );
+		glUniform1f( 8, mesh.shininess );
+	}
+}
+
+InstanceBatcher::InstanceBatcher( std::size_t aMaxInstances )
+	: mInstances( std::max<std::size_t>( aMaxInstances, 1 ) * kInstanceBytes_ )
+	, mMaxInstances( std::max<std::size_t>( aMaxInstances, 1 ) )
+{}
+
+InstanceBatcher::MeshId InstanceBatcher::add_mesh( InstancedMesh const& aMesh )
+{
+	glBindVertexArray( aMesh.vao );
+	glBindBuffer( GL_ARRAY_BUFFER, mInstances.buffer() );
+
+	for( GLuint i = 0; i < 4; ++i )
+	{
+		auto const* const offset = reinterpret_cast<void const*>(i * 4 * sizeof(float));
+		glVertexAttribPointer( kInstanceModelLocation + i, 4, GL_FLOAT, GL_FALSE, GLsizei(kInstanceBytes_), offset );
+		glVertexAttribDivisor( kInstanceModelLocation + i, 1 );
+		glEnableVertexAttribArray( kInstanceModelLocation + i );
+	}
+
+	glBindVertexArray( 0 );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+	mMeshes.emplace_back( aMesh );
+	return MeshId(mMeshes.size()-1);
+}
+
+void InstanceBatcher::add( MeshId aMesh, std::uint32_t aFirst, std::uint32_t aCount, Mat44f const& aModel )
+{
+	assert( aMesh < mMeshes.size() );
+
+	// There are few distinct meshes and ranges per frame, so a linear search
+	// is fine
+	auto const active = mBatches.begin() + std::ptrdiff_t(mActiveBatches);
+	auto it = std::find_if( mBatches.begin(), active, [&] (Batch_ const& aBatch) {
+		return aBatch.mesh == aMesh && aBatch.first == aFirst && aBatch.count == aCount;
+	} );
+
+	if( active == it )
+	{
+		if( mActiveBatches == mBatches.size() )
+			mBatches.emplace_back();
+
+		it = mBatches.begin() + std::ptrdiff_t(mActiveBatches++);
+		it->mesh = aMesh;
+		it->first = aFirst;
+		it->count = aCount;
+		it->models.clear();
+	}
+
+	it->models.emplace_back( aModel );
+}
+void InstanceBatcher::add( MeshId aMesh, MeshLod const& aLod, Mat44f const& aModel )
+{
+	add( aMesh, aLod.firstIndex, aLod.indexCount, aModel );
+}
+
+void InstanceBatcher::flush( RenderQueue& aQueue, GLuint aProgram )
+{
+	mDrawCount = 0;
+	mInstanceCount = 0;
+
+	if( 0 == mActiveBatches )
+		return;
+
+	// Write the model matrices into the instance buffer, and submit a draw
+	// for each batch (or part of one, if the region fills up)
+	auto region = mInstances.begin_region();
+	std::size_t used = 0;
+
+	for( std::size_t i = 0; i < mActiveBatches; ++i )
+	{
+		auto const& batch = mBatches[i];
+		auto const& mesh = mMeshes[batch.mesh];
+
+		for( std::size_t offset = 0; offset < batch.models.size(); )
+		{
+			if( mMaxInstances == used )
+			{
+				mInstances.end_region( used * kInstanceBytes_ );
+				aQueue.execute();
+
+				region = mInstances.begin_region();
+				used = 0;
+			}
+
+			auto const count = std::min( batch.models.size() - offset, mMaxInstances - used );
+
+			auto* const out = reinterpret_cast<float*>(region.data() + used * kInstanceBytes_);
+			for( std::size_t j = 0; j < count; ++j )
+				write_columns_( batch.models[offset + j], out + j*16 );
+
+			RenderDraw draw;
+			draw.indexType = mesh.indexType;
+			draw.first = batch.first;
+			draw.count = batch.count;
+			draw.instanceCount = std::uint32_t(count);
+			draw.baseInstance = std::uint32_t(mInstances.region_offset() / kInstanceBytes_ + used);
+			draw.prepare = &set_mesh_uniforms_;
+			draw.prepareData = &mesh;
+
+			aQueue.submit( { RenderPass::opaque, aProgram, mesh.materials, 0, mesh.vao }, 0.f, draw );
+			++mDrawCount;
+
+			used += count;
+			offset += count;
+		}
+
+		mInstanceCount += batch.models.size();
+	}
+
+	mInstances.end_region( used * kInstanceBytes_ );
+
+	mActiveBatches = 0;
+}
+
+std::size_t InstanceBatcher::draw_count() const noexcept
+{
+	return mDrawCount;
+}
+std::size_t InstanceBatcher::instance_count() const noexcept
+{
+	return mInstanceCount;
+}
@@ -0,0 +1,129 @@
+#ifndef INSTANCE_BATCHER_HPP_3C8E51A7_D29B_4F04_96E2_7A0B4D15C6F3
+#define INSTANCE_BATCHER_HPP_3C8E51A7_D29B_4F04_96E2_7A0B4D15C6F3
+
+#include <glad/glad.h>
+
+#include <array>
+#include <deque>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/mat44.hpp"
+
+#include "../support/stream_buffer.hpp"
+
+#include "mesh_lod.hpp"
+
+class RenderQueue;
+
+// Per-instance model matrix input of default.vert (a mat4 uses this location
+// and the three following ones)
+constexpr GLuint kInstanceModelLocation = 4;
+
+// Vertex input locations of a program that draws meshes with layout tLayout
+// through an InstanceBatcher (for check_vertex_inputs())
+template< typename tLayout >
+constexpr auto instanced_locations() noexcept
+{
+	std::array<GLuint, tLayout::locations.size() + 4> ret{};
+	for( std::size_t i = 0; i < tLayout::locations.size(); ++i )
+		ret[i] = tLayout::locations[i];
+	for( GLuint i = 0; i < 4; ++i )
+		ret[tLayout::locations.size() + i] = kInstanceModelLocation + i;
+	return ret;
+}
+
+// A mesh that is drawn with instancing. Instances of the same mesh share the
+// VAO, the material table and the uniforms below.
+struct InstancedMesh
+{
+	GLuint vao;
+	GLuint materials;                // from create_material_buffer()
+	GLenum indexType = GL_NONE;      // GL_NONE for non-indexed meshes
+
+	Mat44f dequant = kIdentity44f;   // quantized positions to model space
+	float shininess = -1.f;          // default.frag uShininess
+};
+
+/* Instanced drawing of repeated meshes with default.vert
+ *
+ * Objects are queued with add() (one model matrix per object), and flush()
+ * submits one instanced draw per mesh and index/vertex range (e.g., per LOD)
+ * to a RenderQueue, rather than one draw per object. The model matrices are
+ * written to a StreamBuffer and read by default.vert as a per-instance
+ * attribute; the shader derives the world position and normal matrix from
+ * them, so no per-object uniforms are set.
+ *
+ * Draws select their slice of the instance buffer with the base instance
+ * (GL 4.2), so the attribute pointers are set up once, by add_mesh(), rather
+ * than per draw. If a flush exceeds one region of the buffer, it executes the
+ * render queue (as the region's draws must be issued before the buffer moves
+ * on), and continues in the next region.
+ *
+ * The program is default.vert/default.frag or compatible, and takes the camera
+ * from the view uniform block (frame_uniforms.hpp). Each draw sets uniform
+ * locations 2 (position dequantization) and 8 (shininess) of its mesh.
+ *
+ * Example:
+ *
+ *	auto const pad = batcher.add_mesh( { padVao, padMaterials, padIndexType, padDequant } );
+ *	for( auto const& position : padPositions )
+ *		batcher.add( pad, padLods[lod], make_translation( position ) );
+ *	batcher.flush( queue, prog.programId() );
+ */
+class InstanceBatcher final
+{
+	public:
+		using MeshId = std::uint32_t;
+
+		// Requires a current GL context. aMaxInstances is the number of
+		// instances per region of the instance buffer.
+		explicit InstanceBatcher( std::size_t aMaxInstances = 4096 );
+
+		InstanceBatcher( InstanceBatcher const& ) = delete;
+		InstanceBatcher& operator= (InstanceBatcher const&) = delete;
+
+	public:
+		// Register a mesh, and add the instance attributes to its VAO. A VAO
+		// can only be used with one InstanceBatcher.
+		MeshId add_mesh( InstancedMesh const& );
+
+		// Queue an instance that draws aCount indices from aFirst (indexed
+		// meshes) or aCount vertices from aFirst (non-indexed)
+		void add( MeshId, std::uint32_t aFirst, std::uint32_t aCount, Mat44f const& aModel );
+		void add( MeshId, MeshLod const&, Mat44f const& aModel );
+
+		// Submit the queued instances to aQueue, to be drawn with aProgram,
+		// and clear them
+		void flush( RenderQueue& aQueue, GLuint aProgram );
+
+		// Draws and instances submitted by the last flush()
+		std::size_t draw_count() const noexcept;
+		std::size_t instance_count() const noexcept;
+
+	private:
+		struct Batch_
+		{
+			MeshId mesh;
+			std::uint32_t first;
+			std::uint32_t count;
+			std::vector<Mat44f> models;
+		};
+		StreamBuffer mInstances;
+		std::size_t mMaxInstances;
+
+		// (A deque, so that the submitted draws can point to the meshes)
+		std::deque<InstancedMesh> mMeshes;
+
+		// Batches persist between flushes (with their storage); only those
+		// below mActiveBatches are in use
+		std::vector<Batch_> mBatches;
+		std::size_t mActiveBatches = 0;
+
+		std::size_t mDrawCount = 0;
+		std::size_t mInstanceCount = 0;
+};
+
+#endif // INSTANCE_BATCHER_HPP_3C8E51A7_D29B_4F04_96E2_7A0B4D15C6F3
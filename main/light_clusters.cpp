@@ -0,0 +1,305 @@
+#include "light_clusters.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include "../vmlib/vec4.hpp"
+#include "../support/thread_pool.hpp"
+
+namespace
+{
+	// Initial buffer capacities (grown on demand)
+	constexpr std::size_t kInitialLights_ = 256;
+	constexpr std::size_t kInitialIndicesPerCluster_ = 4;
+
+	GLuint create_storage_( std::size_t aBytes )
+	{
+		GLuint buffer = 0;
+		glGenBuffers( 1, &buffer );
+		glBindBuffer( GL_SHADER_STORAGE_BUFFER, buffer );
+		glBufferData( GL_SHADER_STORAGE_BUFFER, GLsizeiptr(aBytes), nullptr, GL_DYNAMIC_DRAW );
+		return buffer;
+	}
+
+	// Upload aBytes to aBuffer, growing it (to at least twice its capacity)
+	// if it does not fit
+	void upload_storage_( GLuint aBuffer, std::size_t& aCapacity, void const* aData, std::size_t aBytes )
+	{
+		glBindBuffer( GL_SHADER_STORAGE_BUFFER, aBuffer );
+		if( aBytes > aCapacity )
+		{
+			aCapacity = std::max( aBytes, 2*aCapacity );
+			glBufferData( GL_SHADER_STORAGE_BUFFER, GLsizeiptr(aCapacity), nullptr, GL_DYNAMIC_DRAW );
+		}
+
+		if( aBytes )
+			glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(aBytes), aData );
+	}
+
+	std::uint32_t tile_( float aNdc, std::uint32_t aTiles ) noexcept
+	{
+		auto const tile = std::floor( (aNdc * 0.5f + 0.5f) * float(aTiles) );
+		return std::uint32_t(std::clamp( tile, 0.f, float(aTiles - 1) ));
+	}
+
+	// Distance from aValue to the range [aMin, aMax]
+	float outside_( float aValue, float aMin, float aMax ) noexcept
+	{
+		return std::max( { aMin - aValue, 0.f, aValue - aMax } );
+	}
+}
+
+float light_radius( Vec3f aColor, float aCutoff ) noexcept
+{
+	assert( aCutoff > 0.f );
+	auto const intensity = std::max( { aColor.x, aColor.y, aColor.z, 0.f } );
+	return std::sqrt( intensity / aCutoff );
+}
+
+LightClusters::LightClusters( std::size_t aMaxViews, LightClusterConfig const& aConfig, ThreadPool* aPool )
+	: mConfig( aConfig )
+	, mPool( aPool ? aPool : &default_thread_pool() )
+	, mViews( std::max<std::size_t>( aMaxViews, 1 ) )
+{
+	mConfig.tilesX = std::max( mConfig.tilesX, 1u );
+	mConfig.tilesY = std::max( mConfig.tilesY, 1u );
+	mConfig.slices = std::max( mConfig.slices, 1u );
+
+	auto const clusters = std::size_t(mConfig.tilesX) * mConfig.tilesY * mConfig.slices;
+
+	GLint alignment = 1;
+	glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment );
+	alignment = std::max( alignment, 1 );
+
+	mClusterDataStride = (ClusterData_::size() + std::size_t(alignment) - 1) / std::size_t(alignment) * std::size_t(alignment);
+
+	glGenBuffers( 1, &mClusterData );
+	glBindBuffer( GL_UNIFORM_BUFFER, mClusterData );
+	glBufferData( GL_UNIFORM_BUFFER, GLsizeiptr(mClusterDataStride * mViews.size()), nullptr, GL_DYNAMIC_DRAW );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+	mLightCapacity = kInitialLights_ * sizeof(ClusterLight);
+	mLightBuffer = create_storage_( mLightCapacity );
+
+	for( auto& view : mViews )
+	{
+		view.grid = create_storage_( 2 * clusters * sizeof(std::uint32_t) );
+
+		view.indexCapacity = kInitialIndicesPerCluster_ * clusters * sizeof(std::uint32_t);
+		view.indices = create_storage_( view.indexCapacity );
+	}
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	mSlices.resize( mConfig.slices );
+	mGrid.resize( 2 * clusters );
+}
+
+LightClusters::~LightClusters()
+{
+	for( auto const& view : mViews )
+	{
+		glDeleteBuffers( 1, &view.indices );
+		glDeleteBuffers( 1, &view.grid );
+	}
+
+	glDeleteBuffers( 1, &mLightBuffer );
+	glDeleteBuffers( 1, &mClusterData );
+}
+
+void LightClusters::set_lights( std::span<ClusterLight const> aLights )
+{
+	mLights.assign( aLights.begin(), aLights.end() );
+
+	upload_storage_( mLightBuffer, mLightCapacity, mLights.data(), mLights.size() * sizeof(ClusterLight) );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kClusterLightsBinding, mLightBuffer );
+}
+
+void LightClusters::assign( std::size_t aView, Mat44f const& aWorldToView, Mat44f const& aProjection, int aX, int aY, int aWidth, int aHeight )
+{
+	assert( aView < mViews.size() );
+
+	auto const tilesX = mConfig.tilesX;
+	auto const tilesY = mConfig.tilesY;
+	auto const slices = mConfig.slices;
+
+	// Camera parameters from the projection matrix (see
+	// make_perspective_projection())
+	float const sx = aProjection[0,0], sy = aProjection[1,1];
+	float const zNear = aProjection[2,3] / (aProjection[2,2] - 1.f);
+	float const zFar = aProjection[2,3] / (aProjection[2,2] + 1.f);
+
+	// Slice s covers the distances zNear * (zFar/zNear)^(s/slices) up to
+	// that of s+1
+	float const logRatio = std::log( zFar / zNear );
+	float const sliceScale = float(slices) / logRatio;
+	float const sliceBias = -float(slices) * std::log( zNear ) / logRatio;
+
+	auto const slice_of = [&] (float aDepth) {
+		auto const slice = std::floor( std::log( aDepth ) * sliceScale + sliceBias );
+		return std::uint32_t(std::clamp( slice, 0.f, float(slices - 1) ));
+	};
+	auto const slice_depth = [&] (std::uint32_t aSlice) {
+		return zNear * std::exp( float(aSlice) / sliceScale );
+	};
+
+	// Lights in the view, with the clusters that their bounding box covers
+	mCandidates.clear();
+	for( std::size_t i = 0; i < mLights.size(); ++i )
+	{
+		auto const& light = mLights[i];
+
+		Vec4f const view = aWorldToView * Vec4f{ light.position.x, light.position.y, light.position.z, 1.f };
+		Vec3f const center{ view.x, view.y, -view.z };
+		float const r = light.radius;
+
+		if( !(r > 0.f) || center.z + r < zNear || center.z - r > zFar )
+			continue;
+
+		// Projected bounds of the box around the light. The box is reached
+		// at distances between center.z +- r; x/z is extremal at one of
+		// them. Lights that cross the near plane cover the whole screen.
+		float nx0 = -1.f, nx1 = 1.f, ny0 = -1.f, ny1 = 1.f;
+		if( center.z - r > zNear )
+		{
+			float const d0 = center.z - r, d1 = center.z + r;
+			nx0 = sx * std::min( (center.x - r) / d0, (center.x - r) / d1 );
+			nx1 = sx * std::max( (center.x + r) / d0, (center.x + r) / d1 );
+			ny0 = sy * std::min( (center.y - r) / d0, (center.y - r) / d1 );
+			ny1 = sy * std::max( (center.y + r) / d0, (center.y + r) / d1 );
+
+			if( nx1 < -1.f || nx0 > 1.f || ny1 < -1.f || ny0 > 1.f )
+				continue;
+		}
+
+		mCandidates.emplace_back( Candidate_{
+			std::uint32_t(i), center, r,
+			slice_of( std::max( center.z - r, zNear ) ), slice_of( std::min( center.z + r, zFar ) ),
+			tile_( nx0, tilesX ), tile_( nx1, tilesX ),
+			tile_( ny0, tilesY ), tile_( ny1, tilesY )
+		} );
+	}
+
+	// Per slice, test the candidates against the (view space) bounding box
+	// of each cluster. Slices are independent: each writes its own clusters
+	// of mGrid, with offsets relative to its own index list.
+	mPool->parallel_for( slices, [&] (std::size_t aSlice) {
+		auto& scratch = mSlices[aSlice];
+		auto& indices = scratch.indices;
+		indices.clear();
+
+		auto const slice = std::uint32_t(aSlice);
+		float const z0 = slice_depth( slice ), z1 = slice_depth( slice + 1 );
+
+		// Candidates in this slice, and in this row of tiles
+		scratch.slice.clear();
+		for( auto const& cand : mCandidates )
+		{
+			if( slice >= cand.slice0 && slice <= cand.slice1 )
+				scratch.slice.emplace_back( &cand );
+		}
+
+		for( std::uint32_t y = 0; y < tilesY; ++y )
+		{
+			float const b0 = -1.f + 2.f * float(y) / float(tilesY);
+			float const b1 = -1.f + 2.f * float(y+1) / float(tilesY);
+			float const y0 = std::min( b0*z0, b0*z1 ) / sy, y1 = std::max( b1*z0, b1*z1 ) / sy;
+
+			scratch.row.clear();
+			for( auto const* cand : scratch.slice )
+			{
+				if( y >= cand->y0 && y <= cand->y1 )
+					scratch.row.emplace_back( cand );
+			}
+
+			for( std::uint32_t x = 0; x < tilesX; ++x )
+			{
+				float const a0 = -1.f + 2.f * float(x) / float(tilesX);
+				float const a1 = -1.f + 2.f * float(x+1) / float(tilesX);
+				float const x0 = std::min( a0*z0, a0*z1 ) / sx, x1 = std::max( a1*z0, a1*z1 ) / sx;
+
+				auto const first = indices.size();
+				for( auto const* cand : scratch.row )
+				{
+					if( x < cand->x0 || x > cand->x1 )
+						continue;
+
+					float const dx = outside_( cand->center.x, x0, x1 );
+					float const dy = outside_( cand->center.y, y0, y1 );
+					float const dz = outside_( cand->center.z, z0, z1 );
+					if( dx*dx + dy*dy + dz*dz <= cand->radius*cand->radius )
+						indices.emplace_back( cand->light );
+				}
+
+				auto const cluster = (std::size_t(slice) * tilesY + y) * tilesX + x;
+				mGrid[2*cluster+0] = std::uint32_t(first);
+				mGrid[2*cluster+1] = std::uint32_t(indices.size() - first);
+			}
+		}
+	} );
+
+	// Concatenate the slices' lists
+	mIndices.clear();
+	mStats = {};
+	mStats.lights = mCandidates.size();
+
+	auto const clustersPerSlice = std::size_t(tilesX) * tilesY;
+	for( std::size_t slice = 0; slice < slices; ++slice )
+	{
+		auto const base = std::uint32_t(mIndices.size());
+		for( std::size_t i = 0; i < clustersPerSlice; ++i )
+		{
+			auto const cluster = slice * clustersPerSlice + i;
+			mGrid[2*cluster+0] += base;
+			mStats.maxPerCluster = std::max<std::size_t>( mStats.maxPerCluster, mGrid[2*cluster+1] );
+		}
+
+		auto const& indices = mSlices[slice].indices;
+		mIndices.insert( mIndices.end(), indices.begin(), indices.end() );
+	}
+
+	mStats.indices = mIndices.size();
+
+	// Upload
+	auto& view = mViews[aView];
+
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, view.grid );
+	glBufferSubData( GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(mGrid.size() * sizeof(std::uint32_t)), mGrid.data() );
+
+	upload_storage_( view.indices, view.indexCapacity, mIndices.data(), mIndices.size() * sizeof(std::uint32_t) );
+	glBindBuffer( GL_SHADER_STORAGE_BUFFER, 0 );
+
+	ClusterData_ data;
+	data.set<0>( Vec4f{ float(aX), float(aY), float(tilesX) / float(std::max( aWidth, 1 )), float(tilesY) / float(std::max( aHeight, 1 )) } );
+	data.set<1>( Vec4f{ zNear, zFar, sliceScale, sliceBias } );
+	data.set<2>( tilesX );
+	data.set<3>( tilesY );
+	data.set<4>( slices );
+
+	glBindBuffer( GL_UNIFORM_BUFFER, mClusterData );
+	glBufferSubData( GL_UNIFORM_BUFFER, GLintptr(aView * mClusterDataStride), GLsizeiptr(data.size()), data.data() );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+
+	select_view( aView );
+}
+
+void LightClusters::select_view( std::size_t aView ) const
+{
+	assert( aView < mViews.size() );
+	auto const& view = mViews[aView];
+
+	glBindBufferRange( GL_UNIFORM_BUFFER, kClusterBlockBinding, mClusterData, GLintptr(aView * mClusterDataStride), GLsizeiptr(ClusterData_::size()) );
+
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kClusterLightsBinding, mLightBuffer );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kClusterGridBinding, view.grid );
+	glBindBufferBase( GL_SHADER_STORAGE_BUFFER, kClusterIndicesBinding, view.indices );
+}
+
+LightClusterStats const& LightClusters::stats() const noexcept
+{
+	return mStats;
+}
@@ -0,0 +1,167 @@
+#ifndef LIGHT_CLUSTERS_HPP_E4A07C5D_1B93_4F26_8D3A_6C92B5F0E718
+#define LIGHT_CLUSTERS_HPP_E4A07C5D_1B93_4F26_8D3A_6C92B5F0E718
+
+#include <glad/glad.h>
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+#include "../vmlib/gpu_layout.hpp"
+
+class ThreadPool;
+
+/* Clustered point lights
+ *
+ * The view frustum is divided into a grid of clusters: tilesX x tilesY
+ * screen tiles, each cut into depth slices whose thickness grows
+ * exponentially with the distance. assign() builds, on the CPU, the list of
+ * lights whose range reaches each cluster. The fragment shaders
+ * (default.frag, terrain.frag) find the cluster of the fragment and only
+ * evaluate the lights in its list, so the cost depends on how many lights
+ * are nearby rather than on the total number of lights.
+ *
+ * The shaders declare
+ *
+ *   struct ClusterLight { vec3 position; float radius; vec3 color; };
+ *
+ *   layout(std430, binding = 5) readonly buffer ClusterLights { ClusterLight uLights[]; };
+ *   layout(std430, binding = 6) readonly buffer ClusterGrid { uvec2 uClusters[]; };
+ *   layout(std430, binding = 7) readonly buffer ClusterIndices { uint uLightIndices[]; };
+ *
+ *   layout(std140, binding = 3) uniform ClusterData
+ *   {
+ *       vec4 uClusterViewport; // origin (pixels), tiles per pixel
+ *       vec4 uClusterDepth;    // near, far, slice scale, slice bias
+ *       uint uClusterTilesX;
+ *       uint uClusterTilesY;
+ *       uint uClusterSlices;
+ *   };
+ *
+ * where uClusters[c] is the (first, count) range of cluster c's light
+ * indices; clusters are numbered (slice * tilesY + y) * tilesX + x. The
+ * lights are shared by all views; the clusters are per view, like the
+ * ViewData (frame_uniforms.hpp).
+ *
+ * A light reaches out to its radius, where its 1/d^2 falloff is windowed to
+ * zero (see light_radius()).
+ */
+constexpr GLuint kClusterBlockBinding = 3;
+
+constexpr GLuint kClusterLightsBinding = 5;
+constexpr GLuint kClusterGridBinding = 6;
+constexpr GLuint kClusterIndicesBinding = 7;
+
+struct ClusterLight
+{
+	Vec3f position; // world space
+	float radius;
+	Vec3f color;    // intensity at unit distance
+	float pad0_;
+};
+
+static_assert( sizeof(ClusterLight) == GpuLayoutTraits<GpuLayout::std430, GpuStruct<Vec3f, float, Vec3f>>::size );
+static_assert( offsetof(ClusterLight, color) == GpuLayoutTraits<GpuLayout::std430, GpuStruct<Vec3f, float, Vec3f>>::offsets[2] );
+
+// Light intensity below which a light is cut off
+constexpr float kClusterLightCutoff = 0.01f;
+
+// Distance at which a light with aColor falls off to aCutoff
+float light_radius( Vec3f aColor, float aCutoff = kClusterLightCutoff ) noexcept;
+
+struct LightClusterConfig
+{
+	std::uint32_t tilesX = 16;
+	std::uint32_t tilesY = 9;
+	std::uint32_t slices = 24;
+};
+
+struct LightClusterStats
+{
+	std::size_t lights = 0;        // lights in the view
+	std::size_t indices = 0;       // light indices, all clusters
+	std::size_t maxPerCluster = 0;
+};
+
+class LightClusters final
+{
+	public:
+		// Requires a current GL context
+		explicit LightClusters( std::size_t aMaxViews = 2, LightClusterConfig const& = {}, ThreadPool* aPool = nullptr );
+		~LightClusters();
+
+		LightClusters( LightClusters const& ) = delete;
+		LightClusters& operator= (LightClusters const&) = delete;
+
+	public:
+		// Upload the lights of this frame, for all views, and bind them to
+		// kClusterLightsBinding
+		void set_lights( std::span<ClusterLight const> );
+
+		// Assign the lights to the clusters of view aView (< aMaxViews), for
+		// a camera with aWorldToView and the (symmetric, perspective)
+		// aProjection, drawn to the viewport (aX, aY, aWidth, aHeight).
+		// Uploads the cluster lists and selects them (select_view()).
+		void assign( std::size_t aView, Mat44f const& aWorldToView, Mat44f const& aProjection, int aX, int aY, int aWidth, int aHeight );
+
+		// Bind the clusters of view aView to kClusterBlockBinding,
+		// kClusterGridBinding and kClusterIndicesBinding
+		void select_view( std::size_t aView ) const;
+
+		// Of the last assign()
+		LightClusterStats const& stats() const noexcept;
+
+	private:
+		struct Candidate_
+		{
+			std::uint32_t light;
+			Vec3f center; // view space, z = distance in front of the camera
+			float radius;
+			std::uint32_t slice0, slice1, x0, x1, y0, y1;
+		};
+
+		struct View_
+		{
+			GLuint grid = 0;
+			GLuint indices = 0;
+			std::size_t indexCapacity = 0;
+		};
+
+		struct Slice_
+		{
+			std::vector<Candidate_ const*> slice, row; // candidates
+			std::vector<std::uint32_t> indices;
+		};
+
+		using ClusterData_ = GpuBlock<GpuLayout::std140, GpuStruct<
+			Vec4f,          // uClusterViewport
+			Vec4f,          // uClusterDepth
+			std::uint32_t,  // uClusterTilesX
+			std::uint32_t,  // uClusterTilesY
+			std::uint32_t   // uClusterSlices
+		>>;
+
+		LightClusterConfig mConfig;
+		ThreadPool* mPool;
+
+		std::vector<ClusterLight> mLights;
+		GLuint mLightBuffer = 0;
+		std::size_t mLightCapacity = 0;
+
+		std::vector<View_> mViews;
+		GLuint mClusterData = 0;
+		std::size_t mClusterDataStride;
+
+		std::vector<Candidate_> mCandidates;
+		std::vector<Slice_> mSlices;
+		std::vector<std::uint32_t> mGrid;    // (first, count) per cluster
+		std::vector<std::uint32_t> mIndices;
+
+		LightClusterStats mStats;
+};
+
+#endif // LIGHT_CLUSTERS_HPP_E4A07C5D_1B93_4F26_8D3A_6C92B5F0E718
@@ -1,90 +1,213 @@
 #include "loadobj.hpp"
 
+#include <algorithm>
+#include <unordered_map>
+
 #include <rapidobj/rapidobj.hpp>
 
 #include "../support/error.hpp"
+#include "../support/thread_pool.hpp"
 
-SimpleMeshData load_wavefront_obj( char const* aPath )
+namespace
+{
+	// Number of output vertices converted per parallel work item. Large
+	// enough to amortize scheduling, small enough to balance big meshes.
+	constexpr std::size_t kConvertChunkSize_ = 16*1024;
+
+	// A unique vertex is identified by the OBJ attribute indices it refers to
+	// plus the material of the face it belongs to. Two corners with the same
+	// key produce bit-identical vertex data, so they can share a vertex.
+	struct VertexKey_
+	{
+		int position;
+		int texcoord;
+		int normal;
+		int material;
+
+		bool operator== (VertexKey_ const&) const = default;
+	};
+
+	struct VertexKeyHash_
+	{
+		std::size_t operator() (VertexKey_ const& aKey) const noexcept
+		{
+			std::size_t h = std::size_t(std::uint32_t(aKey.position));
+			h = h * 0x9E3779B97F4A7C15ull + std::uint32_t(aKey.texcoord);
+			h = h * 0x9E3779B97F4A7C15ull + std::uint32_t(aKey.normal);
+			h = h * 0x9E3779B97F4A7C15ull + std::uint32_t(aKey.material);
+			return h ^ (h >> 29);
+		}
+	};
+
+	// A face corner: index into res.shapes and into that shape's indices
+	struct CornerRef_
+	{
+		std::uint32_t shape;
+		std::uint32_t corner;
+	};
+
+	// Contiguous run of output vertices [outBegin, outBegin+count). Either
+	// maps to consecutive corners of one shape (expanded meshes), or to a
+	// range of the unique corner list (welded meshes).
+	struct ConvertChunk_
+	{
+		std::size_t outBegin;
+		std::size_t count;
+
+		std::uint32_t shape;
+		std::size_t firstCorner;
+	};
+
+	void resize_streams_( SimpleMeshData&, std::size_t );
+	void write_vertex_( SimpleMeshData&, std::size_t, rapidobj::Result const&, rapidobj::Index const&, int aMaterial );
+}
+
+SimpleMeshData load_wavefront_obj( char const* aPath, bool aWeld )
 {
 	auto res = rapidobj::ParseFile(aPath);
 	if (res.error)
 	{
 		throw Error("Unable to load OBJ file '{}' : {}", aPath, res.error.code.message());
 	}
-	
+
 	rapidobj::Triangulate(res);
 
 	SimpleMeshData ret;
 
-	for (auto const& shape : res.shapes)
+	// Materials are stored once per mesh; vertices only refer to them
+	if (res.materials.size() > kMaxMaterials)
+		throw Error("OBJ file '{}' has {} materials; at most {} are supported", aPath, res.materials.size(), kMaxMaterials);
+
+	for (auto const& mat : res.materials)
+	{
+		ret.materials.emplace_back(Material{
+			Vec3f{ mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] },
+			mat.shininess
+		});
+	}
+
+	// Work out where each output vertex comes from first. This fixes the
+	// output layout up front, so that the streams can be sized once and the
+	// actual conversion can run in any order (i.e., in parallel) while still
+	// producing exactly the same result as a serial conversion.
+	std::vector<ConvertChunk_> chunks;
+	std::vector<CornerRef_> uniqueCorners; // welded meshes only
+	std::size_t vertexCount = 0;
+
+	if (!aWeld)
 	{
-		for (std::size_t i = 0; i < shape.mesh.indices.size(); i++)
+		for (std::uint32_t s = 0; s < res.shapes.size(); ++s)
 		{
-			auto const& idx = shape.mesh.indices[i];
-			auto const& mat = res.materials[shape.mesh.material_ids[i / 3]];
-
-			ret.positions.emplace_back ( Vec3f {
-				res.attributes.positions[idx.position_index*3+0],
-				res.attributes.positions[idx.position_index*3+1],
-				res.attributes.positions[idx.position_index*3+2]
-			} );
-
-			// Normals
-			if (idx.normal_index >= 0) 
-            {
-                ret.normals.emplace_back( Vec3f {
-                    res.attributes.normals[idx.normal_index*3+0],
-                    res.attributes.normals[idx.normal_index*3+1],
-                    res.attributes.normals[idx.normal_index*3+2]
-                });
-            }
-            else 
-            {
-				// if there is no normal data set up (avoids crashing)
-                ret.normals.emplace_back( Vec3f { 1.0f, 0.0f, 0.0f } );
-            }
-
-			// Texture coordinates
-			if (idx.texcoord_index >= 0)
+			auto const corners = res.shapes[s].mesh.indices.size();
+			for (std::size_t begin = 0; begin < corners; begin += kConvertChunkSize_)
 			{
-				ret.texcoords.emplace_back(Vec2f{
-					res.attributes.texcoords[idx.texcoord_index * 2 + 0],
-					res.attributes.texcoords[idx.texcoord_index * 2 + 1]
-				});
+				auto const count = std::min(kConvertChunkSize_, corners - begin);
+				chunks.emplace_back(ConvertChunk_{ vertexCount, count, s, begin });
+				vertexCount += count;
 			}
-			else
+		}
+	}
+	else
+	{
+		std::size_t totalCorners = 0;
+		for (auto const& shape : res.shapes)
+			totalCorners += shape.mesh.indices.size();
+
+		ret.indices.reserve(totalCorners);
+
+		std::unordered_map<VertexKey_, std::uint32_t, VertexKeyHash_> welded;
+		welded.reserve(totalCorners / 4);
+
+		for (std::uint32_t s = 0; s < res.shapes.size(); ++s)
+		{
+			auto const& mesh = res.shapes[s].mesh;
+			for (std::size_t i = 0; i < mesh.indices.size(); ++i)
 			{
-				// if there is no texture data set up (avoids crashing)
-				ret.texcoords.emplace_back(Vec2f{ 0.0f, 0.0f });
-			}
+				auto const& idx = mesh.indices[i];
+
+				// Reuse the vertex if this exact corner was seen before
+				VertexKey_ const key{ idx.position_index, idx.texcoord_index, idx.normal_index, mesh.material_ids[i / 3] };
+				auto const [it, inserted] = welded.try_emplace(key, std::uint32_t(uniqueCorners.size()));
+
+				if (inserted)
+					uniqueCorners.emplace_back(CornerRef_{ s, std::uint32_t(i) });
 
-			/*if (i < 5) {
-				std::printf("Material: %s, Shininess: %f, Diffuse: %f %f %f\n",
-					mat.name.c_str(),
-					mat.shininess,
-					mat.diffuse[0], mat.diffuse[1], mat.diffuse[2]);
-			}*/
-
-			// Colours
-			ret.colors.emplace_back(Vec3f{
-				mat.diffuse[0], // Was mat.ambient[0]
-				mat.diffuse[1], // Was mat.ambient[1]
-				mat.diffuse[2]  // Was mat.ambient[2]
-				});
-
-			// Shine
-			ret.shine.push_back(mat.shininess);
-
-			/*auto const& mat = res.materials[shape.mesh.material_ids[i / 3]];
-
-			ret.colors.emplace_back( Vec3f {
-				mat.ambient[0],
-				mat.ambient[1],
-				mat.ambient[2]
-			});*/
+				ret.indices.push_back(it->second);
+			}
 		}
+
+		vertexCount = uniqueCorners.size();
+		for (std::size_t begin = 0; begin < vertexCount; begin += kConvertChunkSize_)
+			chunks.emplace_back(ConvertChunk_{ begin, std::min(kConvertChunkSize_, vertexCount - begin), 0, begin });
 	}
 
+	resize_streams_(ret, vertexCount);
+
+	// Convert. Each chunk writes a disjoint range of the output streams.
+	default_thread_pool().parallel_for(chunks.size(), [&] (std::size_t aChunk) {
+		auto const& chunk = chunks[aChunk];
+		for (std::size_t j = 0; j < chunk.count; ++j)
+		{
+			CornerRef_ const ref = aWeld
+				? uniqueCorners[chunk.firstCorner + j]
+				: CornerRef_{ chunk.shape, std::uint32_t(chunk.firstCorner + j) };
+
+			auto const& mesh = res.shapes[ref.shape].mesh;
+			write_vertex_(ret, chunk.outBegin + j, res, mesh.indices[ref.corner], mesh.material_ids[ref.corner / 3]);
+		}
+	});
+
 	return ret;
 }
 
+namespace
+{
+	void resize_streams_( SimpleMeshData& ret, std::size_t aCount )
+	{
+		ret.positions.resize(aCount);
+		ret.normals.resize(aCount);
+		ret.texcoords.resize(aCount);
+		ret.materialIds.resize(aCount);
+	}
+
+	void write_vertex_( SimpleMeshData& ret, std::size_t aOut, rapidobj::Result const& res, rapidobj::Index const& idx, int aMaterial )
+	{
+		ret.positions[aOut] = Vec3f {
+			res.attributes.positions[idx.position_index*3+0],
+			res.attributes.positions[idx.position_index*3+1],
+			res.attributes.positions[idx.position_index*3+2]
+		};
+
+		// Normals
+		if (idx.normal_index >= 0)
+		{
+			ret.normals[aOut] = Vec3f {
+				res.attributes.normals[idx.normal_index*3+0],
+				res.attributes.normals[idx.normal_index*3+1],
+				res.attributes.normals[idx.normal_index*3+2]
+			};
+		}
+		else
+		{
+			// if there is no normal data set up (avoids crashing)
+			ret.normals[aOut] = Vec3f { 1.0f, 0.0f, 0.0f };
+		}
+
+		// Texture coordinates
+		if (idx.texcoord_index >= 0)
+		{
+			ret.texcoords[aOut] = Vec2f{
+				res.attributes.texcoords[idx.texcoord_index * 2 + 0],
+				res.attributes.texcoords[idx.texcoord_index * 2 + 1]
+			};
+		}
+		else
+		{
+			// if there is no texture data set up (avoids crashing)
+			ret.texcoords[aOut] = Vec2f{ 0.0f, 0.0f };
+		}
+
+		// Material (diffuse colour and shininess live in ret.materials)
+		ret.materialIds[aOut] = std::uint16_t(aMaterial);
+	}
+}
@@ -3,6 +3,12 @@
 
 #include "simple_mesh.hpp"
 
-SimpleMeshData load_wavefront_obj( char const* aPath );
+// Load a Wavefront OBJ file and triangulate it.
+//
+// By default, every face corner becomes its own vertex, and the mesh is drawn
+// with glDrawArrays(). With aWeld set, corners that share position, normal,
+// texture coordinate and material are merged into a single vertex, and the
+// mesh is returned with an index buffer instead.
+SimpleMeshData load_wavefront_obj( char const* aPath, bool aWeld = false );
 
 #endif // LOADOBJ_HPP_2CF735BE_6624_413E_B6DC_B5BBA337F96F
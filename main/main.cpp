@@ -5,7 +5,10 @@
 #include <GLFW/glfw3.h>
 
 #include <print>
+#include <vector>
+#include <algorithm>
 #include <numbers>
+#include <optional>
 #include <typeinfo>
 #include <stdexcept>
 #include <cmath>
@@ -31,15 +34,31 @@
 #include "cube.hpp"
 
 // load objects
+#include "asset_loader.hpp"
 #include "loadobj.hpp"
+#include "mesh_lod.hpp"
+#include "mesh_cache.hpp"
+#include "material.hpp"
 #include "simple_mesh.hpp"
+#include "vertex_format.hpp"
+#include "terrain_tiles.hpp"
+#include "terrain_streamer.hpp"
 #include "rocket.hpp"
 
 // texture utils
 #include "texture.hpp"
+#include "texture_streamer.hpp"
+#include "texture_manager.hpp"
 
 // particles
 #include "particle_system.hpp"
+#include "gpu_particle_system.hpp"
+#include "particle_compositor.hpp"
+
+#include "instance_batcher.hpp"
+#include "render_queue.hpp"
+#include "frame_uniforms.hpp"
+#include "light_clusters.hpp"
 
 
 namespace
@@ -48,6 +67,9 @@ namespace
     constexpr float kMovementPerSecond_ = 5.f;  // units per second
     constexpr float kMouseSensitivity_ = 0.01f; // radians per pixel
 
+    constexpr float kFovY_ = 60.0f * (std::numbers::pi_v<float> / 180.f);
+    constexpr float kLodPixelError_ = 1.f; // max. projected LOD error, in pixels
+
     struct State_
     {
         ShaderProgram *prog;
@@ -66,6 +88,12 @@ namespace
         CameraType camType2 = CameraType::GroundRocket;
         bool splitScreen = false;
 
+        // Simulate particles in compute shaders (or on the CPU)
+        bool gpuParticles = true;
+
+        // Renders particles at reduced resolution; H cycles the resolution
+        ParticleCompositor* particleCompositor = nullptr;
+
         struct CamCtrl_
         {
             Vec3f position = {0.f, 0.f, 0.f};
@@ -97,9 +125,13 @@ namespace
 			bool light2Enabled = false;
 			bool light3Enabled = false;
             bool globalDirectionalEnabled = true;
+            bool sceneLightsEnabled = true; // pad beacons and runway lights
         } lighting;
     };
 
+    // Per-draw uniforms of a terrain tile (RenderDraw::prepare)
+    void set_tile_model_(void const*);
+
     void glfw_callback_error_(int, char const *);
 
     void glfw_callback_key_(GLFWwindow *, int, int, int, int);
@@ -223,22 +255,111 @@ try
 	// https://learn.microsoft.com/en-us/windows/win32/opengl/glviewport
     glViewport(0, 0, iwidth, iheight);
 
+    // Start loading assets on worker threads. The main thread compiles the
+    // shaders meanwhile, and then uploads each asset as soon as it has
+    // loaded (see asset_loader.hpp).
+    AssetLoader loader;
+
+    // Textures are shared by path (see texture_manager.hpp)
+    TextureManager textures;
+
+	// Terrain tiles
+    // (The terrain is split into tiles once and cached, see terrain_tiles.hpp.
+    // Only the tiles near the camera are loaded, on a background thread.)
+    std::optional<TerrainStreamer> terrainStreamer;
+    loader.add("terrain tiles",
+        [] { return load_terrain_tiles("assets/cw2/parlahti.obj"); },
+        [&](TileSet aTiles) {
+            terrainStreamer.emplace(std::move(aTiles));
+            terrainStreamer->update(state.camControl.position);
+        });
+
+	// Terrain and particle textures
+    // (If the terrain texture is baked, its mip levels are streamed in
+    // progressively, coarsest first; see texture_streamer.hpp.)
+    GLuint terrainTexture = 0;
+    std::optional<TextureStreamer> terrainTextureStreamer;
+    TextureHandle terrainTextureHandle;
+    loader.add("assets/cw2/L4343A-4k.jpeg",
+        [] { return read_texture_2d("assets/cw2/L4343A-4k.jpeg", false); },
+        [&](TextureSource aSource) {
+            if (aSource.baked)
+            {
+                terrainTextureStreamer.emplace(std::move(aSource.baked), TextureStreamerConfig{}, &textures);
+                terrainTexture = terrainTextureStreamer->texture();
+            }
+            else
+            {
+                terrainTextureHandle = textures.acquire("assets/cw2/L4343A-4k.jpeg", {}, aSource);
+                terrainTexture = terrainTextureHandle.texture();
+            }
+        });
+
+    GLuint particleTexture = 0;
+    TextureHandle particleTextureHandle;
+    loader.add("assets/cw2/particle.png",
+        [] { return read_texture_2d("assets/cw2/particle.png"); },
+        [&](TextureSource aSource) {
+            particleTextureHandle = textures.acquire("assets/cw2/particle.png", {}, aSource);
+            particleTexture = particleTextureHandle.texture();
+        });
+
+    // Landing pad mesh
+    std::optional<LoadedMesh> padMesh;
+    GLuint padVao = 0;
+    GLuint padMaterials = 0;
+    loader.add("assets/cw2/landingpad.obj",
+        [] { return load_wavefront_obj_cached("assets/cw2/landingpad.obj", kMeshFlagWeld | kMeshFlagOptimize | kMeshFlagLods | kMeshFlagPacked); },
+        [&](LoadedMesh aMesh) {
+            padMesh.emplace(std::move(aMesh));
+            padVao = create_vao(padMesh->view());
+            padMaterials = create_material_buffer(padMesh->view().materials);
+        });
+
+    // Rocket
+    GLuint rocketVao = 0;
+    GLuint rocketMaterials = 0;
+    std::size_t rocketVertexCount = 0;
+    loader.add("rocket",
+        [] { return create_rocket(); },
+        [&](SimpleMeshData aMesh) {
+            rocketVao = create_vao(aMesh);
+            rocketMaterials = create_material_buffer(aMesh.materials);
+            rocketVertexCount = aMesh.positions.size();
+        });
+
 	// Load shader programs
+    // (Between programs, upload the assets that have finished loading
+    // meanwhile, rather than leaving all uploads until loader.finish().)
     ShaderProgram prog( {
         { GL_VERTEX_SHADER, "assets/cw2/default.vert" },
         { GL_FRAGMENT_SHADER, "assets/cw2/default.frag" }
     } );
+    loader.poll();
 
     ShaderProgram terrainProg({
         { GL_VERTEX_SHADER, "assets/cw2/terrain.vert" },
         { GL_FRAGMENT_SHADER, "assets/cw2/terrain.frag" }
         });
+    loader.poll();
     ShaderProgram particleProg({
         { GL_VERTEX_SHADER, "assets/cw2/particle.vert" },
         { GL_FRAGMENT_SHADER, "assets/cw2/particle.frag" }
     });
+    loader.poll();
+    ShaderProgram particleGpuProg({
+        { GL_VERTEX_SHADER, "assets/cw2/particle_gpu.vert" },
+        { GL_FRAGMENT_SHADER, "assets/cw2/particle.frag" }
+    });
+    loader.poll();
 
 
+    // The packed meshes are drawn with these programs; make sure that the
+    // shaders don't expect inputs that the packed vertex format (plus the
+    // per-instance model matrix, for the default program) lacks.
+    check_vertex_inputs(prog.programId(), instanced_locations<PackedVertexLayout>(), "default");
+    check_vertex_inputs<PackedVertexLayout>(terrainProg.programId(), "terrain");
+
     state.prog = &prog;
     state.terrainProg = &terrainProg;
 	state.particleProg = &particleProg;
@@ -248,34 +369,60 @@ try
     //float angle = 0.f;
 
     // Other initialization & loading
+    // Wait for the remaining assets, and for the tiles around the camera
+    loader.finish();
+    terrainStreamer->load_now(state.camControl.position);
+    textures.collect();
+    textures.print_stats();
 	OGL_CHECKPOINT_ALWAYS();
-	// Load terrain mesh
-    auto terrainMesh = load_wavefront_obj("assets/cw2/parlahti.obj");
-    GLuint vao = create_vao(terrainMesh); 
-    std::size_t vertexCount = terrainMesh.positions.size();
-	// Load terrain texture
-    GLuint terrainTexture = load_texture_2d("assets/cw2/L4343A-4k.jpeg");
-    // Load particle texture
-    GLuint particleTexture = load_texture_2d("assets/cw2/particle.png");
+
 	// Init particle system
+    // (One emitter, below the rocket; about 2 particles per frame at 60Hz.)
+    float const rocketParticlesPerSecond = 120.f;
+
     ParticleSystem particleSys;
     particleSys.init(&particleProg, particleTexture);
 
+    std::size_t const rocketEmitter = particleSys.add_emitter({ .spawnPerSecond = rocketParticlesPerSecond });
+
+    // GPU particle system (see gpu_particle_system.hpp); P toggles between
+    // the two, which spawn at the same rate
+    GpuParticleSystem gpuParticleSys({ .spawnPerSecond = rocketParticlesPerSecond });
+    gpuParticleSys.init(&particleGpuProg, particleTexture);
+
+    // Particles are drawn at half resolution and composited onto the scene
+    // (see particle_compositor.hpp), since their overdraw is fill-rate bound
+    ParticleCompositor particleCompositor;
+    state.particleCompositor = &particleCompositor;
+
+
+
+    // landing pad draw data
+    std::vector<MeshLod> padLods = mesh_lods(padMesh->view());
+    GLenum padIndexType = index_type(padMesh->view());
+    Mat44f padDequant = dequant_matrix(padMesh->view().dequant);
+
+    // Pads and rocket are drawn with instancing (see instance_batcher.hpp):
+    // one draw per mesh and LOD, however many copies there are
+    InstanceBatcher instances;
+    InstanceBatcher::MeshId const padInstances = instances.add_mesh({ padVao, padMaterials, padIndexType, padDequant, -1.f }); // Use MTL shine
+    InstanceBatcher::MeshId const rocketInstances = instances.add_mesh({ rocketVao, rocketMaterials, GL_NONE, kIdentity44f, 100.f }); // shiny rocket metal
 
+    // Draws are sorted by state before they are issued (see render_queue.hpp)
+    RenderQueue renderQueue;
 
-    // load landing pad mesh
-    auto padMesh = load_wavefront_obj("assets/cw2/landingpad.obj");
-    GLuint padVao = create_vao(padMesh);
-    std::size_t padVertexCount = padMesh.positions.size();
+    // Lighting and camera uniforms shared by the programs (see frame_uniforms.hpp)
+    FrameUniformBuffers frameUniforms(2);
+
+    // Point lights are assigned to clusters of each view, so that the
+    // shaders only evaluate the lights near each fragment (see
+    // light_clusters.hpp)
+    LightClusters lightClusters(2);
+    std::vector<ClusterLight> pointLights;
 
     Vec3f landingPadPosition1 = {30.f, -0.95f, 30.f};
     Vec3f landingPadPosition2 = {0.f, -0.95f, -5.f};
 
-    // load rocket
-    auto rocketMesh = create_rocket();
-    GLuint rocketVao = create_vao(rocketMesh);
-    std::size_t rocketVertexCount = rocketMesh.positions.size();
-
     // set rocket animation start pos (at landingpad2)
     state.animation.startPosition = landingPadPosition2 + Vec3f{0.f, 1.0f, 0.f};
 
@@ -293,10 +440,47 @@ try
         { 0.0f, 2.0f, 2.0f }
     };
 
+    // Engine glow, at the particle emitter
+    Vec3f const engineGlowColor = { 6.0f, 3.0f, 0.9f };
+
+    // Blinking beacons on the corners of the landing pads
+    Vec3f const beaconColor = { 1.5f, 0.2f, 0.1f };
+    std::vector<Vec3f> beaconPositions;
+    {
+        PositionDequant const& padBox = padMesh->view().dequant;
+        for (Vec3f const& padPosition : { landingPadPosition1, landingPadPosition2 })
+        {
+            for (float sx : { -1.f, 1.f })
+            {
+                for (float sz : { -1.f, 1.f })
+                    beaconPositions.push_back(padPosition + padBox.offset + Vec3f{ sx * padBox.scale.x, padBox.scale.y, sz * padBox.scale.z });
+            }
+        }
+    }
+
+    // Runway lights: two rows along the path between the landing pads
+    Vec3f const runwayColor = { 0.4f, 0.34f, 0.2f };
+    std::vector<Vec3f> runwayPositions;
+    {
+        Vec3f path = landingPadPosition1 - landingPadPosition2;
+        path.y = 0.f;
+        float pathLength = length(path);
+        Vec3f along = path / pathLength;
+        Vec3f side = { -along.z, 0.f, along.x };
+
+        for (float d = 0.f; d <= pathLength; d += 1.5f)
+        {
+            for (float s : { -3.f, 3.f })
+                runwayPositions.push_back(landingPadPosition2 + along * d + side * s + Vec3f{ 0.f, 0.2f, 0.f });
+        }
+    }
+
+    float lightTime = 0.f; // for the beacons
+
     // Performance Measurement Setup
-    GLuint glQueries[5] = { 0 };
+    GLuint glQueries[3] = { 0 };
     #ifdef ENABLE_112_MEASURING_PERFORMANCE
-        glGenQueries(5, glQueries);
+        glGenQueries(3, glQueries);
     #endif
 
     // Get timestamp for the start of frame
@@ -372,6 +556,8 @@ try
         if (state.camControl.moveDown)
             state.camControl.position.y -= speed * dt;
 
+        lightTime += dt;
+
         // update animation
         if (state.animation.active && !state.animation.paused)
         {
@@ -438,48 +624,55 @@ try
 		// Update particles only when animation is active and not paused
         if (state.animation.active && !state.animation.paused)
         {
-            particleSys.update(dt, emitterPos, true);
+            if (state.gpuParticles)
+                gpuParticleSys.update(dt, emitterPos, true);
+            else
+            {
+                particleSys.emitter(rocketEmitter).position = emitterPos;
+                particleSys.update(dt);
+            }
         }
         else if (!state.animation.active)
         {
 			// Kill all particles when animation not active
-            for (auto& p : particleSys.particles)
-            {
-                p.life = -1.0f;
-            }
+            particleSys.clear();
+            gpuParticleSys.clear();
         }
 
         // === Drawing ===
         // Frame time measurements
         #ifdef ENABLE_112_MEASURING_PERFORMANCE
         // Check if we have data for the final query and if so display the data gathered
-        if (glIsQuery(glQueries[4]))
+        if (glIsQuery(glQueries[2]))
         {
             GLint timeAvailable = 0;
-            glGetQueryObjectiv(glQueries[4], GL_QUERY_RESULT_AVAILABLE, &timeAvailable);
+            glGetQueryObjectiv(glQueries[2], GL_QUERY_RESULT_AVAILABLE, &timeAvailable);
 
             if (timeAvailable)
             {
                 OGL_CHECKPOINT_DEBUG();
 
-                GLuint64 times[5];
+                GLuint64 times[3];
                 glGetQueryObjectui64v(glQueries[0], GL_QUERY_RESULT, &times[0]); // Start
-                glGetQueryObjectui64v(glQueries[1], GL_QUERY_RESULT, &times[1]); // After terrain
-                glGetQueryObjectui64v(glQueries[2], GL_QUERY_RESULT, &times[2]); // After Landing pads
-                glGetQueryObjectui64v(glQueries[3], GL_QUERY_RESULT, &times[3]); // After rocket
-                glGetQueryObjectui64v(glQueries[4], GL_QUERY_RESULT, &times[4]); // End
+                glGetQueryObjectui64v(glQueries[1], GL_QUERY_RESULT, &times[1]); // After scene (terrain, landing pads & rocket, sorted by state)
+                glGetQueryObjectui64v(glQueries[2], GL_QUERY_RESULT, &times[2]); // End
 
                 OGL_CHECKPOINT_DEBUG();
 
                 // Convert nanoseconds to milliseconds
                 float nmConst = 1000000.0;
-                double terrainTime = (times[1] - times[0]) / nmConst;
-                double landingPadsTime = (times[2] - times[1]) / nmConst;
-                double rocketTime = (times[3] - times[2]) / nmConst;
-                double totalTime = (times[4] - times[0]) / nmConst;
+                double sceneTime = (times[1] - times[0]) / nmConst;
+                double particlesTime = (times[2] - times[1]) / nmConst;
+                double totalTime = (times[2] - times[0]) / nmConst;
+
+                // (Draws and state changes of the last frame, all views)
+                RenderQueueStats const& queueStats = renderQueue.stats();
 
-                std::print("GPU [ms] Terrain: {:.3f} | Landing Pads: {:.3f} | Rocket: {:.3f} | Total: {:.3f} --- CPU Frame: {:.3f} ms\n",
-                    terrainTime, landingPadsTime, rocketTime, totalTime, cpuFrameTime);
+                // (Point lights of the last view)
+                LightClusterStats const& lightStats = lightClusters.stats();
+
+                std::print("GPU [ms] Scene: {:.3f} | Particles: {:.3f} | Total: {:.3f} --- CPU Frame: {:.3f} ms --- Draws: {} | State changes: {} --- Lights: {} | Max. per cluster: {}\n",
+                    sceneTime, particlesTime, totalTime, cpuFrameTime, queueStats.draws, queueStats.state_changes(), lightStats.lights, lightStats.maxPerCluster);
             }
         }
         #endif
@@ -495,9 +688,64 @@ try
         int numberOfScreens = state.splitScreen ? 2 : 1;
 
         //auto submitStart = Clock::now();
+        renderQueue.begin_frame();
+
+        // === Lighting ===
+        // Uploaded once per frame, for all programs and views
+        FrameUniforms frameData;
+
+        // Global directional light
+        Vec3f lightDir = {0.f, 1.f, -1.f};
+        float len = std::sqrt(lightDir.x * lightDir.x + lightDir.y * lightDir.y + lightDir.z * lightDir.z);
+        frameData.set<kFrameLightDir>({lightDir.x / len, lightDir.y / len, lightDir.z / len});
+        frameData.set<kFrameDirLightEnabled>(state.lighting.globalDirectionalEnabled);
+        frameData.set<kFrameLightDiffuse>({1.0f, 1.0f, 1.0f});
+        frameData.set<kFrameSceneAmbient>({0.15f, 0.15f, 0.15f});
+
+        frameUniforms.set_frame(frameData);
+
+        // Point lights; only the enabled ones are listed
+        pointLights.clear();
+
+        auto addPointLight = [&](Vec3f position, Vec3f color) {
+            pointLights.push_back({ position, light_radius(color), color, 0.f });
+        };
+
+        // Lights which move with the rocket
+        for (int i = 0; i < 3; ++i)
+        {
+            Vec4f lightPositionVec4 = { lightLocations[i].x, lightLocations[i].y, lightLocations[i].z, 1.0f };
+            Vec4f worldPositionVec4 = rocketModel * lightPositionVec4;
+
+            bool active = false;
+            if (i == 0) active = state.lighting.light1Enabled;
+            if (i == 1) active = state.lighting.light2Enabled;
+            if (i == 2) active = state.lighting.light3Enabled;
+
+            if (active)
+                addPointLight({ worldPositionVec4.x, worldPositionVec4.y, worldPositionVec4.z }, lightColors[i]);
+        }
+
+        if (state.animation.active)
+            addPointLight(emitterPos, engineGlowColor);
+
+        if (state.lighting.sceneLightsEnabled)
+        {
+            // Beacons blink once per second, alternating between the corners
+            for (std::size_t i = 0; i < beaconPositions.size(); ++i)
+            {
+                if (std::fmod(lightTime + 0.5f * float(i % 2), 1.f) < 0.5f)
+                    addPointLight(beaconPositions[i], beaconColor);
+            }
+
+            for (Vec3f const& position : runwayPositions)
+                addPointLight(position, runwayColor);
+        }
+
+        lightClusters.set_lights(pointLights);
+
         for (int i = 0; i < numberOfScreens; ++i)
         {
-            glUseProgram(prog.programId());
             int viewX = 0;
             int viewY = 0;
             int viewW = (int)fbwidth;
@@ -524,10 +772,13 @@ try
 
             // projection
             Mat44f projection = make_perspective_projection(
-                60.0f * (std::numbers::pi_v<float> / 180.f),
+                kFovY_,
                 float(viewW) / float(viewH),
                 0.1f, 2000.0f);
 
+            // LOD selection: pixels covered by one unit at distance one
+            float lodPixelScale = lod_pixel_scale(kFovY_, float(viewH));
+
             Vec3f camPos = state.camControl.position;
             float camPhi = state.camControl.phi;
             float camTheta = state.camControl.theta;
@@ -576,9 +827,6 @@ try
             // model
             Mat44f model = kIdentity44f;
 
-            // MVP
-            Mat44f projCameraWorld = projection * view * model;
-
             // normal matrix
             Mat33f normalMatrix = mat44_to_mat33(transpose(invert(model)));
 
@@ -588,171 +836,102 @@ try
             // glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
             // glUseProgram( prog.programId() );
 
-            // send matrix
-            glUniformMatrix4fv(0, 1, GL_TRUE, projCameraWorld.v);
-            glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);
+            // Everything is drawn through the render queue (see
+            // render_queue.hpp), which binds each program once per execute;
+            // the remaining per-program uniforms are therefore set without
+            // binding them
+            GLuint const defaultProgram = prog.programId();
+            GLuint const terrainProgram = terrainProg.programId();
 
-            // === Lighting ===
-            // Global directional light
-            Vec3f lightDir = {0.f, 1.f, -1.f};
-            float lightColor[] = { 1.0f, 1.0f, 1.0f };
-            float len = std::sqrt(lightDir.x * lightDir.x + lightDir.y * lightDir.y + lightDir.z * lightDir.z);
-            lightDir.x /= len;
-            lightDir.y /= len;
-            lightDir.z /= len;
+            // Camera of this view
+            Mat44f viewProjection = projection * view;
+            frameUniforms.set_view(i, make_view_uniforms(viewProjection, camPos));
 
-            glUniform3fv(3, 1, &lightDir.x);
-            glUniform3fv(4, 1, lightColor);
-            float ambientColor[] = {0.15f, 0.15f, 0.15f};
-            glUniform3fv(5, 1, ambientColor);
-
-            #ifdef ENABLE_112_MEASURING_PERFORMANCE
-            if (i == 0) glQueryCounter(glQueries[0], GL_TIMESTAMP);
-            #endif
+            // Point lights of this view
+            lightClusters.assign(i, view, projection, viewX, viewY, viewW, viewH);
 
             // === Draw terrain ===
-            // Bind texture
-            glUseProgram(terrainProg.programId());
-            glUniformMatrix4fv(0, 1, GL_TRUE, projCameraWorld.v); // Location 0: MVP Matrix
-            glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v);    // Location 1: Normal Matrix
-            glUniform3fv(2, 1, &lightDir.x);                      // Location 2: Light Dir
-            glUniform3fv(3, 1, lightColor);                       // Location 3: Light Diffuse
-            glUniform3fv(4, 1, ambientColor);                     // Location 4: Light Ambient
+            // Stream tiles around the (first) camera
+            if (i == 0) terrainStreamer->update(camPos);
 
-            // === Local lighting for terrain ===
-            // Global directional light toggle
-            glUniform1i(6, state.lighting.globalDirectionalEnabled);
+            // Stream terrain texture levels down to the texel density needed
+            // at the nearest point of the terrain
+            if (i == 0 && terrainTextureStreamer)
+            {
+                Vec3f terrainMin = terrainStreamer->bounds_min();
+                Vec3f terrainMax = terrainStreamer->bounds_max();
+                float texelsPerUnit = float(terrainTextureStreamer->width()) / std::max(terrainMax.x - terrainMin.x, 1e-3f);
+                float pixelsPerUnit = lodPixelScale / std::max(distance_to_box(camPos, terrainMin, terrainMax), 1.f);
+                terrainTextureStreamer->update(required_texture_lod(texelsPerUnit, pixelsPerUnit));
+            }
 
-            // Camera position
-            glUniform3fv(7, 1, &camPos.x);
+            glProgramUniformMatrix3fv(terrainProgram, 1, 1, GL_TRUE, normalMatrix.v);    // Location 1: Normal Matrix
+            glProgramUniform1i(terrainProgram, 5, 0);                                    // Location 5: Texture Unit
 
             // Shiny value - set to 0 as the terrain should be rough (except maybe the water but would need to sample shiny texture)
-            glUniform1f(8, 0.0f);
+            glProgramUniform1f(terrainProgram, 8, 0.0f);
 
-            GLuint lightArrayLocation = 9; // Location for shader
-            int valuesPerLight = 3; // Position, colour and activity
-
-            for (int i = 0; i < 3; ++i)
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            for (TerrainStreamer::Tile const* tile : terrainStreamer->resident())
             {
-                // Find the location for the light at the current index so we can edit it's values
-                GLuint thisLightLocation = lightArrayLocation + (i * valuesPerLight);
-
-                Vec4f lightPositionVec4 = { lightLocations[i].x, lightLocations[i].y, lightLocations[i].z, 1.0f };
-                Vec4f worldPositionVec4 = rocketModel * lightPositionVec4;
-                Vec3f worldPositionVec3 = { worldPositionVec4.x, worldPositionVec4.y, worldPositionVec4.z };
-
-                bool active = false;
-                if (i == 0) active = state.lighting.light1Enabled;
-                if (i == 1) active = state.lighting.light2Enabled;
-                if (i == 2) active = state.lighting.light3Enabled;
-
-                // Send data to correct location by offsetting by 1 each time
-                glUniform3fv(thisLightLocation + 0, 1, &worldPositionVec3.x);
-                glUniform3fv(thisLightLocation + 1, 1, &lightColors[i].x);
-                glUniform1i(thisLightLocation + 2, active);
+                // Nearest tiles first (within the same texture/VAO state)
+                float tileDistance = distance_to_box(camPos, tile->boundsMin, tile->boundsMax);
+                MeshLod const& tileLod = tile->lods[select_lod(tile->lods, tileDistance, lodPixelScale, kLodPixelError_)];
+
+                RenderDraw tileDraw;
+                tileDraw.indexType = tile->indexType;
+                tileDraw.first = tileLod.firstIndex;
+                tileDraw.count = tileLod.indexCount;
+                tileDraw.prepare = &set_tile_model_;
+                tileDraw.prepareData = tile;
+
+                renderQueue.submit({ RenderPass::opaque, terrainProgram, 0, terrainTexture, tile->vao }, tileDistance, tileDraw);
             }
 
-            // Bind Texture
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, terrainTexture);
-            glUniform1i(5, 0); // Location 5: Texture Unit
-
-            glBindVertexArray(vao);
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-            glDrawArrays(GL_TRIANGLES, 0, vertexCount);
-
-            #ifdef ENABLE_112_MEASURING_PERFORMANCE
-            if (i == 0) glQueryCounter(glQueries[1], GL_TIMESTAMP); // After Terrain
-            #endif
-
-            // draw landing pads
-            glUseProgram(prog.programId());
-
-            // === Local lighting for terrain ===
-            // Global directional light toggle
-            glUniform1i(6, state.lighting.globalDirectionalEnabled);
-
-            // Camera position
-            glUniform3fv(7, 1, &camPos.x);
-
-            for (int i = 0; i < 3; ++i)
+            // Landing pads; each picks its own LOD, pads with the same LOD
+            // share a draw
+            PositionDequant const& padBox = padMesh->view().dequant;
+            for (Vec3f const& padPosition : { landingPadPosition1, landingPadPosition2 })
             {
-                // Find the location for the light at the current index so we can edit it's values
-                GLuint thisLightLocation = lightArrayLocation + (i * valuesPerLight);
-
-                Vec4f lightPositionVec4 = { lightLocations[i].x, lightLocations[i].y, lightLocations[i].z, 1.0f };
-                Vec4f worldPositionVec4 = rocketModel * lightPositionVec4;
-                Vec3f worldPositionVec3 = { worldPositionVec4.x, worldPositionVec4.y, worldPositionVec4.z };
-
-                bool active = false;
-                if (i == 0) active = state.lighting.light1Enabled;
-                if (i == 1) active = state.lighting.light2Enabled;
-                if (i == 2) active = state.lighting.light3Enabled;
-
-                // Send data to correct location by offsetting by 1 each time
-                glUniform3fv(thisLightLocation + 0, 1, &worldPositionVec3.x);
-                glUniform3fv(thisLightLocation + 1, 1, &lightColors[i].x);
-                glUniform1i(thisLightLocation + 2, active);
+                std::size_t padLod = select_lod(padLods,
+                    distance_to_box(camPos, padPosition + padBox.offset - padBox.scale, padPosition + padBox.offset + padBox.scale),
+                    lodPixelScale, kLodPixelError_);
+                instances.add(padInstances, padLods[padLod], make_translation(padPosition));
             }
 
-            glUniform1f(8, -1.0f); // Use MTL shine
-            glBindVertexArray(padVao);
-
-            model = make_translation(landingPadPosition1);
-
-            // calculate matrices
-            Mat44f mvpPad = projection * view * model;
-            Mat33f normalMatPad = mat44_to_mat33(transpose(invert(model)));
-
-            // send matrices to shader
-            glUniformMatrix4fv(0, 1, GL_TRUE, mvpPad.v);       // uProjCameraWorld
-            glUniformMatrix3fv(1, 1, GL_TRUE, normalMatPad.v); // uNormalMatrix
-            glUniformMatrix4fv(2, 1, GL_TRUE, model.v); // uModelMatrix
-
-            glDrawArrays(GL_TRIANGLES, 0, padVertexCount);
-
-            // draw second pad
-            model = make_translation(landingPadPosition2);
-
-            // recalculate matrices for new position
-            mvpPad = projection * view * model;
-            normalMatPad = mat44_to_mat33(transpose(invert(model)));
+            // draw rocket
+            instances.add(rocketInstances, 0, std::uint32_t(rocketVertexCount), rocketModel);
 
-            // send new matrices
-            glUniformMatrix4fv(0, 1, GL_TRUE, mvpPad.v);
-            glUniformMatrix3fv(1, 1, GL_TRUE, normalMatPad.v);
-            glUniformMatrix4fv(2, 1, GL_TRUE, model.v);
+            instances.flush(renderQueue, defaultProgram);
 
-            glDrawArrays(GL_TRIANGLES, 0, padVertexCount);
+            // Draw the scene (sorted by state)
             #ifdef ENABLE_112_MEASURING_PERFORMANCE
-            if (i == 0) glQueryCounter(glQueries[2], GL_TIMESTAMP);
+            if (i == 0) glQueryCounter(glQueries[0], GL_TIMESTAMP);
             #endif
-
-            // draw rocket
-            // Shiny value - set to 100 for shiny rocket metal
-            glUniform1f(8, 100.f);
-            glBindVertexArray(rocketVao);
-            // model = make_translation(landingPadPosition2 + Vec3f{0.f, 1.0f, 0.f});
-            //  calculate matrices
-            Mat44f mvpRocket = projection * view * rocketModel;
-            Mat33f normalMatRocket = mat44_to_mat33(transpose(invert(rocketModel)));
-            // send matrices to shader
-            glUniformMatrix4fv(0, 1, GL_TRUE, mvpRocket.v);       // uProjCameraWorld
-            glUniformMatrix3fv(1, 1, GL_TRUE, normalMatRocket.v); // uNormalMatrix
-            glUniformMatrix4fv(2, 1, GL_TRUE, rocketModel.v); // uModelMatrix
-            glDrawArrays(GL_TRIANGLES, 0, rocketVertexCount);
+            renderQueue.execute();
             #ifdef ENABLE_112_MEASURING_PERFORMANCE
-            if (i == 0) glQueryCounter(glQueries[3], GL_TIMESTAMP);
+            if (i == 0) glQueryCounter(glQueries[1], GL_TIMESTAMP); // After scene
             #endif
 
             // Render particles
-            particleSys.render(projection* view);
+            // (Composited over the scene, after its depth is complete)
+            ParticleSpriteSize const sprite = particleCompositor.begin(viewX, viewY, viewW, viewH);
+            if (state.gpuParticles)
+                gpuParticleSys.submit(renderQueue, viewProjection, sprite);
+            else
+                particleSys.submit(renderQueue, viewProjection, sprite);
+            renderQueue.execute();
+            particleCompositor.end();
             #ifdef ENABLE_112_MEASURING_PERFORMANCE
-            if (i == 0) glQueryCounter(glQueries[4], GL_TIMESTAMP);
+            if (i == 0) glQueryCounter(glQueries[2], GL_TIMESTAMP);
             #endif
         }
         //auto submitEnd = Clock::now();
-        
+
+        // Evict textures released this frame, if the unused ones are over
+        // budget
+        textures.collect();
+
         // clean
         glBindVertexArray(0);
         glUseProgram(0);
@@ -766,6 +945,7 @@ try
     // Cleanup.
     state.prog = nullptr;
     state.terrainProg = nullptr;
+    state.particleCompositor = nullptr;
 
     // TODO: additional cleanup
 
@@ -782,6 +962,15 @@ catch (std::exception const &eErr)
 
 namespace
 {
+    void set_tile_model_(void const* tileData)
+    {
+        // Tile vertices are quantized to the tile's box; the dequantization
+        // is the model matrix, but does not go into the normal matrix.
+        auto const* tile = static_cast<TerrainStreamer::Tile const*>(tileData);
+        Mat44f tileModel = dequant_matrix(tile->dequant);
+        glUniformMatrix4fv(18, 1, GL_TRUE, tileModel.v); // Location 18: Model Matrix
+    }
+
     void glfw_callback_error_(int aErrNum, char const *aErrDesc)
     {
         std::print(stderr, "GLFW error: {} ({})\n", aErrDesc, aErrNum);
@@ -841,6 +1030,26 @@ namespace
                 state->splitScreen = !state->splitScreen;
             }
 
+            // Toggle GPU/CPU particle simulation
+            if (GLFW_KEY_P == aKey && aAction == GLFW_PRESS)
+            {
+                state->gpuParticles = !state->gpuParticles;
+                std::print("Note: {} particles\n", state->gpuParticles ? "GPU" : "CPU");
+            }
+
+            // Cycle particle resolution (full, half, quarter)
+            if (GLFW_KEY_H == aKey && aAction == GLFW_PRESS && state->particleCompositor)
+            {
+                auto* compositor = state->particleCompositor;
+                switch (compositor->resolution())
+                {
+                    case ParticleResolution::full: compositor->set_resolution(ParticleResolution::half); break;
+                    case ParticleResolution::half: compositor->set_resolution(ParticleResolution::quarter); break;
+                    case ParticleResolution::quarter: compositor->set_resolution(ParticleResolution::full); break;
+                }
+                std::print("Note: particles at 1/{} resolution\n", int(compositor->resolution()));
+            }
+
             // toggle camera type
             if (GLFW_KEY_C == aKey && GLFW_PRESS == aAction)
             {
@@ -868,6 +1077,7 @@ namespace
             if (aKey == GLFW_KEY_2 && aAction == GLFW_PRESS) state->lighting.light2Enabled = !state->lighting.light2Enabled;
             if (aKey == GLFW_KEY_3 && aAction == GLFW_PRESS) state->lighting.light3Enabled = !state->lighting.light3Enabled;
             if (aKey == GLFW_KEY_4 && aAction == GLFW_PRESS) state->lighting.globalDirectionalEnabled = !state->lighting.globalDirectionalEnabled ;
+            if (aKey == GLFW_KEY_5 && aAction == GLFW_PRESS) state->lighting.sceneLightsEnabled = !state->lighting.sceneLightsEnabled;
 
             bool isPressed = (aAction != GLFW_RELEASE);
             if (aKey == GLFW_KEY_W)
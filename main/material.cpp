@@ -0,0 +1,36 @@
+#include "material.hpp"
+
+#include <vector>
+
+#include "../support/error.hpp"
+
+GLuint create_material_buffer( std::span<Material const> aMaterials )
+{
+	// The shader declares a fixed-size array; always allocate all of it, and
+	// zero it, so that out-of-range indices read zeros rather than undefined
+	// data.
+	std::vector<Material> const zeros( kMaxMaterials );
+
+	GLuint buffer = 0;
+	glGenBuffers( 1, &buffer );
+	glBindBuffer( GL_UNIFORM_BUFFER, buffer );
+	glBufferData( GL_UNIFORM_BUFFER, kMaxMaterials * sizeof(Material), zeros.data(), GL_STATIC_DRAW );
+
+	update_material_buffer( buffer, aMaterials );
+	return buffer;
+}
+
+void update_material_buffer( GLuint aBuffer, std::span<Material const> aMaterials )
+{
+	if( aMaterials.size() > kMaxMaterials )
+		throw Error( "Too many materials ({}); at most {} are supported", aMaterials.size(), kMaxMaterials );
+
+	glBindBuffer( GL_UNIFORM_BUFFER, aBuffer );
+	glBufferSubData( GL_UNIFORM_BUFFER, 0, aMaterials.size_bytes(), aMaterials.data() );
+	glBindBuffer( GL_UNIFORM_BUFFER, 0 );
+}
+
+void bind_material_buffer( GLuint aBuffer )
+{
+	glBindBufferBase( GL_UNIFORM_BUFFER, kMaterialBlockBinding, aBuffer );
+}
@@ -0,0 +1,51 @@
+#ifndef MATERIAL_HPP_2F7D91C4_0B5A_4E38_8C61_D49E3A07B5F2
+#define MATERIAL_HPP_2F7D91C4_0B5A_4E38_8C61_D49E3A07B5F2
+
+#include <glad/glad.h>
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+/* Material tables
+ *
+ * Instead of repeating the material's colour and shininess in every vertex,
+ * each vertex stores a small index into its mesh's material table. The table
+ * is uploaded once into a uniform buffer, which default.frag reads as
+ *
+ *   layout(std140, binding = 0) uniform Materials { Material uMaterials[256]; };
+ *
+ * Bind the mesh's table with bind_material_buffer() before drawing. Editing
+ * a material is a single update_material_buffer() call.
+ */
+constexpr GLuint kMaterialBlockBinding = 0;
+constexpr std::size_t kMaxMaterials = 256;
+
+// Matches the std140 layout of struct Material in default.frag: the float
+// fills the padding after the vec3.
+struct Material
+{
+	Vec3f diffuse;
+	float shininess;
+
+	bool operator== (Material const& aOther) const noexcept
+	{
+		return diffuse.x == aOther.diffuse.x && diffuse.y == aOther.diffuse.y && diffuse.z == aOther.diffuse.z
+			&& shininess == aOther.shininess;
+	}
+};
+
+static_assert( 16 == sizeof(Material) );
+
+// Create a uniform buffer holding aMaterials (at most kMaxMaterials).
+GLuint create_material_buffer( std::span<Material const> aMaterials );
+
+// Replace the contents of a buffer created by create_material_buffer().
+void update_material_buffer( GLuint aBuffer, std::span<Material const> aMaterials );
+
+void bind_material_buffer( GLuint aBuffer );
+
+#endif // MATERIAL_HPP_2F7D91C4_0B5A_4E38_8C61_D49E3A07B5F2
@@ -0,0 +1,304 @@
+#include "mesh_cache.hpp"
+
+#include <print>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <filesystem>
+
+#include "loadobj.hpp"
+
+#include "../support/error.hpp"
+
+namespace
+{
+	constexpr char kMeshFileMagic_[8] = { 'M', 'E', 'S', 'H', 'C', 'C', 'H', '\0' };
+
+	constexpr std::uint64_t align_up_( std::uint64_t aValue ) noexcept
+	{
+		return (aValue + kMeshFileAlignment-1) & ~std::uint64_t(kMeshFileAlignment-1);
+	}
+
+	template< typename tElem >
+	bool bind_stream_( std::span<tElem const>& aOut, MeshFileStream const& aStream, std::span<std::byte const> aFile )
+	{
+		if( sizeof(tElem) != aStream.elementSize )
+			return false;
+		if( 0 != aStream.offset % alignof(tElem) )
+			return false;
+		if( aStream.offset > aFile.size() || aStream.count > (aFile.size() - aStream.offset) / sizeof(tElem) )
+			return false;
+
+		aOut = { reinterpret_cast<tElem const*>(aFile.data() + aStream.offset), std::size_t(aStream.count) };
+		return true;
+	}
+}
+
+LoadedMesh::LoadedMesh( SimpleMeshData aData )
+	: mData( std::move(aData) )
+	, mView( make_view( *mData ) )
+{}
+LoadedMesh::LoadedMesh( MappedFile aFile, SimpleMeshView aView )
+	: mFile( std::move(aFile) )
+	, mView( aView )
+{}
+
+// Moving the vectors in mData or the mapping in mFile does not move the
+// underlying storage, so the spans in mView remain valid.
+LoadedMesh::LoadedMesh( LoadedMesh&& ) noexcept = default;
+LoadedMesh& LoadedMesh::operator= (LoadedMesh&&) noexcept = default;
+
+SimpleMeshView const& LoadedMesh::view() const noexcept
+{
+	return mView;
+}
+
+bool LoadedMesh::from_file() const noexcept
+{
+	return !mData.has_value();
+}
+
+
+std::optional<LoadedMesh> open_mesh_file( char const* aPath, MeshFileHeader* aHeader, std::string* aSourcePath )
+{
+	std::error_code ec;
+	if( !std::filesystem::exists( aPath, ec ) )
+		return {};
+
+	MappedFile file;
+	try
+	{
+		file = MappedFile( aPath );
+	}
+	catch( std::exception const& eErr )
+	{
+		std::print( stderr, "Note: ignoring mesh file: {}\n", eErr.what() );
+		return {};
+	}
+
+	auto const bytes = file.bytes();
+	if( bytes.size() < sizeof(MeshFileHeader) )
+		return {};
+
+	MeshFileHeader header;
+	std::memcpy( &header, bytes.data(), sizeof(header) );
+
+	if( 0 != std::memcmp( header.magic, kMeshFileMagic_, sizeof(kMeshFileMagic_) ) )
+		return {};
+	if( kMeshFileVersion != header.version )
+		return {};
+
+	std::size_t const tableOffset = sizeof(MeshFileHeader) + header.pathLength;
+	std::size_t const tableSize = std::size_t(header.streamCount) * sizeof(MeshFileStream);
+	if( tableOffset > bytes.size() || tableSize > bytes.size() - tableOffset )
+		return {};
+
+	SimpleMeshView view;
+	for( std::uint32_t i = 0; i < header.streamCount; ++i )
+	{
+		MeshFileStream stream;
+		std::memcpy( &stream, bytes.data() + tableOffset + i*sizeof(MeshFileStream), sizeof(stream) );
+
+		bool ok = false;
+		switch( stream.kind )
+		{
+			case MeshFileStreamKind::positions: ok = bind_stream_( view.positions, stream, bytes ); break;
+			case MeshFileStreamKind::materialIds: ok = bind_stream_( view.materialIds, stream, bytes ); break;
+			case MeshFileStreamKind::normals: ok = bind_stream_( view.normals, stream, bytes ); break;
+			case MeshFileStreamKind::texcoords: ok = bind_stream_( view.texcoords, stream, bytes ); break;
+			case MeshFileStreamKind::materials: ok = bind_stream_( view.materials, stream, bytes ); break;
+			case MeshFileStreamKind::indices32: ok = bind_stream_( view.indices, stream, bytes ); break;
+			case MeshFileStreamKind::indices16: ok = bind_stream_( view.shortIndices, stream, bytes ); break;
+			case MeshFileStreamKind::packed: ok = bind_stream_( view.packed, stream, bytes ); break;
+			case MeshFileStreamKind::lods: ok = bind_stream_( view.lods, stream, bytes ); break;
+			case MeshFileStreamKind::dequant:
+			{
+				std::span<PositionDequant const> dequant;
+				ok = bind_stream_( dequant, stream, bytes ) && 1 == dequant.size();
+				if( ok )
+					view.dequant = dequant.front();
+			} break;
+		}
+
+		if( !ok )
+			return {};
+	}
+
+	if( aHeader )
+		*aHeader = header;
+	if( aSourcePath )
+		aSourcePath->assign( reinterpret_cast<char const*>(bytes.data() + sizeof(MeshFileHeader)), header.pathLength );
+
+	return LoadedMesh( std::move(file), view );
+}
+
+bool write_mesh_file( char const* aPath, std::string_view aSourcePath, AssetSourceKey const& aKey, std::uint32_t aFlags, SimpleMeshData const& aMesh )
+{
+	// Store indices in the width that create_vao() will upload, so that the
+	// mapped data can be used as-is.
+	std::vector<std::uint16_t> shortIndices;
+	bool const narrow = !aMesh.indices.empty() && GL_UNSIGNED_SHORT == index_type( aMesh );
+	if( narrow )
+		shortIndices.assign( aMesh.indices.begin(), aMesh.indices.end() );
+
+	struct Source_
+	{
+		MeshFileStreamKind kind;
+		std::uint32_t elementSize;
+		void const* data;
+		std::size_t count;
+	};
+
+	std::vector<Source_> const sources{
+		{ MeshFileStreamKind::positions, sizeof(Vec3f), aMesh.positions.data(), aMesh.positions.size() },
+		{ MeshFileStreamKind::materialIds, sizeof(std::uint16_t), aMesh.materialIds.data(), aMesh.materialIds.size() },
+		{ MeshFileStreamKind::normals, sizeof(Vec3f), aMesh.normals.data(), aMesh.normals.size() },
+		{ MeshFileStreamKind::texcoords, sizeof(Vec2f), aMesh.texcoords.data(), aMesh.texcoords.size() },
+		{ MeshFileStreamKind::materials, sizeof(Material), aMesh.materials.data(), aMesh.materials.size() },
+		{ MeshFileStreamKind::packed, sizeof(PackedVertex), aMesh.packed.data(), aMesh.packed.size() },
+		{ MeshFileStreamKind::dequant, sizeof(PositionDequant), &aMesh.dequant, 1 },
+		{ MeshFileStreamKind::lods, sizeof(MeshLod), aMesh.lods.data(), aMesh.lods.size() },
+		narrow
+			? Source_{ MeshFileStreamKind::indices16, sizeof(std::uint16_t), shortIndices.data(), shortIndices.size() }
+			: Source_{ MeshFileStreamKind::indices32, sizeof(std::uint32_t), aMesh.indices.data(), aMesh.indices.size() }
+	};
+
+	MeshFileHeader header{};
+	std::memcpy( header.magic, kMeshFileMagic_, sizeof(kMeshFileMagic_) );
+	header.version = kMeshFileVersion;
+	header.flags = aFlags;
+	header.sourceSize = aKey.size;
+	header.sourceModTime = aKey.modTime;
+	header.pathLength = std::uint32_t(aSourcePath.size());
+	header.streamCount = std::uint32_t(sources.size());
+
+	std::vector<MeshFileStream> table;
+	std::uint64_t end = sizeof(MeshFileHeader) + aSourcePath.size() + sources.size()*sizeof(MeshFileStream);
+	for( auto const& source : sources )
+	{
+		auto const offset = align_up_( end );
+		table.emplace_back( MeshFileStream{ source.kind, source.elementSize, offset, source.count } );
+		end = offset + source.count * source.elementSize;
+	}
+
+	// Write to a temporary file first, and move it into place once complete.
+	// This way, a crash or a concurrent load never sees a partial file.
+	std::string const path( aPath );
+	auto const tempPath = path + ".tmp";
+
+	std::FILE* fout = std::fopen( tempPath.c_str(), "wb" );
+	if( !fout )
+	{
+		std::print( stderr, "Note: unable to write mesh file '{}'\n", path );
+		return false;
+	}
+
+	std::uint64_t written = 0;
+	auto const write_ = [&] ( void const* aData, std::size_t aBytes ) {
+		if( aBytes )
+			written += std::fwrite( aData, 1, aBytes, fout );
+	};
+	auto const pad_ = [&] ( std::uint64_t aTo ) {
+		static constexpr std::byte kZeros[kMeshFileAlignment] = {};
+		if( aTo > written )
+			write_( kZeros, std::size_t(aTo - written) );
+	};
+
+	write_( &header, sizeof(header) );
+	write_( aSourcePath.data(), aSourcePath.size() );
+	write_( table.data(), table.size() * sizeof(MeshFileStream) );
+
+	for( std::size_t i = 0; i < sources.size(); ++i )
+	{
+		pad_( table[i].offset );
+		write_( sources[i].data, sources[i].count * sources[i].elementSize );
+	}
+
+	bool const ok = (0 == std::ferror( fout )) && written == end;
+	std::fclose( fout );
+
+	std::error_code ec;
+	if( ok )
+		std::filesystem::rename( tempPath, path, ec );
+
+	if( !ok || ec )
+	{
+		std::filesystem::remove( tempPath, ec );
+		std::print( stderr, "Note: unable to write mesh file '{}'\n", path );
+		return false;
+	}
+
+	return true;
+}
+
+std::string mesh_cache_path( char const* aSourcePath )
+{
+	return std::string(aSourcePath) + ".meshcache";
+}
+
+SimpleMeshData build_mesh( char const* aPath, std::uint32_t aFlags, MeshOptimizeReport* aReport )
+{
+	auto mesh = load_wavefront_obj( aPath, 0 != (aFlags & kMeshFlagWeld) );
+	process_mesh( mesh, aFlags, aReport );
+	return mesh;
+}
+
+void process_mesh( SimpleMeshData& aMesh, std::uint32_t aFlags, MeshOptimizeReport* aReport )
+{
+	// Optimization reorders the separate streams, so it has to happen before
+	// packing.
+	if( (aFlags & kMeshFlagOptimize) && !aMesh.indices.empty() )
+	{
+		auto const report = optimize_mesh( aMesh );
+		if( aReport )
+			*aReport = report;
+	}
+
+	// LODs are generated after optimization: the vertex order is final at
+	// that point, and each LOD gets its own vertex cache optimization.
+	if( (aFlags & kMeshFlagLods) && !aMesh.indices.empty() )
+		generate_lods( aMesh );
+
+	if( aFlags & kMeshFlagPacked )
+		pack_vertices( aMesh );
+}
+
+LoadedMesh load_wavefront_obj_cached( char const* aPath, std::uint32_t aFlags )
+{
+	std::uint32_t const flags = aFlags & (kMeshFlagWeld | kMeshFlagPacked | kMeshFlagOptimize | kMeshFlagLods);
+
+	// Baked meshes are used as-is; keeping them up to date is the job of the
+	// asset-baker tool.
+	MeshFileHeader header;
+	auto const bakedPath = baked_asset_path( aPath, kBakedMeshExtension );
+	if( auto baked = open_mesh_file( bakedPath.c_str(), &header ); baked && flags == header.flags )
+		return std::move(*baked);
+
+	// The cache is only valid for the exact source it was created from
+	auto const key = asset_source_key( aPath );
+	auto const cachePath = mesh_cache_path( aPath );
+
+	std::string cachedSource;
+	if( auto cached = open_mesh_file( cachePath.c_str(), &header, &cachedSource ) )
+	{
+		if( key && flags == header.flags && cachedSource == aPath
+			&& *key == AssetSourceKey{ header.sourceSize, header.sourceModTime } )
+		{
+			return std::move(*cached);
+		}
+	}
+
+	MeshOptimizeReport report{};
+	auto mesh = build_mesh( aPath, flags, &report );
+	if( flags & kMeshFlagOptimize )
+	{
+		std::print( "Note: optimized '{}': ACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}\n", aPath,
+			report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr );
+	}
+
+	if( key )
+		write_mesh_file( cachePath.c_str(), aPath, *key, flags, mesh );
+
+	return LoadedMesh( std::move(mesh) );
+}
@@ -0,0 +1,131 @@
+#ifndef MESH_CACHE_HPP_8E2B4F0A_61C7_4D93_A5E8_2C9F7B3D1E46
+#define MESH_CACHE_HPP_8E2B4F0A_61C7_4D93_A5E8_2C9F7B3D1E46
+
+#include <string>
+#include <optional>
+
+#include <cstdint>
+
+#include "simple_mesh.hpp"
+#include "baked_assets.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+
+#include "../support/mapped_file.hpp"
+
+/* Binary mesh files
+ *
+ * Parsing large OBJ files as text dominates start-up time. Meshes are
+ * therefore stored in a simple binary container that can be memory-mapped
+ * and uploaded directly from the mapped pages. The same container is used in
+ * two places:
+ *
+ *  - Mesh cache: the first time an OBJ file is loaded, the resulting mesh is
+ *    written next to it ("<source>.meshcache"). The cache is only used if the
+ *    source path, size, modification time and load flags match.
+ *
+ *  - Baked meshes: the asset-baker tool writes meshes ahead of time into
+ *    "<source dir>/baked/<source name>.mesh" (see baked_asset_path()). If a
+ *    baked mesh exists, it is used as-is, without consulting the source.
+ *
+ * File layout (native endianness):
+ *   - MeshFileHeader
+ *   - source path (pathLength bytes, not null-terminated)
+ *   - streamCount x MeshFileStream
+ *   - stream data, each stream aligned to kMeshFileAlignment bytes
+ */
+constexpr std::uint32_t kMeshFileVersion = 3;
+constexpr std::size_t kMeshFileAlignment = 16;
+
+// Load flags stored in the header
+constexpr std::uint32_t kMeshFlagWeld = 1u << 0;
+constexpr std::uint32_t kMeshFlagPacked = 1u << 1; // see pack_vertices()
+constexpr std::uint32_t kMeshFlagOptimize = 1u << 2; // see optimize_mesh(); requires kMeshFlagWeld
+constexpr std::uint32_t kMeshFlagLods = 1u << 3; // see generate_lods(); requires kMeshFlagWeld
+
+enum class MeshFileStreamKind : std::uint32_t
+{
+	positions = 1,
+	materialIds,
+	normals,
+	texcoords,
+	materials,
+	indices32,
+	indices16,
+	packed,
+	dequant,
+	lods
+};
+
+struct MeshFileHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t flags;
+
+	std::uint64_t sourceSize;
+	std::int64_t sourceModTime;
+
+	std::uint32_t pathLength;
+	std::uint32_t streamCount;
+};
+
+struct MeshFileStream
+{
+	MeshFileStreamKind kind;
+	std::uint32_t elementSize;
+	std::uint64_t offset; // from start of file
+	std::uint64_t count;  // number of elements
+};
+
+// Mesh data backed either by a memory-mapped mesh file or by a freshly
+// loaded SimpleMeshData. Either way, view() is valid for the lifetime of the
+// object.
+class LoadedMesh final
+{
+	public:
+		explicit LoadedMesh( SimpleMeshData );
+		LoadedMesh( MappedFile, SimpleMeshView );
+
+		LoadedMesh( LoadedMesh&& ) noexcept;
+		LoadedMesh& operator= (LoadedMesh&&) noexcept;
+
+	public:
+		SimpleMeshView const& view() const noexcept;
+
+		bool from_file() const noexcept;
+
+	private:
+		std::optional<SimpleMeshData> mData;
+		MappedFile mFile;
+		SimpleMeshView mView;
+};
+
+// Open a mesh file. Returns an empty optional if the file does not exist or
+// is not a valid mesh file of the current version. On success, the header
+// and stored source path are returned via aHeader and aSourcePath, if given.
+std::optional<LoadedMesh> open_mesh_file( char const* aPath, MeshFileHeader* aHeader = nullptr, std::string* aSourcePath = nullptr );
+
+// Write a mesh file. The file is written to a temporary location first and
+// moved into place once complete. Returns false (after printing a note) if
+// the file cannot be written.
+bool write_mesh_file( char const* aPath, std::string_view aSourcePath, AssetSourceKey const&, std::uint32_t aFlags, SimpleMeshData const& );
+
+// Path of the cache file that belongs to aSourcePath
+std::string mesh_cache_path( char const* aSourcePath );
+
+// Parse an OBJ file and process it as described by aFlags, a combination of
+// kMeshFlagWeld (see load_wavefront_obj()), kMeshFlagOptimize, kMeshFlagLods
+// and kMeshFlagPacked. If aReport is given and the mesh is optimized, the
+// optimization statistics are returned through it.
+SimpleMeshData build_mesh( char const* aPath, std::uint32_t aFlags, MeshOptimizeReport* aReport = nullptr );
+
+// The processing steps of build_mesh() that follow parsing (and welding), for
+// meshes that come from elsewhere.
+void process_mesh( SimpleMeshData&, std::uint32_t aFlags, MeshOptimizeReport* aReport = nullptr );
+
+// Load an OBJ file, preferring a baked mesh, then the mesh cache, and only
+// then parsing the OBJ with build_mesh() (and writing the cache).
+LoadedMesh load_wavefront_obj_cached( char const* aPath, std::uint32_t aFlags = 0 );
+
+#endif // MESH_CACHE_HPP_8E2B4F0A_61C7_4D93_A5E8_2C9F7B3D1E46
@@ -0,0 +1,36 @@
+#include "mesh_lod.hpp"
+
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+float lod_pixel_scale( float aFovY, float aViewportHeight ) noexcept
+{
+	return aViewportHeight / (2.f * std::tan( 0.5f * aFovY ));
+}
+
+float distance_to_box( Vec3f aPoint, Vec3f aMin, Vec3f aMax ) noexcept
+{
+	float const dx = std::max( { aMin.x - aPoint.x, 0.f, aPoint.x - aMax.x } );
+	float const dy = std::max( { aMin.y - aPoint.y, 0.f, aPoint.y - aMax.y } );
+	float const dz = std::max( { aMin.z - aPoint.z, 0.f, aPoint.z - aMax.z } );
+	return std::sqrt( dx*dx + dy*dy + dz*dz );
+}
+
+std::size_t select_lod( std::span<MeshLod const> aLods, float aDistance, float aPixelScale, float aMaxPixelError ) noexcept
+{
+	assert( !aLods.empty() );
+
+	// Avoid dividing by zero when the camera is inside the bounds
+	float const distance = std::max( aDistance, 1e-3f );
+
+	std::size_t ret = 0;
+	for( std::size_t i = 1; i < aLods.size(); ++i )
+	{
+		if( aLods[i].error * aPixelScale / distance > aMaxPixelError )
+			break;
+		ret = i;
+	}
+	return ret;
+}
@@ -0,0 +1,44 @@
+#ifndef MESH_LOD_HPP_94E2B7A1_5C03_4D8F_A6E9_3B17C0F85D26
+#define MESH_LOD_HPP_94E2B7A1_5C03_4D8F_A6E9_3B17C0F85D26
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+/* Levels of detail
+ *
+ * A LOD is a range of a mesh's index buffer. All LODs of a mesh share the
+ * same vertices; LOD 0 is the full-detail mesh and each following LOD has
+ * fewer triangles (see generate_lods() in mesh_simplify.hpp).
+ *
+ * Each LOD records its geometric error, i.e., how far (in model units) its
+ * surface may deviate from LOD 0. At draw time, the error is projected to
+ * the screen, and the coarsest LOD whose projected error stays below a pixel
+ * threshold is used.
+ */
+struct MeshLod
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	float error;
+	std::uint32_t reserved; // zero; keeps the struct 16 bytes in mesh files
+};
+
+static_assert( 16 == sizeof(MeshLod) );
+
+// Number of pixels that one unit covers at distance one, for a perspective
+// projection with the given vertical field of view.
+float lod_pixel_scale( float aFovY, float aViewportHeight ) noexcept;
+
+// Distance from aPoint to the box [aMin, aMax] (zero if inside)
+float distance_to_box( Vec3f aPoint, Vec3f aMin, Vec3f aMax ) noexcept;
+
+// Index of the coarsest LOD whose error, seen from aDistance, projects to at
+// most aMaxPixelError pixels. aLods must be non-empty and ordered from fine
+// to coarse.
+std::size_t select_lod( std::span<MeshLod const> aLods, float aDistance, float aPixelScale, float aMaxPixelError = 1.f ) noexcept;
+
+#endif // MESH_LOD_HPP_94E2B7A1_5C03_4D8F_A6E9_3B17C0F85D26
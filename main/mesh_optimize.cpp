@@ -0,0 +1,447 @@
+#include "mesh_optimize.hpp"
+
+#include <array>
+#include <limits>
+#include <vector>
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	constexpr std::uint32_t kInvalid_ = std::numeric_limits<std::uint32_t>::max();
+
+	// Forsyth's tuning parameters (from the original article). The LRU cache
+	// modelled by the scoring function is larger than the simulated FIFO;
+	// the article found this to work well across hardware.
+	constexpr std::size_t kScoreCacheSize_ = 32;
+	constexpr float kCacheDecayPower_ = 1.5f;
+	constexpr float kLastTriScore_ = 0.75f;
+	constexpr float kValenceBoostScale_ = 2.f;
+	constexpr float kValenceBoostPower_ = 0.5f;
+	constexpr std::size_t kMaxValenceTable_ = 32;
+
+	struct ScoreTables_
+	{
+		std::array<float, kScoreCacheSize_> cache;
+		std::array<float, kMaxValenceTable_> valence;
+
+		ScoreTables_()
+		{
+			for( std::size_t i = 0; i < kScoreCacheSize_; ++i )
+			{
+				if( i < 3 )
+				{
+					// The vertices of the last triangle get a fixed score, so
+					// that the next triangle is not biased towards either of
+					// its edges.
+					cache[i] = kLastTriScore_;
+				}
+				else
+				{
+					float const scaler = 1.f / float(kScoreCacheSize_ - 3);
+					cache[i] = std::pow( 1.f - float(i - 3) * scaler, kCacheDecayPower_ );
+				}
+			}
+
+			valence[0] = 0.f;
+			for( std::size_t i = 1; i < kMaxValenceTable_; ++i )
+				valence[i] = kValenceBoostScale_ * std::pow( float(i), -kValenceBoostPower_ );
+		}
+
+		float score( std::uint32_t aCachePos, std::uint32_t aRemaining ) const noexcept
+		{
+			// Vertices without remaining triangles are never picked again
+			if( 0 == aRemaining )
+				return -1.f;
+
+			float ret = aCachePos < kScoreCacheSize_ ? cache[aCachePos] : 0.f;
+			ret += aRemaining < kMaxValenceTable_
+				? valence[aRemaining]
+				: kValenceBoostScale_ * std::pow( float(aRemaining), -kValenceBoostPower_ );
+			return ret;
+		}
+	};
+
+	Vec3f cross_( Vec3f aA, Vec3f aB ) noexcept
+	{
+		return Vec3f{ aA.y*aB.z - aA.z*aB.y, aA.z*aB.x - aA.x*aB.z, aA.x*aB.y - aA.y*aB.x };
+	}
+	float dot_( Vec3f aA, Vec3f aB ) noexcept
+	{
+		return aA.x*aB.x + aA.y*aB.y + aA.z*aB.z;
+	}
+
+	// Simulated FIFO cache; returns the number of misses for one triangle
+	class FifoCache_ final
+	{
+		public:
+			FifoCache_( std::size_t aVertexCount, std::size_t aCacheSize )
+				: mTimestamps( aVertexCount, 0 )
+				, mCacheSize( aCacheSize )
+			{}
+
+			unsigned triangle( std::uint32_t const* aTri ) noexcept
+			{
+				unsigned misses = 0;
+				for( std::size_t k = 0; k < 3; ++k )
+				{
+					// A vertex is in the FIFO if it was inserted within the
+					// last mCacheSize insertions.
+					auto const v = aTri[k];
+					if( 0 == mTimestamps[v] || mTime - mTimestamps[v] >= mCacheSize )
+					{
+						mTimestamps[v] = ++mTime;
+						++misses;
+					}
+				}
+				return misses;
+			}
+
+			void clear() noexcept
+			{
+				// Move time forward far enough to invalidate all entries
+				mTime += mCacheSize + 1;
+			}
+
+		private:
+			std::vector<std::size_t> mTimestamps;
+			std::size_t mCacheSize;
+			std::size_t mTime = 0;
+	};
+}
+
+VertexCacheStats analyze_vertex_cache( std::span<std::uint32_t const> aIndices, std::size_t aVertexCount, std::size_t aCacheSize )
+{
+	assert( 0 == aIndices.size() % 3 );
+
+	std::size_t const triCount = aIndices.size() / 3;
+	if( 0 == triCount )
+		return { 0.f, 0.f };
+
+	FifoCache_ cache( aVertexCount, aCacheSize );
+	std::vector<bool> used( aVertexCount, false );
+
+	std::size_t misses = 0, unique = 0;
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		misses += cache.triangle( &aIndices[t*3] );
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			if( !used[aIndices[t*3+k]] )
+			{
+				used[aIndices[t*3+k]] = true;
+				++unique;
+			}
+		}
+	}
+
+	return { float(misses) / float(triCount), float(misses) / float(unique) };
+}
+
+void optimize_vertex_cache( std::span<std::uint32_t> aIndices, std::size_t aVertexCount )
+{
+	assert( 0 == aIndices.size() % 3 );
+
+	std::size_t const triCount = aIndices.size() / 3;
+	if( 0 == triCount )
+		return;
+
+	static ScoreTables_ const tables;
+
+	// Vertex -> triangle adjacency, stored compactly. The live triangles of
+	// vertex v are adjacency[adjOffset[v] .. adjOffset[v]+remaining[v]).
+	std::vector<std::uint32_t> remaining( aVertexCount, 0 );
+	for( auto const v : aIndices )
+		++remaining[v];
+
+	std::vector<std::uint32_t> adjOffset( aVertexCount+1, 0 );
+	for( std::size_t v = 0; v < aVertexCount; ++v )
+		adjOffset[v+1] = adjOffset[v] + remaining[v];
+
+	std::vector<std::uint32_t> adjacency( aIndices.size() );
+	{
+		std::vector<std::uint32_t> fill( adjOffset.begin(), adjOffset.end()-1 );
+		for( std::size_t i = 0; i < aIndices.size(); ++i )
+			adjacency[fill[aIndices[i]]++] = std::uint32_t(i / 3);
+	}
+
+	std::vector<std::uint32_t> cachePos( aVertexCount, kInvalid_ );
+	std::vector<float> vertexScore( aVertexCount );
+	for( std::size_t v = 0; v < aVertexCount; ++v )
+		vertexScore[v] = tables.score( kInvalid_, remaining[v] );
+
+	std::vector<float> triScore( triCount );
+	for( std::size_t t = 0; t < triCount; ++t )
+		triScore[t] = vertexScore[aIndices[t*3+0]] + vertexScore[aIndices[t*3+1]] + vertexScore[aIndices[t*3+2]];
+
+	std::vector<bool> emitted( triCount, false );
+	std::vector<std::uint32_t> output;
+	output.reserve( aIndices.size() );
+
+	// Start with the best triangle overall. Later, only triangles that touch
+	// the cache are considered, which keeps the algorithm linear.
+	std::uint32_t best = std::uint32_t(std::max_element( triScore.begin(), triScore.end() ) - triScore.begin());
+	std::size_t fallbackCursor = 0;
+
+	std::vector<std::uint32_t> cache, nextCache;
+	cache.reserve( kScoreCacheSize_ + 3 );
+	nextCache.reserve( kScoreCacheSize_ + 3 );
+
+	for( std::size_t emittedCount = 0; emittedCount < triCount; ++emittedCount )
+	{
+		if( kInvalid_ == best )
+		{
+			// Nothing in the cache has triangles left; continue with the
+			// next unused triangle in input order.
+			while( emitted[fallbackCursor] )
+				++fallbackCursor;
+			best = std::uint32_t(fallbackCursor);
+		}
+
+		emitted[best] = true;
+		std::uint32_t const* tri = &aIndices[best*3];
+		output.insert( output.end(), tri, tri+3 );
+
+		// Retire the triangle from its vertices' adjacency
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			auto const v = tri[k];
+			auto* const begin = &adjacency[adjOffset[v]];
+			auto* const end = begin + remaining[v];
+			auto* const it = std::find( begin, end, best );
+			assert( it != end );
+			std::swap( *it, *(end-1) );
+			--remaining[v];
+		}
+
+		// Update the LRU cache: the triangle's vertices move to the front
+		nextCache.assign( tri, tri+3 );
+		for( auto const v : cache )
+		{
+			if( v != tri[0] && v != tri[1] && v != tri[2] )
+				nextCache.push_back( v );
+		}
+
+		// Rescore the affected vertices and their triangles. Vertices that
+		// fell out of the cache are rescored too.
+		for( std::size_t i = 0; i < nextCache.size(); ++i )
+		{
+			auto const v = nextCache[i];
+			cachePos[v] = i < kScoreCacheSize_ ? std::uint32_t(i) : kInvalid_;
+
+			float const score = tables.score( cachePos[v], remaining[v] );
+			float const delta = score - vertexScore[v];
+			vertexScore[v] = score;
+
+			for( std::uint32_t j = 0; j < remaining[v]; ++j )
+				triScore[adjacency[adjOffset[v] + j]] += delta;
+		}
+
+		// Pick the best triangle of the cached vertices. This is a separate
+		// pass: a triangle's score is only final once the deltas of all
+		// three of its vertices have been applied.
+		best = kInvalid_;
+		float bestScore = -1.f;
+		for( std::size_t i = 0; i < nextCache.size() && i < kScoreCacheSize_; ++i )
+		{
+			auto const v = nextCache[i];
+			for( std::uint32_t j = 0; j < remaining[v]; ++j )
+			{
+				auto const t = adjacency[adjOffset[v] + j];
+				if( triScore[t] > bestScore )
+				{
+					bestScore = triScore[t];
+					best = t;
+				}
+			}
+		}
+
+		if( nextCache.size() > kScoreCacheSize_ )
+			nextCache.resize( kScoreCacheSize_ );
+		std::swap( cache, nextCache );
+	}
+
+	std::copy( output.begin(), output.end(), aIndices.begin() );
+}
+
+void optimize_overdraw( std::span<std::uint32_t> aIndices, std::span<Vec3f const> aPositions, float aThreshold )
+{
+	assert( 0 == aIndices.size() % 3 );
+
+	std::size_t const triCount = aIndices.size() / 3;
+	if( triCount < 2 )
+		return;
+
+	// Find cluster boundaries. A hard boundary is where the vertex-cache
+	// order starts over (all three vertices miss). Hard clusters are split
+	// further where the ACMR of the part so far is within aThreshold of the
+	// whole cluster's ACMR, i.e., where starting with a cold cache costs
+	// little.
+	std::vector<unsigned> misses( triCount );
+	{
+		FifoCache_ cache( aPositions.size(), kVertexCacheSimSize );
+		for( std::size_t t = 0; t < triCount; ++t )
+			misses[t] = cache.triangle( &aIndices[t*3] );
+	}
+
+	std::vector<std::size_t> hard;
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		if( 0 == t || 3 == misses[t] )
+			hard.push_back( t );
+	}
+	hard.push_back( triCount );
+
+	std::vector<std::size_t> clusters; // start triangle of each cluster
+	{
+		FifoCache_ cache( aPositions.size(), kVertexCacheSimSize );
+		for( std::size_t h = 0; h+1 < hard.size(); ++h )
+		{
+			std::size_t const begin = hard[h], end = hard[h+1];
+
+			std::size_t clusterMisses = 0;
+			for( std::size_t t = begin; t < end; ++t )
+				clusterMisses += misses[t];
+			float const target = aThreshold * float(clusterMisses) / float(end - begin);
+
+			clusters.push_back( begin );
+
+			cache.clear();
+			std::size_t partMisses = 0, partStart = begin;
+			for( std::size_t t = begin; t < end; ++t )
+			{
+				partMisses += cache.triangle( &aIndices[t*3] );
+
+				std::size_t const partTris = t+1 - partStart;
+				if( t+1 < end && float(partMisses) <= target * float(partTris) )
+				{
+					clusters.push_back( t+1 );
+					cache.clear();
+					partMisses = 0;
+					partStart = t+1;
+				}
+			}
+		}
+	}
+	clusters.push_back( triCount );
+
+	// Sort clusters by how much they face away from the mesh's centre.
+	// Clusters on the outside, facing outwards, are drawn first.
+	auto const tri_ = [&] ( std::size_t aTri, Vec3f& aCentroid, Vec3f& aAreaNormal ) {
+		Vec3f const p0 = aPositions[aIndices[aTri*3+0]];
+		Vec3f const p1 = aPositions[aIndices[aTri*3+1]];
+		Vec3f const p2 = aPositions[aIndices[aTri*3+2]];
+		aCentroid = (1.f/3.f) * (p0 + p1 + p2);
+		aAreaNormal = cross_( p1 - p0, p2 - p0 ); // length = 2*area
+	};
+
+	Vec3f meshCentroid{ 0.f, 0.f, 0.f };
+	float meshArea = 0.f;
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		Vec3f c, n;
+		tri_( t, c, n );
+		float const area = std::sqrt( dot_( n, n ) );
+		meshCentroid += area * c;
+		meshArea += area;
+	}
+	if( meshArea > 0.f )
+		meshCentroid = (1.f / meshArea) * meshCentroid;
+
+	std::size_t const clusterCount = clusters.size()-1;
+	std::vector<float> sortKey( clusterCount );
+	for( std::size_t i = 0; i < clusterCount; ++i )
+	{
+		Vec3f centroid{ 0.f, 0.f, 0.f }, normal{ 0.f, 0.f, 0.f };
+		float area = 0.f;
+		for( std::size_t t = clusters[i]; t < clusters[i+1]; ++t )
+		{
+			Vec3f c, n;
+			tri_( t, c, n );
+			float const a = std::sqrt( dot_( n, n ) );
+			centroid += a * c;
+			normal += n;
+			area += a;
+		}
+
+		float const normalLength = std::sqrt( dot_( normal, normal ) );
+		if( area > 0.f && normalLength > 0.f )
+			sortKey[i] = dot_( (1.f / area) * centroid - meshCentroid, (1.f / normalLength) * normal );
+		else
+			sortKey[i] = 0.f;
+	}
+
+	std::vector<std::size_t> order( clusterCount );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+	std::stable_sort( order.begin(), order.end(), [&] ( std::size_t aA, std::size_t aB ) {
+		return sortKey[aA] > sortKey[aB];
+	} );
+
+	std::vector<std::uint32_t> output;
+	output.reserve( aIndices.size() );
+	for( auto const i : order )
+		output.insert( output.end(), aIndices.begin() + clusters[i]*3, aIndices.begin() + clusters[i+1]*3 );
+
+	std::copy( output.begin(), output.end(), aIndices.begin() );
+}
+
+void optimize_vertex_fetch( SimpleMeshData& aMeshData )
+{
+	assert( aMeshData.packed.empty() );
+
+	std::size_t const vertexCount = aMeshData.positions.size();
+
+	std::vector<std::uint32_t> remap( vertexCount, kInvalid_ );
+	std::uint32_t next = 0;
+	for( auto& index : aMeshData.indices )
+	{
+		if( kInvalid_ == remap[index] )
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	auto const reorder_ = [&] ( auto& aStream ) {
+		if( aStream.empty() )
+			return;
+
+		assert( aStream.size() == vertexCount );
+		std::remove_reference_t<decltype(aStream)> out( next );
+		for( std::size_t v = 0; v < vertexCount; ++v )
+		{
+			if( kInvalid_ != remap[v] )
+				out[remap[v]] = aStream[v];
+		}
+		aStream = std::move(out);
+	};
+
+	reorder_( aMeshData.positions );
+	reorder_( aMeshData.normals );
+	reorder_( aMeshData.texcoords );
+	reorder_( aMeshData.materialIds );
+}
+
+
+MeshOptimizeReport optimize_mesh( SimpleMeshData& aMeshData )
+{
+	assert( aMeshData.packed.empty() );
+
+	auto const vertexCount = aMeshData.positions.size();
+
+	MeshOptimizeReport report{};
+	report.before = analyze_vertex_cache( aMeshData.indices, vertexCount );
+	if( aMeshData.indices.empty() )
+	{
+		report.after = report.before;
+		return report;
+	}
+
+	optimize_vertex_cache( aMeshData.indices, vertexCount );
+	optimize_overdraw( aMeshData.indices, aMeshData.positions );
+	optimize_vertex_fetch( aMeshData );
+
+	report.after = analyze_vertex_cache( aMeshData.indices, aMeshData.positions.size() );
+	return report;
+}
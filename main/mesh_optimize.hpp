@@ -0,0 +1,66 @@
+#ifndef MESH_OPTIMIZE_HPP_71C3A9E0_2D84_4F6B_9E15_B80D6F42C7A3
+#define MESH_OPTIMIZE_HPP_71C3A9E0_2D84_4F6B_9E15_B80D6F42C7A3
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simple_mesh.hpp"
+
+#include "../vmlib/vec3.hpp"
+
+/* Mesh optimization for indexed triangle meshes
+ *
+ * The passes are meant to run in order, once, on welded meshes (i.e., in the
+ * asset-baker or before writing the mesh cache):
+ *
+ *  1. optimize_vertex_cache(): reorder triangles so that consecutive
+ *     triangles share vertices (Forsyth, "Linear-Speed Vertex Cache
+ *     Optimisation").
+ *  2. optimize_overdraw(): split the result into clusters and draw the
+ *     outward-facing clusters first, so that they occlude the rest (Sander et
+ *     al., "Fast Triangle Reordering for Vertex Locality and Reduced
+ *     Overdraw"). Clusters keep their internal order, so only a little of the
+ *     vertex-cache efficiency is traded for less overdraw.
+ *  3. optimize_vertex_fetch(): renumber the vertices in the order in which
+ *     they are first referenced, so that vertex fetches walk the buffer
+ *     linearly.
+ *
+ * optimize_mesh() runs all three on a SimpleMeshData.
+ */
+
+// Size of the FIFO post-transform cache that analyze_vertex_cache() simulates.
+// Actual hardware differs, but a small FIFO is a reasonable approximation.
+constexpr std::size_t kVertexCacheSimSize = 16;
+
+struct VertexCacheStats
+{
+	float acmr; // average cache miss ratio: transformed vertices per triangle (0.5 .. 3)
+	float atvr; // average transformed vertex ratio: transformed / unique vertices (>= 1)
+};
+
+VertexCacheStats analyze_vertex_cache( std::span<std::uint32_t const> aIndices, std::size_t aVertexCount, std::size_t aCacheSize = kVertexCacheSimSize );
+
+void optimize_vertex_cache( std::span<std::uint32_t> aIndices, std::size_t aVertexCount );
+
+// aThreshold limits how much worse than the input the ACMR may become (e.g.,
+// 1.05 = 5% worse). Larger values produce smaller clusters.
+void optimize_overdraw( std::span<std::uint32_t> aIndices, std::span<Vec3f const> aPositions, float aThreshold = 1.05f );
+
+// Reorders the separate vertex streams of the mesh. Unreferenced vertices are
+// dropped.
+void optimize_vertex_fetch( SimpleMeshData& );
+
+
+struct MeshOptimizeReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+// Runs all passes on an indexed, unpacked mesh. Non-indexed meshes are left
+// untouched.
+MeshOptimizeReport optimize_mesh( SimpleMeshData& );
+
+#endif // MESH_OPTIMIZE_HPP_71C3A9E0_2D84_4F6B_9E15_B80D6F42C7A3
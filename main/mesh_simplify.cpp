@@ -0,0 +1,409 @@
+#include "mesh_simplify.hpp"
+
+#include <limits>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include <cmath>
+#include <cassert>
+
+#include "mesh_optimize.hpp"
+
+namespace
+{
+	constexpr std::uint32_t kInvalid_ = std::numeric_limits<std::uint32_t>::max();
+
+	// Symmetric 4x4 matrix (upper triangle) plus the total weight of the
+	// planes that were added to it
+	struct Quadric_
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		void add_plane( double aA, double aB, double aC, double aD, double aWeight ) noexcept
+		{
+			a00 += aWeight*aA*aA; a01 += aWeight*aA*aB; a02 += aWeight*aA*aC; a03 += aWeight*aA*aD;
+			a11 += aWeight*aB*aB; a12 += aWeight*aB*aC; a13 += aWeight*aB*aD;
+			a22 += aWeight*aC*aC; a23 += aWeight*aC*aD;
+			a33 += aWeight*aD*aD;
+			weight += aWeight;
+		}
+
+		Quadric_& operator+= ( Quadric_ const& aOther ) noexcept
+		{
+			a00 += aOther.a00; a01 += aOther.a01; a02 += aOther.a02; a03 += aOther.a03;
+			a11 += aOther.a11; a12 += aOther.a12; a13 += aOther.a13;
+			a22 += aOther.a22; a23 += aOther.a23;
+			a33 += aOther.a33;
+			weight += aOther.weight;
+			return *this;
+		}
+
+		// Sum of squared distances to the planes at aP
+		double evaluate( Vec3f aP ) const noexcept
+		{
+			double const x = aP.x, y = aP.y, z = aP.z;
+			return a00*x*x + 2*a01*x*y + 2*a02*x*z + 2*a03*x
+				+ a11*y*y + 2*a12*y*z + 2*a13*y
+				+ a22*z*z + 2*a23*z
+				+ a33;
+		}
+	};
+
+	struct Bounds_
+	{
+		Vec3f min;
+		float extent; // largest side of the bounding box
+	};
+
+	struct Collapse_
+	{
+		float cost;
+		float positionError; // squared, in normalized units
+		std::uint32_t from;
+		std::uint32_t to;
+	};
+
+	Vec3f cross_( Vec3f aA, Vec3f aB ) noexcept
+	{
+		return Vec3f{ aA.y*aB.z - aA.z*aB.y, aA.z*aB.x - aA.x*aB.z, aA.x*aB.y - aA.y*aB.x };
+	}
+	float dot_( Vec3f aA, Vec3f aB ) noexcept
+	{
+		return aA.x*aB.x + aA.y*aB.y + aA.z*aB.z;
+	}
+
+	Bounds_ compute_bounds_( std::span<Vec3f const> aPositions ) noexcept
+	{
+		if( aPositions.empty() )
+			return { Vec3f{ 0.f, 0.f, 0.f }, 1.f };
+
+		Vec3f lo = aPositions.front(), hi = lo;
+		for( auto const& p : aPositions )
+		{
+			lo = Vec3f{ std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) };
+			hi = Vec3f{ std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) };
+		}
+
+		float const extent = std::max( { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z } );
+		return { lo, extent > 0.f ? extent : 1.f };
+	}
+
+	// Vertices that must not move: vertices on open borders (edges that
+	// belong to a single triangle) and vertices on attribute seams (another
+	// vertex has the same position)
+	std::vector<bool> find_locked_( std::span<Vec3f const> aPositions, std::span<std::uint32_t const> aIndices )
+	{
+		std::vector<bool> locked( aPositions.size(), false );
+
+		struct PositionHash_
+		{
+			std::size_t operator() (Vec3f const& aP) const noexcept
+			{
+				std::uint32_t bits[3];
+				std::memcpy( bits, &aP, sizeof(bits) );
+				std::size_t h = bits[0];
+				h = h * 0x9E3779B97F4A7C15ull + bits[1];
+				h = h * 0x9E3779B97F4A7C15ull + bits[2];
+				return h ^ (h >> 29);
+			}
+		};
+		struct PositionEqual_
+		{
+			bool operator() (Vec3f const& aA, Vec3f const& aB) const noexcept
+			{
+				return 0 == std::memcmp( &aA, &aB, sizeof(Vec3f) );
+			}
+		};
+
+		std::unordered_map<Vec3f, std::uint32_t, PositionHash_, PositionEqual_> firstAt;
+		firstAt.reserve( aPositions.size() );
+		for( std::uint32_t v = 0; v < aPositions.size(); ++v )
+		{
+			auto const [it, inserted] = firstAt.try_emplace( aPositions[v], v );
+			if( !inserted )
+			{
+				locked[v] = true;
+				locked[it->second] = true;
+			}
+		}
+
+		// Count how many triangles use each (undirected) edge
+		std::unordered_map<std::uint64_t, std::uint32_t> edgeUse;
+		edgeUse.reserve( aIndices.size() );
+		auto const edge_key_ = [] ( std::uint32_t aA, std::uint32_t aB ) {
+			if( aA > aB )
+				std::swap( aA, aB );
+			return (std::uint64_t(aA) << 32) | aB;
+		};
+
+		for( std::size_t i = 0; i < aIndices.size(); i += 3 )
+		{
+			for( std::size_t k = 0; k < 3; ++k )
+				++edgeUse[edge_key_( aIndices[i+k], aIndices[i+(k+1)%3] )];
+		}
+
+		for( auto const& [key, count] : edgeUse )
+		{
+			if( 1 == count )
+			{
+				locked[std::uint32_t(key >> 32)] = true;
+				locked[std::uint32_t(key)] = true;
+			}
+		}
+
+		return locked;
+	}
+}
+
+std::vector<std::uint32_t> simplify_indices( SimpleMeshData const& aMesh, std::span<std::uint32_t const> aIndices, std::size_t aTargetIndexCount, float aMaxError, float* aResultError, SimplifyOptions const& aOptions )
+{
+	assert( aMesh.packed.empty() );
+	assert( 0 == aIndices.size() % 3 );
+
+	std::size_t const vertexCount = aMesh.positions.size();
+	bool const hasNormals = aMesh.normals.size() == vertexCount;
+	bool const hasTexcoords = aMesh.texcoords.size() == vertexCount;
+
+	// Work in normalized coordinates, so that the cost function (and
+	// especially the weight of the attribute penalties) does not depend on
+	// the size of the mesh.
+	auto const bounds = compute_bounds_( aMesh.positions );
+	float const invExtent = 1.f / bounds.extent;
+
+	std::vector<Vec3f> positions( vertexCount );
+	for( std::size_t v = 0; v < vertexCount; ++v )
+		positions[v] = invExtent * (aMesh.positions[v] - bounds.min);
+
+	double const maxPositionError = double(aMaxError * invExtent) * double(aMaxError * invExtent);
+
+	auto const locked = find_locked_( aMesh.positions, aIndices );
+
+	// Initial quadrics: the planes of the adjacent triangles, weighted by
+	// area
+	std::vector<Quadric_> quadrics( vertexCount );
+	for( std::size_t i = 0; i < aIndices.size(); i += 3 )
+	{
+		Vec3f const p0 = positions[aIndices[i+0]];
+		Vec3f const n = cross_( positions[aIndices[i+1]] - p0, positions[aIndices[i+2]] - p0 );
+		float const length = std::sqrt( dot_( n, n ) );
+		if( length <= 0.f )
+			continue;
+
+		Vec3f const unit = (1.f / length) * n;
+		float const area = 0.5f * length;
+		for( std::size_t k = 0; k < 3; ++k )
+			quadrics[aIndices[i+k]].add_plane( unit.x, unit.y, unit.z, -dot_( unit, p0 ), area );
+	}
+
+	auto const cost_ = [&] ( std::uint32_t aFrom, std::uint32_t aTo, double& aPositionError ) {
+		Quadric_ q = quadrics[aFrom];
+		q += quadrics[aTo];
+
+		aPositionError = q.weight > 0.0 ? std::max( 0.0, q.evaluate( positions[aTo] ) / q.weight ) : 0.0;
+
+		double attributes = 0.0;
+		if( hasNormals )
+		{
+			Vec3f const d = aMesh.normals[aFrom] - aMesh.normals[aTo];
+			attributes += aOptions.normalWeight * dot_( d, d );
+		}
+		if( hasTexcoords )
+		{
+			Vec2f const d = aMesh.texcoords[aFrom] - aMesh.texcoords[aTo];
+			attributes += aOptions.texcoordWeight * (d.x*d.x + d.y*d.y);
+		}
+
+		return aPositionError + attributes;
+	};
+
+	std::vector<std::uint32_t> indices( aIndices.begin(), aIndices.end() );
+	std::vector<std::uint32_t> remap( vertexCount );
+	std::vector<std::uint32_t> triOffset( vertexCount+1 ), triList;
+	std::vector<std::uint32_t> bestTarget( vertexCount );
+	std::vector<double> bestCost( vertexCount ), bestPositionError( vertexCount );
+	std::vector<bool> touched( vertexCount );
+	std::vector<Collapse_> collapses;
+
+	double resultError = 0.0;
+
+	// Each pass collapses a set of independent edges (no two collapses touch
+	// the same triangle), then rebuilds the index list.
+	while( indices.size() > aTargetIndexCount )
+	{
+		// Vertex -> triangle adjacency of the current mesh
+		std::fill( triOffset.begin(), triOffset.end(), 0u );
+		for( auto const v : indices )
+			++triOffset[v+1];
+		for( std::size_t v = 0; v < vertexCount; ++v )
+			triOffset[v+1] += triOffset[v];
+
+		triList.resize( indices.size() );
+		{
+			std::vector<std::uint32_t> fill( triOffset.begin(), triOffset.end()-1 );
+			for( std::size_t i = 0; i < indices.size(); ++i )
+				triList[fill[indices[i]]++] = std::uint32_t(i / 3);
+		}
+
+		// Best collapse for each vertex
+		std::fill( bestTarget.begin(), bestTarget.end(), kInvalid_ );
+		for( std::size_t i = 0; i < indices.size(); i += 3 )
+		{
+			for( std::size_t k = 0; k < 6; ++k )
+			{
+				auto const from = indices[i + k%3];
+				auto const to = indices[i + (k < 3 ? (k+1)%3 : (k+2)%3)];
+				if( locked[from] )
+					continue;
+
+				double positionError;
+				double const cost = cost_( from, to, positionError );
+				if( positionError > maxPositionError )
+					continue;
+
+				if( kInvalid_ == bestTarget[from] || cost < bestCost[from] )
+				{
+					bestTarget[from] = to;
+					bestCost[from] = cost;
+					bestPositionError[from] = positionError;
+				}
+			}
+		}
+
+		collapses.clear();
+		for( std::uint32_t v = 0; v < vertexCount; ++v )
+		{
+			if( kInvalid_ != bestTarget[v] )
+				collapses.emplace_back( Collapse_{ float(bestCost[v]), float(bestPositionError[v]), v, bestTarget[v] } );
+		}
+		std::sort( collapses.begin(), collapses.end(), [] ( Collapse_ const& aA, Collapse_ const& aB ) {
+			return aA.cost < aB.cost;
+		} );
+
+		// Apply the cheapest collapses. Collapsing the vertices of a triangle
+		// changes the triangle, so all vertices around a collapse are
+		// excluded from further collapses in this pass.
+		for( std::uint32_t v = 0; v < vertexCount; ++v )
+			remap[v] = v;
+		std::fill( touched.begin(), touched.end(), false );
+
+		std::size_t const trianglesToRemove = (indices.size() - aTargetIndexCount + 2) / 3;
+		std::size_t removed = 0, applied = 0;
+
+		for( auto const& collapse : collapses )
+		{
+			if( removed >= trianglesToRemove )
+				break;
+			if( touched[collapse.from] || touched[collapse.to] )
+				continue;
+
+			// Reject collapses that flip a triangle
+			bool flips = false;
+			std::size_t degenerate = 0;
+			for( std::uint32_t j = triOffset[collapse.from]; j < triOffset[collapse.from+1] && !flips; ++j )
+			{
+				std::uint32_t const* tri = &indices[triList[j]*3];
+				if( tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to )
+				{
+					++degenerate;
+					continue;
+				}
+
+				Vec3f before[3], after[3];
+				for( std::size_t k = 0; k < 3; ++k )
+				{
+					before[k] = positions[tri[k]];
+					after[k] = tri[k] == collapse.from ? positions[collapse.to] : before[k];
+				}
+
+				Vec3f const n0 = cross_( before[1] - before[0], before[2] - before[0] );
+				Vec3f const n1 = cross_( after[1] - after[0], after[2] - after[0] );
+				if( dot_( n0, n1 ) <= 0.f )
+					flips = true;
+			}
+
+			if( flips )
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			resultError = std::max( resultError, double(collapse.positionError) );
+
+			for( std::uint32_t j = triOffset[collapse.from]; j < triOffset[collapse.from+1]; ++j )
+			{
+				std::uint32_t const* tri = &indices[triList[j]*3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+			}
+			touched[collapse.to] = true;
+
+			removed += degenerate;
+			++applied;
+		}
+
+		if( 0 == applied )
+			break;
+
+		// Rebuild the index list, dropping triangles that became degenerate
+		std::size_t out = 0;
+		for( std::size_t i = 0; i < indices.size(); i += 3 )
+		{
+			auto const a = remap[indices[i+0]], b = remap[indices[i+1]], c = remap[indices[i+2]];
+			if( a == b || b == c || c == a )
+				continue;
+
+			indices[out++] = a;
+			indices[out++] = b;
+			indices[out++] = c;
+		}
+		indices.resize( out );
+	}
+
+	if( aResultError )
+		*aResultError = float(std::sqrt( resultError )) * bounds.extent;
+
+	return indices;
+}
+
+void generate_lods( SimpleMeshData& aMesh, LodChainOptions const& aOptions )
+{
+	assert( aMesh.packed.empty() );
+	assert( aMesh.lods.empty() );
+
+	if( aMesh.indices.empty() )
+		return;
+
+	auto const bounds = compute_bounds_( aMesh.positions );
+	float const maxError = aOptions.maxRelativeError * bounds.extent;
+
+	aMesh.lods.emplace_back( MeshLod{ 0, std::uint32_t(aMesh.indices.size()), 0.f, 0 } );
+
+	std::vector<std::uint32_t> current( aMesh.indices );
+	float error = 0.f;
+
+	while( aMesh.lods.size() < aOptions.maxLods )
+	{
+		std::size_t const target = std::size_t(float(current.size() / 3) * aOptions.ratio) * 3;
+
+		float stepError = 0.f;
+		auto next = simplify_indices( aMesh, current, target, maxError, &stepError, aOptions.simplify );
+
+		// Stop once a LOD would not be meaningfully cheaper to draw
+		if( next.empty() || 10 * next.size() > 9 * current.size() )
+			break;
+
+		optimize_vertex_cache( next, aMesh.positions.size() );
+
+		// Each LOD is simplified from the previous one, so the deviation from
+		// LOD 0 is at most the sum of the steps.
+		error += stepError;
+
+		aMesh.lods.emplace_back( MeshLod{ std::uint32_t(aMesh.indices.size()), std::uint32_t(next.size()), error, 0 } );
+		aMesh.indices.insert( aMesh.indices.end(), next.begin(), next.end() );
+
+		current = std::move(next);
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef MESH_SIMPLIFY_HPP_3A58D6C2_E17B_4F90_8B4D_62C9A0E17F35
+#define MESH_SIMPLIFY_HPP_3A58D6C2_E17B_4F90_8B4D_62C9A0E17F35
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "simple_mesh.hpp"
+
+/* Mesh simplification with quadric error metrics
+ *
+ * Edges are collapsed in order of increasing cost, where the cost is the
+ * quadric error of the collapsed vertex (Garland & Heckbert, "Surface
+ * Simplification Using Quadric Error Metrics") plus a penalty for the change
+ * in normal and texture coordinates. Vertices are always collapsed onto an
+ * existing vertex, so the simplified mesh only needs new indices and can
+ * share the vertex streams with the original.
+ *
+ * Vertices on open borders and on attribute seams (several vertices at the
+ * same position, e.g., where materials or texture coordinates change) are
+ * never moved. This keeps seams and borders watertight, including the
+ * borders between separately simplified pieces of a mesh.
+ */
+struct SimplifyOptions
+{
+	// Weights of the attribute penalties, relative to the squared position
+	// error in units of the mesh's size
+	float normalWeight = 0.01f;
+	float texcoordWeight = 0.01f;
+};
+
+// Simplify the triangles aIndices (which refer to aMesh's vertices) to at
+// most aTargetIndexCount indices, as long as the error stays below
+// aMaxError (in model units). Returns the new indices; the resulting error
+// is returned via aResultError, if given.
+std::vector<std::uint32_t> simplify_indices(
+	SimpleMeshData const& aMesh,
+	std::span<std::uint32_t const> aIndices,
+	std::size_t aTargetIndexCount,
+	float aMaxError,
+	float* aResultError = nullptr,
+	SimplifyOptions const& = {}
+);
+
+struct LodChainOptions
+{
+	std::size_t maxLods = 5;       // including LOD 0
+	float ratio = 0.5f;            // target triangle count relative to the previous LOD
+	float maxRelativeError = 0.05f; // relative to the mesh's size
+	SimplifyOptions simplify;
+};
+
+// Generate a LOD chain for an indexed, unpacked mesh. The LODs are appended
+// to aMesh.indices and described by aMesh.lods (see mesh_lod.hpp). The chain
+// ends early once simplification no longer makes progress.
+void generate_lods( SimpleMeshData& aMesh, LodChainOptions const& = {} );
+
+#endif // MESH_SIMPLIFY_HPP_3A58D6C2_E17B_4F90_8B4D_62C9A0E17F35
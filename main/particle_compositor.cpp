@@ -0,0 +1,225 @@
+#include "particle_compositor.hpp"
+
+#include <print>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	// Depth format that matches the read framebuffer's depth buffer (as
+	// required by glBlitFramebuffer()), or GL_NONE if it has none.
+	GLenum read_depth_format_()
+	{
+		GLint readFbo = 0;
+		glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readFbo );
+
+		// (The default framebuffer names its buffers differently.)
+		GLenum const depthAttachment = readFbo ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+		GLenum const stencilAttachment = readFbo ? GL_STENCIL_ATTACHMENT : GL_STENCIL;
+
+		GLint type = GL_NONE;
+		glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type );
+		if( GL_NONE == type )
+			return GL_NONE;
+
+		GLint depthBits = 0, componentType = GL_NONE;
+		glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits );
+		glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType );
+
+		GLint stencilType = GL_NONE, stencilBits = 0;
+		glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &stencilType );
+		if( GL_NONE != stencilType )
+			glGetFramebufferAttachmentParameteriv( GL_READ_FRAMEBUFFER, stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits );
+
+		if( GL_FLOAT == componentType )
+			return stencilBits ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+
+		switch( depthBits )
+		{
+			case 16: return GL_DEPTH_COMPONENT16;
+			case 24: return stencilBits ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+			case 32: return GL_DEPTH_COMPONENT32;
+		}
+
+		return GL_NONE;
+	}
+
+	bool has_stencil_( GLenum aDepthFormat ) noexcept
+	{
+		return GL_DEPTH24_STENCIL8 == aDepthFormat || GL_DEPTH32F_STENCIL8 == aDepthFormat;
+	}
+}
+
+ParticleCompositor::ParticleCompositor( ParticleCompositorConfig const& aConfig )
+	: mConfig( aConfig )
+	, mCompositeProg( {
+		{ GL_VERTEX_SHADER, "assets/cw2/particle_composite.vert" },
+		{ GL_FRAGMENT_SHADER, "assets/cw2/particle_composite.frag" }
+	} )
+{
+	// No vertex attributes, but core profile draws need a VAO
+	glGenVertexArrays( 1, &mVao );
+}
+
+ParticleCompositor::~ParticleCompositor()
+{
+	release_target_();
+	glDeleteVertexArrays( 1, &mVao );
+}
+
+ParticleResolution ParticleCompositor::resolution() const noexcept
+{
+	return mConfig.resolution;
+}
+void ParticleCompositor::set_resolution( ParticleResolution aResolution ) noexcept
+{
+	mConfig.resolution = aResolution;
+}
+
+ParticleSpriteSize ParticleCompositor::begin( GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight )
+{
+	mViewX = aX;
+	mViewY = aY;
+	mViewWidth = aWidth;
+	mViewHeight = aHeight;
+	mOffscreen = false;
+
+	// A sprite may cover at most maxSpriteCoverage of the view
+	auto const maxSize = std::sqrt( mConfig.maxSpriteCoverage * float(aWidth) * float(aHeight) );
+
+	if( ParticleResolution::full == mConfig.resolution )
+		return { mConfig.spriteScale, maxSize };
+
+	auto const divisor = GLsizei(mConfig.resolution);
+
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &mSceneFbo );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, GLuint(mSceneFbo) );
+
+	auto const depthFormat = read_depth_format_();
+	if( GL_NONE == depthFormat )
+	{
+		std::print( stderr, "Note: no depth buffer to test particles against; drawing them at full resolution\n" );
+		mConfig.resolution = ParticleResolution::full;
+		return { mConfig.spriteScale, maxSize };
+	}
+
+	// (Re)create the target if the view size or depth format changed
+	auto const lowWidth = std::max( 1, (aWidth + divisor-1) / divisor );
+	auto const lowHeight = std::max( 1, (aHeight + divisor-1) / divisor );
+
+	bool const created = lowWidth != mTargetWidth || lowHeight != mTargetHeight || depthFormat != mDepthFormat;
+	if( created )
+	{
+		mDepthFormat = depthFormat;
+		resize_( lowWidth, lowHeight );
+	}
+
+	// Downsample the scene's depth into the target
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, mFbo );
+	glBlitFramebuffer(
+		aX, aY, aX + aWidth, aY + aHeight,
+		0, 0, lowWidth, lowHeight,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST
+	);
+
+	if( created && GL_INVALID_OPERATION == glGetError() )
+	{
+		std::print( stderr, "Note: unable to copy depth buffer for particles; drawing them at full resolution\n" );
+		mConfig.resolution = ParticleResolution::full;
+		release_target_();
+
+		glBindFramebuffer( GL_FRAMEBUFFER, GLuint(mSceneFbo) );
+		return { mConfig.spriteScale, maxSize };
+	}
+
+	glBindFramebuffer( GL_FRAMEBUFFER, mFbo );
+	glViewport( 0, 0, lowWidth, lowHeight );
+
+	GLfloat const transparent[4] = { 0.f, 0.f, 0.f, 0.f };
+	glClearBufferfv( GL_COLOR, 0, transparent );
+
+	mOffscreen = true;
+
+	auto const scale = 1.f / float(divisor);
+	return { mConfig.spriteScale * scale, maxSize * scale };
+}
+
+void ParticleCompositor::end()
+{
+	if( !mOffscreen )
+		return;
+
+	mOffscreen = false;
+
+	glBindFramebuffer( GL_FRAMEBUFFER, GLuint(mSceneFbo) );
+	glViewport( mViewX, mViewY, mViewWidth, mViewHeight );
+
+	// Add the particles on top of the scene (they were already depth tested)
+	GLboolean const depthTest = glIsEnabled( GL_DEPTH_TEST );
+	glDisable( GL_DEPTH_TEST );
+	glDepthMask( GL_FALSE );
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_ONE, GL_ONE );
+
+	glUseProgram( mCompositeProg.programId() );
+
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, mColor );
+	glUniform1i( 1, 0 );
+
+	glBindVertexArray( mVao );
+	glDrawArrays( GL_TRIANGLES, 0, 3 );
+
+	glBindVertexArray( 0 );
+	glUseProgram( 0 );
+	glDisable( GL_BLEND );
+	glDepthMask( GL_TRUE );
+	if( depthTest )
+		glEnable( GL_DEPTH_TEST );
+}
+
+void ParticleCompositor::resize_( GLsizei aWidth, GLsizei aHeight )
+{
+	release_target_();
+
+	// Colour: additive accumulation needs more range than 8 bits
+	glGenTextures( 1, &mColor );
+	glBindTexture( GL_TEXTURE_2D, mColor );
+	glTexStorage2D( GL_TEXTURE_2D, 1, GL_RGBA16F, aWidth, aHeight );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	// Depth: only tested against, never sampled
+	glGenRenderbuffers( 1, &mDepth );
+	glBindRenderbuffer( GL_RENDERBUFFER, mDepth );
+	glRenderbufferStorage( GL_RENDERBUFFER, mDepthFormat, aWidth, aHeight );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+
+	GLint previous = 0;
+	glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &previous );
+
+	glGenFramebuffers( 1, &mFbo );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, mFbo );
+	glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColor, 0 );
+	glFramebufferRenderbuffer( GL_DRAW_FRAMEBUFFER, has_stencil_( mDepthFormat ) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepth );
+	glBindFramebuffer( GL_DRAW_FRAMEBUFFER, GLuint(previous) );
+
+	mTargetWidth = aWidth;
+	mTargetHeight = aHeight;
+}
+
+void ParticleCompositor::release_target_() noexcept
+{
+	if( mFbo )
+		glDeleteFramebuffers( 1, &mFbo );
+	if( mColor )
+		glDeleteTextures( 1, &mColor );
+	if( mDepth )
+		glDeleteRenderbuffers( 1, &mDepth );
+
+	mFbo = mColor = mDepth = 0;
+	mTargetWidth = mTargetHeight = 0;
+}
@@ -0,0 +1,110 @@
+#ifndef PARTICLE_COMPOSITOR_HPP_1E6B93D4_07A2_4C5F_9B38_E4D0A27F6C81
+#define PARTICLE_COMPOSITOR_HPP_1E6B93D4_07A2_4C5F_9B38_E4D0A27F6C81
+
+#include <glad/glad.h>
+
+#include "../support/program.hpp"
+
+// Resolution of the particle render target, relative to the view
+enum class ParticleResolution
+{
+	full = 1,   // draw straight into the view
+	half = 2,
+	quarter = 4
+};
+
+// Point sprite size, in pixels of the target that is drawn to (particle.vert:
+// uPointSize)
+struct ParticleSpriteSize
+{
+	float scale;   // size at distance one
+	float maxSize; // upper limit
+};
+
+struct ParticleCompositorConfig
+{
+	ParticleResolution resolution = ParticleResolution::half;
+
+	// Size of a sprite at distance one, in pixels of a full resolution view
+	float spriteScale = 500.f;
+
+	// Largest fraction of the view's area that a single sprite may cover
+	float maxSpriteCoverage = 0.01f;
+};
+
+/* Reduced-resolution particle rendering
+ *
+ * Additive particle sprites are cheap to shade but overdraw heavily, so
+ * close to the camera they are limited by fill rate. The compositor draws
+ * them into an offscreen RGBA16F target at half or quarter resolution
+ * instead:
+ *
+ *  - begin() copies the scene's depth buffer into the target at the reduced
+ *    resolution (nearest sample, with glBlitFramebuffer()), so that the
+ *    particles are still hidden by the scene, and clears the colour,
+ *  - the particles are drawn as usual (additive, depth test but no depth
+ *    writes),
+ *  - end() upsamples the result bilinearly and adds it to the view.
+ *
+ * Independently of that, begin() returns the sprite size for the target,
+ * with the size limited by the coverage budget.
+ *
+ * The depth copy requires the target's depth format to match the scene's.
+ * The format is picked from the scene framebuffer's depth and stencil bits;
+ * if the copy fails anyway, the compositor falls back to full resolution.
+ *
+ * Example:
+ *
+ *	queue.execute(); // the scene, including its depth
+ *	auto const sprite = compositor.begin( viewX, viewY, viewW, viewH );
+ *	particles.submit( queue, viewProj, sprite );
+ *	queue.execute();
+ *	compositor.end();
+ */
+class ParticleCompositor final
+{
+	public:
+		// Compiles the composite shader. Throws Error on failure.
+		explicit ParticleCompositor( ParticleCompositorConfig const& = {} );
+		~ParticleCompositor();
+
+		ParticleCompositor( ParticleCompositor const& ) = delete;
+		ParticleCompositor& operator= (ParticleCompositor const&) = delete;
+
+	public:
+		ParticleResolution resolution() const noexcept;
+		void set_resolution( ParticleResolution ) noexcept;
+
+		// Start drawing the particles for the view at (aX, aY, aWidth,
+		// aHeight) of the currently bound framebuffer, which must have a
+		// depth buffer. Binds the particle target (unless the resolution is
+		// full).
+		ParticleSpriteSize begin( GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight );
+
+		// Composite the particles into the view, and restore the framebuffer
+		// and viewport passed to begin()
+		void end();
+
+	private:
+		void resize_( GLsizei aWidth, GLsizei aHeight );
+		void release_target_() noexcept;
+
+		ParticleCompositorConfig mConfig;
+		ShaderProgram mCompositeProg;
+
+		GLuint mFbo = 0;
+		GLuint mColor = 0;
+		GLuint mDepth = 0;
+		GLuint mVao = 0;
+
+		GLenum mDepthFormat = GL_NONE;
+		GLsizei mTargetWidth = 0, mTargetHeight = 0;
+
+		// View of the current begin()/end()
+		GLint mSceneFbo = 0;
+		GLint mViewX = 0, mViewY = 0;
+		GLsizei mViewWidth = 0, mViewHeight = 0;
+		bool mOffscreen = false;
+};
+
+#endif // PARTICLE_COMPOSITOR_HPP_1E6B93D4_07A2_4C5F_9B38_E4D0A27F6C81
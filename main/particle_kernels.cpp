@@ -0,0 +1,251 @@
+#include "particle_kernels.hpp"
+
+#include <cassert>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define PARTICLE_KERNEL_AVX2_ 1
+#	define PARTICLE_KERNEL_SSE_ 0
+#elif defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#	define PARTICLE_KERNEL_AVX2_ 0
+#	define PARTICLE_KERNEL_SSE_ 1
+#else
+#	define PARTICLE_KERNEL_AVX2_ 0
+#	define PARTICLE_KERNEL_SSE_ 0
+#endif
+
+namespace
+{
+	constexpr std::size_t kStreamCount_ = std::size_t(ParticleStream::count);
+
+#	if PARTICLE_KERNEL_SSE_ || PARTICLE_KERNEL_AVX2_
+	// Write the four particles in aX..aLife (one per lane) as (x,y,z,life),
+	// keeping only those whose bit is set in aKeep. Every particle is
+	// stored, but the output only advances past kept ones, so there are no
+	// branches.
+	float* store_packed_4_( float* aOut, __m128 aX, __m128 aY, __m128 aZ, __m128 aLife, int aKeep ) noexcept
+	{
+		_MM_TRANSPOSE4_PS( aX, aY, aZ, aLife );
+
+		_mm_storeu_ps( aOut, aX );
+		aOut += kPackedParticleFloats * ((aKeep >> 0) & 1);
+		_mm_storeu_ps( aOut, aY );
+		aOut += kPackedParticleFloats * ((aKeep >> 1) & 1);
+		_mm_storeu_ps( aOut, aZ );
+		aOut += kPackedParticleFloats * ((aKeep >> 2) & 1);
+		_mm_storeu_ps( aOut, aLife );
+		aOut += kPackedParticleFloats * ((aKeep >> 3) & 1);
+
+		return aOut;
+	}
+#	endif // ~ SSE || AVX2
+
+	// Bit mask of the aLanes particles starting at aIndex that are below
+	// aSize
+	int valid_lanes_( std::size_t aIndex, std::size_t aSize, std::size_t aLanes ) noexcept
+	{
+		std::size_t const remaining = aSize > aIndex ? aSize - aIndex : 0;
+		return int(1u << std::min( remaining, aLanes )) - 1;
+	}
+
+	// Write the indices of the particles whose bit is set in aMask, without
+	// branching (see store_packed_4_())
+	std::uint32_t* store_indices_( std::uint32_t* aOut, std::size_t aIndex, int aMask, std::size_t aLanes ) noexcept
+	{
+		for( std::size_t i = 0; i < aLanes; ++i )
+		{
+			*aOut = std::uint32_t(aIndex + i);
+			aOut += (aMask >> i) & 1;
+		}
+
+		return aOut;
+	}
+}
+
+ParticleStreams::ParticleStreams( std::size_t aCapacity )
+	: mCapacity( (aCapacity + kParticleLanes - 1) / kParticleLanes * kParticleLanes )
+	, mData( kStreamCount_ * mCapacity / kParticleLanes, Lanes_{} )
+{
+	float* life = (*this)[ParticleStream::life];
+	float* maxLife = (*this)[ParticleStream::maxLife];
+	for( std::size_t i = 0; i < mCapacity; ++i )
+	{
+		life[i] = -1.f;
+		maxLife[i] = 1.f;
+	}
+}
+
+std::size_t ParticleStreams::capacity() const noexcept
+{
+	return mCapacity;
+}
+
+std::size_t ParticleStreams::size() const noexcept
+{
+	return mSize;
+}
+
+std::size_t ParticleStreams::spawn( std::size_t aCount ) noexcept
+{
+	auto const count = std::min( aCount, mCapacity - mSize );
+	mSize += count;
+	return count;
+}
+
+void ParticleStreams::remove_dead( std::span<std::uint32_t const> aDead ) noexcept
+{
+	assert( aDead.size() <= mSize );
+
+	float* life = (*this)[ParticleStream::life];
+
+	// Dead particles below the new size are replaced by the live particles
+	// above it, taken from the end. (There are exactly as many of each.)
+	auto const newSize = mSize - aDead.size();
+	auto source = mSize;
+
+	for( auto const dead : aDead )
+	{
+		assert( dead < mSize && life[dead] <= 0.f );
+		if( dead >= newSize )
+			break;
+
+		do
+		{
+			--source;
+		} while( life[source] <= 0.f );
+
+		for( std::size_t s = 0; s < kStreamCount_; ++s )
+		{
+			float* stream = mData[s * mCapacity / kParticleLanes].v;
+			stream[dead] = stream[source];
+		}
+	}
+
+	for( auto i = newSize; i < mSize; ++i )
+		life[i] = -1.f;
+
+	mSize = newSize;
+}
+
+void ParticleStreams::clear() noexcept
+{
+	float* life = (*this)[ParticleStream::life];
+	for( std::size_t i = 0; i < mSize; ++i )
+		life[i] = -1.f;
+
+	mSize = 0;
+}
+
+float* ParticleStreams::operator[] ( ParticleStream aStream ) noexcept
+{
+	assert( aStream < ParticleStream::count );
+	return mData.empty() ? nullptr : mData[std::size_t(aStream) * mCapacity / kParticleLanes].v;
+}
+float const* ParticleStreams::operator[] ( ParticleStream aStream ) const noexcept
+{
+	assert( aStream < ParticleStream::count );
+	return mData.empty() ? nullptr : mData[std::size_t(aStream) * mCapacity / kParticleLanes].v;
+}
+
+ParticleKernelCounts integrate_and_pack_particles( ParticleStreams& aStreams, std::size_t aBegin, std::size_t aEnd, float aDt, float* aOut, std::uint32_t* aExpired ) noexcept
+{
+	assert( 0 == aBegin % kParticleLanes );
+	assert( aEnd <= aStreams.capacity() );
+
+	float* px = aStreams[ParticleStream::posX];
+	float* py = aStreams[ParticleStream::posY];
+	float* pz = aStreams[ParticleStream::posZ];
+	float const* vx = aStreams[ParticleStream::velX];
+	float const* vy = aStreams[ParticleStream::velY];
+	float const* vz = aStreams[ParticleStream::velZ];
+	float* life = aStreams[ParticleStream::life];
+	float const* maxLife = aStreams[ParticleStream::maxLife];
+
+	float* out = aOut;
+	std::uint32_t* expired = aExpired;
+
+	// (Whole groups of lanes; slots past size() are dead.)
+	auto const size = aStreams.size();
+	auto const end = (aEnd + kParticleLanes - 1) / kParticleLanes * kParticleLanes;
+
+#	if PARTICLE_KERNEL_AVX2_
+	__m256 const dt = _mm256_set1_ps( aDt );
+	__m256 const zero = _mm256_setzero_ps();
+
+	for( std::size_t i = aBegin; i < end; i += 8 )
+	{
+		__m256 l = _mm256_load_ps( life + i );
+		__m256 const alive = _mm256_cmp_ps( l, zero, _CMP_GT_OQ );
+
+		// Dead particles get a zero time step
+		__m256 const step = _mm256_and_ps( dt, alive );
+		__m256 const x = _mm256_add_ps( _mm256_load_ps( px + i ), _mm256_mul_ps( _mm256_load_ps( vx + i ), step ) );
+		__m256 const y = _mm256_add_ps( _mm256_load_ps( py + i ), _mm256_mul_ps( _mm256_load_ps( vy + i ), step ) );
+		__m256 const z = _mm256_add_ps( _mm256_load_ps( pz + i ), _mm256_mul_ps( _mm256_load_ps( vz + i ), step ) );
+		l = _mm256_sub_ps( l, step );
+
+		_mm256_store_ps( px + i, x );
+		_mm256_store_ps( py + i, y );
+		_mm256_store_ps( pz + i, z );
+		_mm256_store_ps( life + i, l );
+
+		int const keep = _mm256_movemask_ps( _mm256_cmp_ps( l, zero, _CMP_GT_OQ ) );
+		__m256 const fade = _mm256_div_ps( l, _mm256_load_ps( maxLife + i ) );
+
+		out = store_packed_4_( out, _mm256_castps256_ps128( x ), _mm256_castps256_ps128( y ), _mm256_castps256_ps128( z ), _mm256_castps256_ps128( fade ), keep );
+		out = store_packed_4_( out, _mm256_extractf128_ps( x, 1 ), _mm256_extractf128_ps( y, 1 ), _mm256_extractf128_ps( z, 1 ), _mm256_extractf128_ps( fade, 1 ), keep >> 4 );
+
+		expired = store_indices_( expired, i, ~keep & valid_lanes_( i, size, 8 ), 8 );
+	}
+#	elif PARTICLE_KERNEL_SSE_
+	__m128 const dt = _mm_set1_ps( aDt );
+	__m128 const zero = _mm_setzero_ps();
+
+	for( std::size_t i = aBegin; i < end; i += 4 )
+	{
+		__m128 l = _mm_load_ps( life + i );
+		__m128 const alive = _mm_cmpgt_ps( l, zero );
+
+		__m128 const step = _mm_and_ps( dt, alive );
+		__m128 const x = _mm_add_ps( _mm_load_ps( px + i ), _mm_mul_ps( _mm_load_ps( vx + i ), step ) );
+		__m128 const y = _mm_add_ps( _mm_load_ps( py + i ), _mm_mul_ps( _mm_load_ps( vy + i ), step ) );
+		__m128 const z = _mm_add_ps( _mm_load_ps( pz + i ), _mm_mul_ps( _mm_load_ps( vz + i ), step ) );
+		l = _mm_sub_ps( l, step );
+
+		_mm_store_ps( px + i, x );
+		_mm_store_ps( py + i, y );
+		_mm_store_ps( pz + i, z );
+		_mm_store_ps( life + i, l );
+
+		int const keep = _mm_movemask_ps( _mm_cmpgt_ps( l, zero ) );
+		out = store_packed_4_( out, x, y, z, _mm_div_ps( l, _mm_load_ps( maxLife + i ) ), keep );
+
+		expired = store_indices_( expired, i, ~keep & valid_lanes_( i, size, 4 ), 4 );
+	}
+#	else
+	for( std::size_t i = aBegin; i < end; ++i )
+	{
+		float const step = life[i] > 0.f ? aDt : 0.f;
+		px[i] += vx[i] * step;
+		py[i] += vy[i] * step;
+		pz[i] += vz[i] * step;
+		life[i] -= step;
+
+		out[0] = px[i];
+		out[1] = py[i];
+		out[2] = pz[i];
+		out[3] = life[i] / maxLife[i];
+		out += life[i] > 0.f ? kPackedParticleFloats : 0;
+
+		*expired = std::uint32_t(i);
+		expired += life[i] <= 0.f && i < size ? 1 : 0;
+	}
+#	endif // ~ AVX2/SSE
+
+	return {
+		std::size_t(out - aOut) / kPackedParticleFloats,
+		std::size_t(expired - aExpired)
+	};
+}
@@ -0,0 +1,107 @@
+#ifndef PARTICLE_KERNELS_HPP_3C8F2A61_D94B_4E07_B1A5_60E7C2D89F14
+#define PARTICLE_KERNELS_HPP_3C8F2A61_D94B_4E07_B1A5_60E7C2D89F14
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+// Particles are processed in groups of this many lanes (one AVX register)
+constexpr std::size_t kParticleLanes = 8;
+
+// Components of a particle, see ParticleStreams
+enum class ParticleStream : std::size_t
+{
+	posX, posY, posZ,
+	velX, velY, velZ,
+	life,    // remaining life (s); dead if <= 0
+	maxLife, // initial life (s)
+
+	count
+};
+
+// Structure-of-arrays particle pool: one float stream per component.
+// Streams are 32-byte aligned, and the capacity is rounded up to a multiple
+// of kParticleLanes, so kernels never need a remainder loop.
+//
+// Live particles are kept packed at the front, in [0, size()). spawn() takes
+// the slots after them, and remove_dead() fills the slots of dead particles
+// with the last live particles (swap-remove). Spawning is therefore O(1), and
+// updates only touch the live particles. Slots past size() are always dead
+// (life -1).
+class ParticleStreams final
+{
+	public:
+		explicit ParticleStreams( std::size_t aCapacity = 0 );
+
+	public:
+		std::size_t capacity() const noexcept;
+		std::size_t size() const noexcept;
+
+		// Append up to aCount particles (fewer if the pool fills up), and
+		// return how many were added. They take the slots starting at the
+		// old size(); the caller must set all of their streams (with
+		// life > 0).
+		std::size_t spawn( std::size_t aCount ) noexcept;
+
+		// Swap-remove the particles at aDead, which must be sorted, below
+		// size() and have life <= 0 (see integrate_and_pack_particles()).
+		// Moves at most aDead.size() particles.
+		void remove_dead( std::span<std::uint32_t const> aDead ) noexcept;
+
+		// Kill all particles
+		void clear() noexcept;
+
+		float* operator[] ( ParticleStream ) noexcept;
+		float const* operator[] ( ParticleStream ) const noexcept;
+
+	private:
+		struct alignas(32) Lanes_
+		{
+			float v[kParticleLanes];
+		};
+
+		std::size_t mCapacity;
+		std::size_t mSize = 0;
+		std::vector<Lanes_> mData; // all streams, back to back
+};
+
+// Float values per particle written by integrate_and_pack_particles()
+constexpr std::size_t kPackedParticleFloats = 4;
+
+struct ParticleKernelCounts
+{
+	std::size_t packed;  // particles written to aOut
+	std::size_t expired; // indices written to aExpired
+};
+
+/* Particle update kernel
+ *
+ * Advances the particles in [aBegin, aEnd) by aDt, and in the same pass
+ * writes the particles that are still alive afterwards to aOut as
+ * (x, y, z, life/maxLife). The indices of the particles below size() that
+ * are dead afterwards are written to aExpired, in ascending order; pass them
+ * to remove_dead() once the kernel is done.
+ *
+ * aBegin must be a multiple of kParticleLanes, and aEnd either a multiple of
+ * kParticleLanes or size(). The range is processed in whole groups of lanes,
+ * so aOut and aExpired must have room for aEnd-aBegin particles and indices
+ * respectively, rounded up to a multiple of kParticleLanes. aOut is written sequentially, so it may
+ * point to write-combined (mapped GPU) memory.
+ *
+ * Disjoint ranges of the same ParticleStreams may be processed concurrently.
+ *
+ * Dead lanes are handled with masks rather than branches. Uses AVX2 when the
+ * compiler targets it, SSE2 otherwise (and plain C++ on non-x86 targets).
+ */
+ParticleKernelCounts integrate_and_pack_particles(
+	ParticleStreams&,
+	std::size_t aBegin,
+	std::size_t aEnd,
+	float aDt,
+	float* aOut,
+	std::uint32_t* aExpired
+) noexcept;
+
+#endif // PARTICLE_KERNELS_HPP_3C8F2A61_D94B_4E07_B1A5_60E7C2D89F14
@@ -0,0 +1,204 @@
+#include "particle_simulation.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "../support/thread_pool.hpp"
+
+#include "counter_rng.hpp"
+
+ParticleSimulation::ParticleSimulation( ParticleSimulationConfig const& aConfig, ThreadPool* aPool )
+	: mConfig( aConfig )
+	, mPool( aPool ? aPool : &default_thread_pool() )
+	, mParticles( aConfig.capacity )
+{
+	mConfig.capacity = mParticles.capacity();
+	mConfig.chunkSize = (std::max<std::size_t>( mConfig.chunkSize, 1 ) + kParticleLanes - 1) / kParticleLanes * kParticleLanes;
+
+	// Everything is allocated up front, so updates don't allocate
+	auto const maxChunks = (mConfig.capacity + mConfig.chunkSize - 1) / mConfig.chunkSize;
+
+	mExpired.resize( mConfig.capacity );
+	mExpiredCounts.resize( maxChunks );
+
+	mPackedFirsts.reserve( maxChunks );
+	mPackedCounts.reserve( maxChunks );
+}
+
+std::size_t ParticleSimulation::capacity() const noexcept
+{
+	return mConfig.capacity;
+}
+std::size_t ParticleSimulation::size() const noexcept
+{
+	return mParticles.size();
+}
+
+std::size_t ParticleSimulation::add_emitter( ParticleEmitter const& aEmitter )
+{
+	mEmitters.emplace_back( EmitterState_{ aEmitter } );
+
+	// Each emitter's new particles form one range per update, and together
+	// the ranges cross each chunk boundary at most once
+	mSpawnBlocks.reserve( mEmitters.size() + mExpiredCounts.size() );
+
+	return mEmitters.size()-1;
+}
+
+std::size_t ParticleSimulation::emitter_count() const noexcept
+{
+	return mEmitters.size();
+}
+ParticleEmitter& ParticleSimulation::emitter( std::size_t aIndex )
+{
+	assert( aIndex < mEmitters.size() );
+	return mEmitters[aIndex].emitter;
+}
+ParticleEmitter const& ParticleSimulation::emitter( std::size_t aIndex ) const
+{
+	assert( aIndex < mEmitters.size() );
+	return mEmitters[aIndex].emitter;
+}
+
+void ParticleSimulation::update( float aDt, float* aOut )
+{
+	spawn_( aDt );
+
+	// Advance and pack the live particles, one chunk per work item
+	auto const size = mParticles.size();
+	auto const chunk = mConfig.chunkSize;
+	auto const chunks = (size + chunk - 1) / chunk;
+
+	mPackedFirsts.resize( chunks );
+	mPackedCounts.resize( chunks );
+
+	mPool->parallel_for( chunks, [&] (std::size_t aChunk) {
+		auto const begin = aChunk * chunk;
+		auto const end = std::min( begin + chunk, size );
+
+		auto const counts = integrate_and_pack_particles( mParticles, begin, end, aDt, aOut + begin * kPackedParticleFloats, mExpired.data() + begin );
+
+		mPackedFirsts[aChunk] = std::int32_t(begin);
+		mPackedCounts[aChunk] = std::int32_t(counts.packed);
+		mExpiredCounts[aChunk] = counts.expired;
+	} );
+
+	// Gather the expired particles' indices (still sorted, since the chunks
+	// are in order) and remove them
+	mPackedTotal = 0;
+
+	std::size_t expired = 0;
+	for( std::size_t i = 0; i < chunks; ++i )
+	{
+		auto const from = mExpired.begin() + std::ptrdiff_t(i * chunk);
+		std::copy( from, from + std::ptrdiff_t(mExpiredCounts[i]), mExpired.begin() + std::ptrdiff_t(expired) );
+		expired += mExpiredCounts[i];
+
+		mPackedTotal += std::size_t(mPackedCounts[i]);
+	}
+
+	mParticles.remove_dead( std::span( mExpired.data(), expired ) );
+}
+
+void ParticleSimulation::clear() noexcept
+{
+	mParticles.clear();
+
+	mPackedFirsts.clear();
+	mPackedCounts.clear();
+	mPackedTotal = 0;
+}
+
+std::span<std::int32_t const> ParticleSimulation::packed_firsts() const noexcept
+{
+	return mPackedFirsts;
+}
+std::span<std::int32_t const> ParticleSimulation::packed_counts() const noexcept
+{
+	return mPackedCounts;
+}
+std::size_t ParticleSimulation::packed_count() const noexcept
+{
+	return mPackedTotal;
+}
+std::size_t ParticleSimulation::max_packed_ranges() const noexcept
+{
+	return mExpiredCounts.size();
+}
+
+void ParticleSimulation::spawn_( float aDt )
+{
+	// Reserve slots for each emitter's new particles (in emitter order, so
+	// that the result is deterministic), in blocks that don't straddle chunks
+	mSpawnBlocks.clear();
+
+	for( std::size_t i = 0; i < mEmitters.size(); ++i )
+	{
+		auto& state = mEmitters[i];
+		if( !state.emitter.active )
+			continue;
+
+		// Spawn at a fixed rate; carry fractions over to the next update
+		state.spawnDebt += state.emitter.spawnPerSecond * aDt;
+		auto const whole = std::floor( state.spawnDebt );
+		state.spawnDebt -= whole;
+
+		auto const wanted = std::size_t(std::min( double(whole), double(mConfig.capacity) ));
+		auto first = mParticles.size();
+		auto count = mParticles.spawn( wanted );
+		auto counter = state.spawned;
+
+		// (Particles that didn't fit still use up their random numbers, so
+		// later particles don't depend on how full the pool was.)
+		state.spawned += wanted;
+
+		while( count > 0 )
+		{
+			auto const chunkEnd = (first / mConfig.chunkSize + 1) * mConfig.chunkSize;
+			auto const n = std::min( count, chunkEnd - first );
+
+			mSpawnBlocks.emplace_back( SpawnBlock_{ std::uint32_t(i), counter, first, n } );
+
+			first += n;
+			counter += n;
+			count -= n;
+		}
+	}
+
+	auto const seed = mConfig.seed;
+	mPool->parallel_for( mSpawnBlocks.size(), [&] (std::size_t aBlock) {
+		auto const& block = mSpawnBlocks[aBlock];
+		auto const& emitter = mEmitters[block.emitter].emitter;
+
+		PhiloxKey const key{ std::uint32_t(seed), std::uint32_t(seed >> 32) };
+
+		float* px = mParticles[ParticleStream::posX];
+		float* py = mParticles[ParticleStream::posY];
+		float* pz = mParticles[ParticleStream::posZ];
+		float* vx = mParticles[ParticleStream::velX];
+		float* vy = mParticles[ParticleStream::velY];
+		float* vz = mParticles[ParticleStream::velZ];
+		float* life = mParticles[ParticleStream::life];
+		float* maxLife = mParticles[ParticleStream::maxLife];
+
+		for( std::size_t j = 0; j < block.count; ++j )
+		{
+			auto const n = block.counter + j;
+			auto const bits = philox4x32( { std::uint32_t(n), std::uint32_t(n >> 32), block.emitter, 0 }, key );
+
+			auto const i = block.first + j;
+
+			// Life between 1.0 and 1.5s; downward velocity with some random
+			// x/z movement
+			life[i] = 1.f + uniform_float( bits[0] ) * 0.5f;
+			maxLife[i] = life[i];
+			px[i] = emitter.position.x;
+			py[i] = emitter.position.y;
+			pz[i] = emitter.position.z;
+			vx[i] = uniform_float( bits[1] ) * 2.f - 1.f;
+			vy[i] = -3.f;
+			vz[i] = uniform_float( bits[2] ) * 2.f - 1.f;
+		}
+	} );
+}
@@ -0,0 +1,125 @@
+#ifndef PARTICLE_SIMULATION_HPP_A94C2E07_5B3D_4F86_8E1A_D27F60C4B935
+#define PARTICLE_SIMULATION_HPP_A94C2E07_5B3D_4F86_8E1A_D27F60C4B935
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+#include "particle_kernels.hpp"
+
+class ThreadPool;
+
+struct ParticleEmitter
+{
+	Vec3f position{ 0.f, 0.f, 0.f };
+
+	// Particles spawned per second of simulated time, while active
+	float spawnPerSecond = 120.f;
+
+	bool active = true;
+};
+
+struct ParticleSimulationConfig
+{
+	// Number of particle slots. Spawning stops while all are in use.
+	std::size_t capacity = 1000;
+
+	// Seed for the particles' random numbers. Simulations with the same
+	// seed, emitters and time steps produce the same particles, independent
+	// of the number of threads.
+	std::uint64_t seed = 0;
+
+	// Particles per parallel work item (rounded up to kParticleLanes)
+	std::size_t chunkSize = 16384;
+};
+
+/* CPU particle simulation
+ *
+ * Each update() spawns particles from the emitters into a ParticleStreams
+ * pool, and then advances and packs the live particles in chunks of
+ * chunkSize, with the chunks spread over a ThreadPool. Chunk i packs its
+ * particles into the output at particle i*chunkSize; the ranges that were
+ * written are listed by packed_firsts() and packed_counts() (e.g., for
+ * glMultiDrawArrays()). Particles that expired are swap-removed afterwards,
+ * which takes time proportional to the number of expired particles only.
+ *
+ * Random numbers come from a counter-based generator (counter_rng.hpp)
+ * keyed by the seed and emitter, and indexed by the number of particles the
+ * emitter has spawned so far. There is no shared generator state, and the
+ * results do not depend on which thread spawns which particle.
+ */
+class ParticleSimulation final
+{
+	public:
+		// Uses default_thread_pool() if aPool is null
+		explicit ParticleSimulation( ParticleSimulationConfig const& = {}, ThreadPool* aPool = nullptr );
+
+	public:
+		std::size_t capacity() const noexcept;
+
+		// Number of live particles
+		std::size_t size() const noexcept;
+
+		// Returns the emitter's index
+		std::size_t add_emitter( ParticleEmitter const& = {} );
+
+		std::size_t emitter_count() const noexcept;
+		ParticleEmitter& emitter( std::size_t );
+		ParticleEmitter const& emitter( std::size_t ) const;
+
+		// Spawn particles from the active emitters, advance all particles by
+		// aDt, and pack the survivors into aOut, which must have room for
+		// kPackedParticleFloats * capacity() floats.
+		void update( float aDt, float* aOut );
+
+		// Kill all particles. (The emitters keep their state.)
+		void clear() noexcept;
+
+		// Ranges of aOut written by the last update(), in particles
+		std::span<std::int32_t const> packed_firsts() const noexcept;
+		std::span<std::int32_t const> packed_counts() const noexcept;
+
+		// Total number of particles written by the last update()
+		std::size_t packed_count() const noexcept;
+
+		// Upper bound for the size of packed_firsts() and packed_counts()
+		std::size_t max_packed_ranges() const noexcept;
+
+	private:
+		struct EmitterState_
+		{
+			ParticleEmitter emitter;
+			std::uint64_t spawned = 0; // counter for the random numbers
+			float spawnDebt = 0.f;     // fractional particles not spawned yet
+		};
+		struct SpawnBlock_
+		{
+			std::uint32_t emitter;
+			std::uint64_t counter;
+			std::size_t first;
+			std::size_t count;
+		};
+
+		void spawn_( float aDt );
+
+		ParticleSimulationConfig mConfig;
+		ThreadPool* mPool;
+
+		ParticleStreams mParticles;
+
+		std::vector<EmitterState_> mEmitters;
+		std::vector<SpawnBlock_> mSpawnBlocks;
+
+		std::vector<std::uint32_t> mExpired;
+		std::vector<std::size_t> mExpiredCounts;
+
+		std::vector<std::int32_t> mPackedFirsts;
+		std::vector<std::int32_t> mPackedCounts;
+		std::size_t mPackedTotal = 0;
+};
+
+#endif // PARTICLE_SIMULATION_HPP_A94C2E07_5B3D_4F86_8E1A_D27F60C4B935
@@ -1,32 +1,37 @@
 #include "particle_system.hpp"
 
-#include <cstdlib> 
-#include <vector>
+#include <span>
+
+#include "render_queue.hpp"
 
 // Constructor
-ParticleSystem::ParticleSystem()
+// Each region of the stream buffer holds the max number of particles
+ParticleSystem::ParticleSystem(ParticleSimulationConfig const& config)
+    : simulation(config)
+    , stream(simulation.capacity() * kFloatsPerParticle * sizeof(float))
 {
-    // Reserving memory before hand so no realtime allocations are made
-    particles.resize(kMaxParticles);
+    static_assert(kFloatsPerParticle == kPackedParticleFloats);
+
+    // (Memory for all particles is allocated up front, so no realtime
+    // allocations are made.)
+    drawFirsts.reserve(simulation.max_packed_ranges());
+    drawCounts.reserve(simulation.max_packed_ranges());
 
     // Generate opengl buffers
     glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
 
     glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    // Allocate max size on gpu
-    // 4 floats per particle for 3d position and life time value
-    glBufferData(GL_ARRAY_BUFFER, kMaxParticles * 4 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
 
     // Position attribute
+    // (Attributes point at the start of the buffer; draws pick the current
+    // region with their first vertex.)
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kFloatsPerParticle * sizeof(float), 0);
 
     // Life attribute
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, kFloatsPerParticle * sizeof(float), (void *)(3 * sizeof(float)));
 
     // Unbind
     glBindVertexArray(0);
@@ -36,8 +41,7 @@ ParticleSystem::ParticleSystem()
 // Destructor
 ParticleSystem::~ParticleSystem()
 {
-    // Get rid of buffers on exit
-    if (vbo) glDeleteBuffers(1, &vbo);
+    // Get rid of buffers on exit (the stream buffer deletes itself)
     if (vao) glDeleteVertexArrays(1, &vao);
 }
 
@@ -48,110 +52,87 @@ void ParticleSystem::init(ShaderProgram* pShader, GLuint pTexture)
     texture = pTexture;
 }
 
-// Update Simulation Loop
-void ParticleSystem::update(float dt, Vec3f emitterPos, bool active)
+// Emitters
+std::size_t ParticleSystem::add_emitter(ParticleEmitter const& emitter)
 {
-    // Spawn 2 per frame if active
-    int spawnCount = active ? 2 : 0;
-
-    for (auto& p : particles)
-    {
-        if (spawnCount <= 0) break;
-
-        // Any dead particles can be re used (pooling)
-        if (p.life < 0.0f)
-        {
-            // Reset life and velocity randomly between 1.0 to 1.5s
-            p.life = 1.0f + ((std::rand() % 100) / 100.0f) * 0.5f;
-            p.maxLife = p.life;
-            p.position = emitterPos;
-            float rx = ((std::rand() % 100) / 50.0f) - 1.0f;
-            float rz = ((std::rand() % 100) / 50.0f) - 1.0f;
-
-			// Set downward velocity with some random x/z movement
-            p.velocity = Vec3f{ rx, -3.0f, rz };
-
-            spawnCount--;
-        }
-    }
-
-    // Update physics for all particles (pos and life values)
-    for (auto& p : particles)
-    {
-        if (p.life > 0.0f)
-        {
-            p.position += p.velocity * dt;
-            p.life -= dt;
-        }
-    }
+    return simulation.add_emitter(emitter);
 }
 
-// Render Loop
-void ParticleSystem::render(Mat44f const& viewProj)
+ParticleEmitter& ParticleSystem::emitter(std::size_t index)
 {
-    if (!shader) return;
-
-    // Static vector and pre reservation stops reallocation
-    static std::vector<float> gpuData;
-    gpuData.clear();
+    return simulation.emitter(index);
+}
 
-    if (gpuData.capacity() < kMaxParticles * 4)
+// Update Simulation Loop
+void ParticleSystem::update(float dt)
+{
+    // Spawn, update physics (pos and life values) and pack the survivors
+    // directly into the next region of the stream buffer. The region is not
+    // in use by the GPU anymore (begin_region() waits for it if necessary),
+    // so this never stalls on the driver.
+    std::span<std::byte> region = stream.begin_region();
+    simulation.update(dt, reinterpret_cast<float*>(region.data()));
+
+    // Each chunk of the simulation packs its particles separately; draw
+    // them with one draw range per chunk
+    auto const firsts = simulation.packed_firsts();
+    auto const counts = simulation.packed_counts();
+
+    GLint const regionFirst = GLint(stream.region_offset() / (kFloatsPerParticle * sizeof(float)));
+
+    drawFirsts.clear();
+    drawCounts.clear();
+    for (std::size_t i = 0; i < counts.size(); ++i)
     {
-        gpuData.reserve(kMaxParticles * 4);
+        drawFirsts.push_back(regionFirst + firsts[i]);
+        drawCounts.push_back(counts[i]);
     }
 
-    int activeCount = 0;
-    for (const auto& p : particles)
-    {
-        if (p.life > 0.0f)
-        {
-            gpuData.push_back(p.position.x);
-            gpuData.push_back(p.position.y);
-            gpuData.push_back(p.position.z);
-            gpuData.push_back(p.life / p.maxLife);
-
-            activeCount++;
-        }
-    }
+    // (The ranges have gaps between them; the written data ends with the
+    // last range.)
+    std::size_t const used = counts.empty() ? 0 : std::size_t(firsts.back() + counts.back());
+    stream.end_region(used * kFloatsPerParticle * sizeof(float));
+}
 
-	// If there is no active particles we get to save resources
-    if (activeCount == 0) return;
+// Kill all particles
+void ParticleSystem::clear()
+{
+    simulation.clear();
 
-	// Additive blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    drawFirsts.clear();
+    drawCounts.clear();
+}
 
-	// Stop depth writing so particles don't occlude each other
-    glDepthMask(GL_FALSE);
+// Render Loop
+void ParticleSystem::submit(RenderQueue& queue, Mat44f const& viewProj, ParticleSpriteSize const& sprite)
+{
+    if (!shader) return;
 
-	// Deeded for resizing points in particle vertex shader
-    glEnable(GL_PROGRAM_POINT_SIZE);
-    glUseProgram(shader->programId());
+	// If there is no active particles we get to save resources
+    if (drawCounts.empty()) return;
 
-	// Upload data to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	// Using sub data instea of buffer data so we don't re allocate memory on gpu
-    glBufferSubData(GL_ARRAY_BUFFER, 0, gpuData.size() * sizeof(float), gpuData.data());
+    GLuint const program = shader->programId();
 
     // View projection matrix
-    glUniformMatrix4fv(0, 1, GL_TRUE, viewProj.v);
+    // (The queue binds the program, so the uniforms are set without it.)
+    glProgramUniformMatrix4fv(program, 0, 1, GL_TRUE, viewProj.v);
 
     // Add the fire colour 
-    glUniform4f(2, 1.0f, 0.4f, 0.2f, 1.0f);
+    glProgramUniform4f(program, 2, 1.0f, 0.4f, 0.2f, 1.0f);
 
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(1, 0);
+    // Sprite size, clamped to the coverage budget
+    glProgramUniform2f(program, 3, sprite.scale, sprite.maxSize);
 
-	// Draw the particles as points
-    glBindVertexArray(vao);
-    glDrawArrays(GL_POINTS, 0, activeCount);
+    // Texture unit
+    glProgramUniform1i(program, 1, 0);
 
-    // Cleanup
-    glBindVertexArray(0);
-    glUseProgram(0);
-    glDisable(GL_PROGRAM_POINT_SIZE);
-    glDepthMask(GL_TRUE);
-    glDisable(GL_BLEND);
+	// Draw the particles as points
+    // (The additive pass blends additively, and stops depth writing so
+    // particles don't occlude each other.)
+    RenderDraw draw;
+    draw.mode = GL_POINTS;
+    draw.multiFirsts = drawFirsts;
+    draw.multiCounts = drawCounts;
+
+    queue.submit({ RenderPass::additive, program, 0, texture, vao }, 0.f, draw);
 }
\ No newline at end of file
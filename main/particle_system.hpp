@@ -7,38 +7,55 @@
 #include "../vmlib/vec3.hpp"
 #include "../vmlib/mat44.hpp"
 #include "../support/program.hpp"
+#include "../support/stream_buffer.hpp"
 
-// Basic particle state
-struct Particle {
-    Vec3f position;
-    Vec3f velocity;
-    float life = -1.0f; // Negative values for dead particles
-    float maxLife = 1.0f;
-};
+#include "particle_simulation.hpp"
+#include "particle_compositor.hpp"
+
+class RenderQueue;
 
 class ParticleSystem {
 public:
-    ParticleSystem();
+    // Capacity, random seed etc. are set at runtime (particle_simulation.hpp)
+    explicit ParticleSystem(ParticleSimulationConfig const& config = {});
     ~ParticleSystem();
 
 	// Shader and texture setup
     void init(ShaderProgram* pShader, GLuint pTexture);
 
-    // Run physics and spawn new particles
-    void update(float dt, Vec3f emitterPos, bool active);
+    // Emitters; add_emitter() returns the new emitter's index
+    std::size_t add_emitter(ParticleEmitter const& emitter = {});
+    ParticleEmitter& emitter(std::size_t index);
+
+    // Run physics and spawn new particles from the active emitters
+    // (This also packs the live particles for drawing, on all threads of the
+    // default thread pool.)
+    void update(float dt);
 
-    // Draw the current group of particles
-    void render(Mat44f const& viewProj);
+    // Kill all particles
+    void clear();
 
-    std::vector<Particle> particles;
+    // Queue drawing the particles packed by the last update (additive pass)
+    // (sprite: point size for the render target, see particle_compositor.hpp)
+    void submit(RenderQueue& queue, Mat44f const& viewProj, ParticleSpriteSize const& sprite);
+
+    // Particle state and simulation
+    ParticleSimulation simulation;
 
 private:
-    // Maximum particle count
-    static constexpr int kMaxParticles = 1000;
+    // 3d position and life time value
+    static constexpr int kFloatsPerParticle = 4;
 
 	// Open GL resources
+    // (Particles are written straight into a persistently mapped, triple
+    // buffered vertex buffer, see stream_buffer.hpp.)
+    StreamBuffer stream;
     GLuint vao = 0;
-    GLuint vbo = 0;
+
+    // Draw ranges of the packed particles (one per simulation chunk)
+    std::vector<GLint> drawFirsts;
+    std::vector<GLsizei> drawCounts;
+
     GLuint texture = 0;
     ShaderProgram* shader = nullptr;
 };
@@ -0,0 +1,280 @@
+#include "render_queue.hpp"
+
+#include <array>
+#include <bit>
+
+#include <cassert>
+
+#include "../support/error.hpp"
+
+#include "material.hpp"
+
+namespace
+{
+	// Key layout (see render_queue.hpp)
+	constexpr unsigned kDepthBits_ = 24;
+	constexpr unsigned kVaoBits_ = 16;
+	constexpr unsigned kMaterialBits_ = 12;
+	constexpr unsigned kProgramBits_ = 8;
+
+	constexpr unsigned kVaoShift_ = kDepthBits_;
+	constexpr unsigned kMaterialShift_ = kVaoShift_ + kVaoBits_;
+	constexpr unsigned kProgramShift_ = kMaterialShift_ + kMaterialBits_;
+	constexpr unsigned kPassShift_ = kProgramShift_ + kProgramBits_;
+
+	static_assert( 60 == kPassShift_ );
+
+	constexpr std::uint64_t field_( std::uint64_t aKey, unsigned aShift, unsigned aBits ) noexcept
+	{
+		return (aKey >> aShift) & ((std::uint64_t(1) << aBits) - 1);
+	}
+
+	// Non-negative floats are ordered like their bit patterns; keep the top
+	// 24 of the 31 bits that are used
+	std::uint64_t depth_bits_( float aDepth ) noexcept
+	{
+		if( !(aDepth > 0.f) ) // (also NaN)
+			return 0;
+		return std::bit_cast<std::uint32_t>( aDepth ) >> 7;
+	}
+
+	template< typename tKey, typename tValue >
+	std::uint32_t intern_( std::unordered_map<tKey, std::uint32_t>& aIds, std::vector<tValue>& aValues, tKey aKey, tValue const& aValue, unsigned aBits, char const* aWhat )
+	{
+		auto const [it, inserted] = aIds.try_emplace( aKey, std::uint32_t(aValues.size()) );
+		if( inserted )
+		{
+			if( aValues.size() == (std::size_t(1) << aBits) )
+			{
+				aIds.erase( it );
+				throw Error( "Render queue: more than {} different {} in one frame", std::size_t(1) << aBits, aWhat );
+			}
+
+			aValues.emplace_back( aValue );
+		}
+
+		return it->second;
+	}
+
+	// LSD radix sort by key, one byte per pass. Stable, so draws with equal
+	// keys stay in submission order. Passes where all keys have the same
+	// byte are skipped (e.g., the upper bytes, with few distinct states).
+	template< typename tItem >
+	void radix_sort_( std::vector<tItem>& aItems, std::vector<tItem>& aScratch )
+	{
+		auto const count = aItems.size();
+		if( count < 2 )
+			return;
+
+		std::array<std::array<std::uint32_t, 256>, 8> histograms{};
+		for( auto const& item : aItems )
+		{
+			for( unsigned byte = 0; byte < 8; ++byte )
+				++histograms[byte][(item.key >> (8*byte)) & 0xff];
+		}
+
+		aScratch.resize( count );
+
+		for( unsigned byte = 0; byte < 8; ++byte )
+		{
+			auto& offsets = histograms[byte];
+			if( count == offsets[(aItems[0].key >> (8*byte)) & 0xff] )
+				continue;
+
+			std::uint32_t sum = 0;
+			for( auto& offset : offsets )
+			{
+				auto const n = offset;
+				offset = sum;
+				sum += n;
+			}
+
+			for( auto const& item : aItems )
+				aScratch[offsets[(item.key >> (8*byte)) & 0xff]++] = item;
+
+			aItems.swap( aScratch );
+		}
+	}
+
+	std::size_t index_size_( GLenum aIndexType ) noexcept
+	{
+		switch( aIndexType )
+		{
+			case GL_UNSIGNED_BYTE: return 1;
+			case GL_UNSIGNED_SHORT: return 2;
+		}
+		return 4;
+	}
+}
+
+void RenderQueue::begin_frame()
+{
+	assert( mItems.empty() );
+
+	mPrograms.clear();
+	mMaterials.clear();
+	mVaos.clear();
+
+	mProgramIds.clear();
+	mMaterialIds.clear();
+	mVaoIds.clear();
+
+	mStats = {};
+}
+
+void RenderQueue::submit( RenderState const& aState, float aDepth, RenderDraw const& aDraw )
+{
+	std::uint64_t const key = (std::uint64_t(aState.pass) << kPassShift_)
+		| (std::uint64_t(program_id_( aState.program )) << kProgramShift_)
+		| (std::uint64_t(material_id_( aState.materials, aState.texture )) << kMaterialShift_)
+		| (std::uint64_t(vao_id_( aState.vao )) << kVaoShift_)
+		| depth_bits_( aDepth );
+
+	mItems.emplace_back( Item_{ key, std::uint32_t(mDraws.size()) } );
+	mDraws.emplace_back( aDraw );
+}
+
+void RenderQueue::execute()
+{
+	if( mItems.empty() )
+		return;
+
+	radix_sort_( mItems, mScratch );
+
+	// Other code may have changed the state since the last execute(), so
+	// the first draw binds everything
+	constexpr auto kUnknown = ~std::uint64_t(0);
+	std::uint64_t pass = kUnknown, program = kUnknown, material = kUnknown, vao = kUnknown;
+
+	for( auto const& item : mItems )
+	{
+		auto const itemPass = field_( item.key, kPassShift_, 4 );
+		if( itemPass != pass )
+		{
+			apply_pass_( RenderPass(itemPass) );
+			pass = itemPass;
+			++mStats.passChanges;
+		}
+
+		auto const itemProgram = field_( item.key, kProgramShift_, kProgramBits_ );
+		if( itemProgram != program )
+		{
+			glUseProgram( mPrograms[itemProgram] );
+			program = itemProgram;
+			++mStats.programBinds;
+		}
+
+		auto const itemMaterial = field_( item.key, kMaterialShift_, kMaterialBits_ );
+		if( itemMaterial != material )
+		{
+			auto const& bind = mMaterials[itemMaterial];
+			if( bind.materials )
+				bind_material_buffer( bind.materials );
+			if( bind.texture )
+			{
+				glActiveTexture( GL_TEXTURE0 );
+				glBindTexture( GL_TEXTURE_2D, bind.texture );
+			}
+
+			material = itemMaterial;
+			++mStats.materialBinds;
+		}
+
+		auto const itemVao = field_( item.key, kVaoShift_, kVaoBits_ );
+		if( itemVao != vao )
+		{
+			glBindVertexArray( mVaos[itemVao] );
+			vao = itemVao;
+			++mStats.vaoBinds;
+		}
+
+		draw_( mDraws[item.draw] );
+	}
+
+	mStats.draws += mItems.size();
+
+	if( RenderPass(pass) != RenderPass::opaque )
+		apply_pass_( RenderPass::opaque );
+
+	glBindVertexArray( 0 );
+	glUseProgram( 0 );
+
+	mItems.clear();
+	mDraws.clear();
+}
+
+std::size_t RenderQueue::size() const noexcept
+{
+	return mItems.size();
+}
+
+RenderQueueStats const& RenderQueue::stats() const noexcept
+{
+	return mStats;
+}
+
+std::uint32_t RenderQueue::program_id_( GLuint aProgram )
+{
+	return intern_( mProgramIds, mPrograms, aProgram, aProgram, kProgramBits_, "programs" );
+}
+std::uint32_t RenderQueue::material_id_( GLuint aMaterials, GLuint aTexture )
+{
+	auto const key = (std::uint64_t(aMaterials) << 32) | aTexture;
+	return intern_( mMaterialIds, mMaterials, key, Material_{ aMaterials, aTexture }, kMaterialBits_, "materials/textures" );
+}
+std::uint32_t RenderQueue::vao_id_( GLuint aVao )
+{
+	return intern_( mVaoIds, mVaos, aVao, aVao, kVaoBits_, "VAOs" );
+}
+
+void RenderQueue::apply_pass_( RenderPass aPass )
+{
+	switch( aPass )
+	{
+		case RenderPass::opaque:
+			glDisable( GL_BLEND );
+			glDepthMask( GL_TRUE );
+			glDisable( GL_PROGRAM_POINT_SIZE );
+			break;
+
+		case RenderPass::additive:
+			glEnable( GL_BLEND );
+			glBlendFunc( GL_SRC_ALPHA, GL_ONE );
+			glDepthMask( GL_FALSE );
+			glEnable( GL_PROGRAM_POINT_SIZE );
+			break;
+	}
+}
+
+void RenderQueue::draw_( RenderDraw const& aDraw )
+{
+	if( aDraw.prepare )
+		aDraw.prepare( aDraw.prepareData );
+
+	if( !aDraw.multiFirsts.empty() )
+	{
+		assert( aDraw.multiFirsts.size() == aDraw.multiCounts.size() );
+		glMultiDrawArrays( aDraw.mode, aDraw.multiFirsts.data(), aDraw.multiCounts.data(), GLsizei(aDraw.multiFirsts.size()) );
+	}
+	else if( aDraw.indirectBuffer )
+	{
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, aDraw.indirectBuffer );
+		glDrawArraysIndirect( aDraw.mode, reinterpret_cast<void const*>(aDraw.indirectOffset) );
+		glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+	}
+	else if( GL_NONE == aDraw.indexType )
+	{
+		if( 1 == aDraw.instanceCount && 0 == aDraw.baseInstance )
+			glDrawArrays( aDraw.mode, GLint(aDraw.first), GLsizei(aDraw.count) );
+		else
+			glDrawArraysInstancedBaseInstance( aDraw.mode, GLint(aDraw.first), GLsizei(aDraw.count), GLsizei(aDraw.instanceCount), aDraw.baseInstance );
+	}
+	else
+	{
+		auto const* const offset = reinterpret_cast<void const*>(aDraw.first * index_size_( aDraw.indexType ));
+		if( 1 == aDraw.instanceCount && 0 == aDraw.baseInstance )
+			glDrawElements( aDraw.mode, GLsizei(aDraw.count), aDraw.indexType, offset );
+		else
+			glDrawElementsInstancedBaseInstance( aDraw.mode, GLsizei(aDraw.count), aDraw.indexType, offset, GLsizei(aDraw.instanceCount), aDraw.baseInstance );
+	}
+}
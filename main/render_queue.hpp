@@ -0,0 +1,159 @@
+#ifndef RENDER_QUEUE_HPP_8D2F4A61_C7B3_4E95_A0D8_5F16E3B92C47
+#define RENDER_QUEUE_HPP_8D2F4A61_C7B3_4E95_A0D8_5F16E3B92C47
+
+#include <glad/glad.h>
+
+#include <span>
+#include <vector>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-function state of a pass. Passes are drawn in this order.
+enum class RenderPass : std::uint8_t
+{
+	opaque,   // depth writes, no blending
+	additive  // no depth writes, additive blending, point size from the
+	          // vertex shader (particles)
+};
+
+// State that a draw needs bound. Either of materials and texture may be zero.
+struct RenderState
+{
+	RenderPass pass = RenderPass::opaque;
+	GLuint program = 0;
+	GLuint materials = 0; // bind_material_buffer()
+	GLuint texture = 0;   // 2D texture, on unit 0
+	GLuint vao = 0;
+};
+
+// A draw call. Pointers must stay valid until RenderQueue::execute().
+struct RenderDraw
+{
+	GLenum mode = GL_TRIANGLES;
+	GLenum indexType = GL_NONE; // GL_NONE for non-indexed draws
+
+	std::uint32_t first = 0;    // first index or vertex
+	std::uint32_t count = 0;    // number of indices or vertices
+	std::uint32_t instanceCount = 1;
+	std::uint32_t baseInstance = 0;
+
+	// Non-indexed only: draw these ranges (glMultiDrawArrays()) instead of
+	// first/count, if not empty
+	std::span<GLint const> multiFirsts;
+	std::span<GLsizei const> multiCounts;
+
+	// Non-indexed only: draw with the command at indirectOffset in this
+	// buffer (glDrawArraysIndirect()) instead of first/count, if not zero
+	GLuint indirectBuffer = 0;
+	std::size_t indirectOffset = 0;
+
+	// Called with the draw's state bound, just before drawing; e.g., for
+	// per-draw uniforms
+	void (*prepare)( void const* ) = nullptr;
+	void const* prepareData = nullptr;
+};
+
+// Number of draws and state changes (since begin_frame())
+struct RenderQueueStats
+{
+	std::size_t draws = 0;
+	std::size_t passChanges = 0;
+	std::size_t programBinds = 0;
+	std::size_t materialBinds = 0;
+	std::size_t vaoBinds = 0;
+
+	std::size_t state_changes() const noexcept
+	{
+		return passChanges + programBinds + materialBinds + vaoBinds;
+	}
+};
+
+/* Sorted render queue
+ *
+ * Draws are submitted with the state they need and a depth, and are only
+ * issued by execute(). Each draw gets a 64-bit key,
+ *
+ *   pass (4 bits) | program (8) | materials/texture (12) | VAO (16) | depth (24)
+ *
+ * where the state fields are small ids handed out per frame, and the draws
+ * are radix-sorted by key. Draws with the same state thus end up next to
+ * each other (front to back within the same state), and execute() only
+ * changes the state that differs from the previous draw. The number of GL
+ * state changes grows with the number of distinct states, not the number
+ * of draws.
+ *
+ * Since programs are bound by execute() only, per-view uniforms should be
+ * set with glProgramUniform*() when submitting, and per-draw uniforms from
+ * RenderDraw::prepare.
+ *
+ * execute() leaves the opaque pass state, and no program or VAO bound.
+ *
+ * Example:
+ *
+ *	queue.begin_frame();
+ *	for( auto const& object : objects )
+ *		queue.submit( { RenderPass::opaque, prog, object.materials, 0, object.vao }, object.distance, object.draw );
+ *	queue.execute();
+ */
+class RenderQueue final
+{
+	public:
+		RenderQueue() = default;
+
+		RenderQueue( RenderQueue const& ) = delete;
+		RenderQueue& operator= (RenderQueue const&) = delete;
+
+	public:
+		// Reset the statistics and the state ids. The queue must be empty.
+		void begin_frame();
+
+		// Queue a draw. aDepth orders draws that share the same state (e.g.,
+		// the distance to the camera; negative values count as zero). Throws
+		// Error if a frame uses more distinct states than the key can hold.
+		void submit( RenderState const&, float aDepth, RenderDraw const& );
+
+		// Sort and issue the queued draws, and clear the queue
+		void execute();
+
+		std::size_t size() const noexcept;
+
+		RenderQueueStats const& stats() const noexcept;
+
+	private:
+		struct Item_
+		{
+			std::uint64_t key;
+			std::uint32_t draw;
+		};
+		struct Material_
+		{
+			GLuint materials;
+			GLuint texture;
+		};
+
+		std::uint32_t program_id_( GLuint );
+		std::uint32_t material_id_( GLuint aMaterials, GLuint aTexture );
+		std::uint32_t vao_id_( GLuint );
+
+		void apply_pass_( RenderPass );
+		void draw_( RenderDraw const& );
+
+		std::vector<Item_> mItems;
+		std::vector<Item_> mScratch;
+		std::vector<RenderDraw> mDraws;
+
+		// GL names of the ids in the keys
+		std::vector<GLuint> mPrograms;
+		std::vector<Material_> mMaterials;
+		std::vector<GLuint> mVaos;
+
+		std::unordered_map<GLuint, std::uint32_t> mProgramIds;
+		std::unordered_map<std::uint64_t, std::uint32_t> mMaterialIds;
+		std::unordered_map<GLuint, std::uint32_t> mVaoIds;
+
+		RenderQueueStats mStats;
+};
+
+#endif // RENDER_QUEUE_HPP_8D2F4A61_C7B3_4E95_A0D8_5F16E3B92C47
@@ -1,27 +1,162 @@
 #include "simple_mesh.hpp"
 
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+namespace
+{
+	GLuint create_packed_vao_( SimpleMeshView const& );
+	GLuint create_index_buffer_( SimpleMeshView const& );
+}
+
 SimpleMeshData concatenate( SimpleMeshData aM, SimpleMeshData const& aN )
 {
+	// Either both meshes are indexed or neither is
+	assert( aM.indices.empty() == aN.indices.empty() );
+	// Packed meshes are quantized relative to their own bounds
+	assert( aM.packed.empty() && aN.packed.empty() );
+	// LOD chains are generated for the final mesh
+	assert( aM.lods.empty() && aN.lods.empty() );
+
+	auto const base = std::uint32_t(aM.positions.size());
+	for( auto const index : aN.indices )
+		aM.indices.push_back( base + index );
+
+	// Merge the material tables, and remap aN's material ids into the
+	// merged table
+	std::vector<std::uint16_t> remap;
+	for( auto const& material : aN.materials )
+	{
+		auto const it = std::find( aM.materials.begin(), aM.materials.end(), material );
+		remap.push_back( std::uint16_t(it - aM.materials.begin()) );
+		if( aM.materials.end() == it )
+			aM.materials.push_back( material );
+	}
+	for( auto const id : aN.materialIds )
+		aM.materialIds.push_back( remap[id] );
+
 	aM.positions.insert( aM.positions.end(), aN.positions.begin(), aN.positions.end() );
-	aM.colors.insert( aM.colors.end(), aN.colors.begin(), aN.colors.end() );
 	aM.normals.insert( aM.normals.end(), aN.normals.begin(), aN.normals.end() );
 	return aM;
 }
 
+void set_material( SimpleMeshData& aMeshData, Material const& aMaterial )
+{
+	aMeshData.materials.assign( 1, aMaterial );
+	aMeshData.materialIds.assign( aMeshData.positions.size(), 0 );
+}
+
+
+SimpleMeshView make_view( SimpleMeshData const& aMeshData )
+{
+	SimpleMeshView view;
+	view.positions = aMeshData.positions;
+	view.normals = aMeshData.normals;
+	view.texcoords = aMeshData.texcoords;
+	view.materialIds = aMeshData.materialIds;
+	view.materials = aMeshData.materials;
+	view.packed = aMeshData.packed;
+	view.dequant = aMeshData.dequant;
+	view.indices = aMeshData.indices;
+	view.lods = aMeshData.lods;
+	return view;
+}
+
+void pack_vertices( SimpleMeshData& aMeshData )
+{
+	// Quantize positions relative to the bounding box, so that the full
+	// 16-bit range covers the mesh.
+	PositionDequant dequant;
+	if (!aMeshData.positions.empty())
+	{
+		Vec3f lo = aMeshData.positions.front(), hi = lo;
+		for (auto const& p : aMeshData.positions)
+		{
+			lo = Vec3f{ std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = Vec3f{ std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+
+		dequant = make_position_dequant(lo, hi);
+	}
+
+	pack_vertices(aMeshData, dequant);
+}
+
+void pack_vertices( SimpleMeshData& aMeshData, PositionDequant const& aDequant )
+{
+	auto const count = aMeshData.positions.size();
+	assert( aMeshData.normals.size() == count && aMeshData.materialIds.size() == count );
+
+	std::vector<PackedVertex> packed(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		auto& out = packed[i];
+
+		auto const q = quantize_position(aMeshData.positions[i], aDequant);
+		std::copy(q.begin(), q.end(), out.position);
+
+		out.material = aMeshData.materialIds[i];
+		out.normal = pack_snorm_2_10_10_10(aMeshData.normals[i]);
+
+		auto const t = aMeshData.texcoords.empty() ? Vec2f{ 0.f, 0.f } : aMeshData.texcoords[i];
+		out.texcoord[0] = float_to_half(t.x);
+		out.texcoord[1] = float_to_half(t.y);
+	}
+
+	aMeshData.packed = std::move(packed);
+	aMeshData.dequant = aDequant;
+
+	aMeshData.positions = {};
+	aMeshData.normals = {};
+	aMeshData.texcoords = {};
+	aMeshData.materialIds = {};
+}
+
+std::size_t vertex_count( SimpleMeshData const& aMeshData )
+{
+	return aMeshData.packed.empty() ? aMeshData.positions.size() : aMeshData.packed.size();
+}
+std::size_t vertex_count( SimpleMeshView const& aMeshData )
+{
+	return aMeshData.packed.empty() ? aMeshData.positions.size() : aMeshData.packed.size();
+}
+
 
 GLuint create_vao( SimpleMeshData const& aMeshData )
 {
+	auto view = make_view(aMeshData);
+
+	// Narrow the indices if they fit into 16 bits
+	std::vector<std::uint16_t> shortIndices;
+	if (!aMeshData.indices.empty() && GL_UNSIGNED_SHORT == index_type(aMeshData))
+	{
+		shortIndices.assign(aMeshData.indices.begin(), aMeshData.indices.end());
+		view.indices = {};
+		view.shortIndices = shortIndices;
+	}
+
+	return create_vao(view);
+}
+
+GLuint create_vao( SimpleMeshView const& aMeshData )
+{
+	if (!aMeshData.packed.empty())
+		return create_packed_vao_(aMeshData);
+
 	// Create position vbo
 	GLuint positionVBO = 0;
 	glGenBuffers(1, &positionVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, positionVBO );
 	glBufferData(GL_ARRAY_BUFFER, aMeshData.positions.size() * sizeof(Vec3f), aMeshData.positions.data(), GL_STATIC_DRAW);
 
-	// Create color vbo
-	GLuint colorVBO = 0;
-	glGenBuffers(1, &colorVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, colorVBO );
-	glBufferData(GL_ARRAY_BUFFER, aMeshData.colors.size() * sizeof(Vec3f), aMeshData.colors.data(), GL_STATIC_DRAW);
+	// Create material id vbo
+	GLuint materialVBO = 0;
+	glGenBuffers(1, &materialVBO );
+	glBindBuffer(GL_ARRAY_BUFFER, materialVBO );
+	glBufferData(GL_ARRAY_BUFFER, aMeshData.materialIds.size_bytes(), aMeshData.materialIds.data(), GL_STATIC_DRAW);
 
 	// Create normal vbo
 	GLuint normalVBO = 0;
@@ -35,12 +170,6 @@ GLuint create_vao( SimpleMeshData const& aMeshData )
 	glBindBuffer(GL_ARRAY_BUFFER, texCoordsVBO);
 	glBufferData(GL_ARRAY_BUFFER, aMeshData.texcoords.size() * sizeof(Vec2f), aMeshData.texcoords.data(), GL_STATIC_DRAW);
 
-	// Create shine value vbo
-	GLuint shineVBO = 0;
-	glGenBuffers(1, &shineVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, shineVBO);
-	glBufferData(GL_ARRAY_BUFFER, aMeshData.shine.size() * sizeof(float), aMeshData.shine.data(), GL_STATIC_DRAW);
-
 	// Create and bind vao 
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -51,9 +180,9 @@ GLuint create_vao( SimpleMeshData const& aMeshData )
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(0);
 
-	// Configure color 
-	glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	// Configure material id (integer attribute)
+	glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_SHORT, 0, 0);
     glEnableVertexAttribArray(1);
 
 	// Configure normals
@@ -69,25 +198,100 @@ GLuint create_vao( SimpleMeshData const& aMeshData )
 		glEnableVertexAttribArray(3);
 	}
 
-	// Configure shine
-	if (!aMeshData.shine.empty())
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, shineVBO);
-		glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(4);
-	}
+	// Create index buffer
+	// The element array binding is part of the VAO state, so this must happen
+	// while the VAO is still bound.
+	GLuint indexBuffer = create_index_buffer_(aMeshData);
 
 	// clean 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-	glDeleteBuffers(1, &colorVBO);
+	glDeleteBuffers(1, &materialVBO);
 	glDeleteBuffers(1, &positionVBO);
 	glDeleteBuffers(1, &normalVBO);
 	glDeleteBuffers(1, &texCoordsVBO);
-	glDeleteBuffers(1, &shineVBO);
+	glDeleteBuffers(1, &indexBuffer);
 
 	// return 	
 	return vao;
 
-}
\ No newline at end of file
+}
+
+GLenum index_type( SimpleMeshData const& aMeshData )
+{
+	// Indices refer to the vertex streams, so the number of vertices bounds
+	// the largest index.
+	if (vertex_count(aMeshData) <= std::size_t(std::numeric_limits<std::uint16_t>::max()) + 1)
+		return GL_UNSIGNED_SHORT;
+
+	return GL_UNSIGNED_INT;
+}
+
+GLenum index_type( SimpleMeshView const& aMeshData )
+{
+	return aMeshData.shortIndices.empty() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+}
+
+std::size_t index_count( SimpleMeshView const& aMeshData )
+{
+	return aMeshData.indices.size() + aMeshData.shortIndices.size();
+}
+
+std::vector<MeshLod> mesh_lods( SimpleMeshView const& aMeshData )
+{
+	if (!aMeshData.lods.empty())
+		return { aMeshData.lods.begin(), aMeshData.lods.end() };
+
+	return { MeshLod{ 0, std::uint32_t(index_count(aMeshData)), 0.f, 0 } };
+}
+
+void draw_lod( MeshLod const& aLod, GLenum aIndexType )
+{
+	std::size_t const indexSize = GL_UNSIGNED_SHORT == aIndexType ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+	auto const* const offset = reinterpret_cast<void const*>(aLod.firstIndex * indexSize);
+	glDrawElements(GL_TRIANGLES, GLsizei(aLod.indexCount), aIndexType, offset);
+}
+
+namespace
+{
+	GLuint create_packed_vao_( SimpleMeshView const& aMeshData )
+	{
+		GLuint vao = 0;
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+
+		GLuint vbo = 0;
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, aMeshData.packed.size_bytes(), aMeshData.packed.data(), GL_STATIC_DRAW);
+
+		PackedVertexLayout::apply(vbo);
+
+		GLuint indexBuffer = create_index_buffer_(aMeshData);
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &indexBuffer);
+
+		return vao;
+	}
+
+	GLuint create_index_buffer_( SimpleMeshView const& aMeshData )
+	{
+		GLuint indexBuffer = 0;
+		if (!aMeshData.indices.empty() || !aMeshData.shortIndices.empty())
+		{
+			glGenBuffers(1, &indexBuffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+			if (!aMeshData.shortIndices.empty())
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, aMeshData.shortIndices.size_bytes(), aMeshData.shortIndices.data(), GL_STATIC_DRAW);
+			else
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, aMeshData.indices.size_bytes(), aMeshData.indices.data(), GL_STATIC_DRAW);
+		}
+		return indexBuffer;
+	}
+}
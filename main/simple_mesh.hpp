@@ -3,23 +3,106 @@
 
 #include <glad/glad.h>
 
+#include <span>
 #include <vector>
 
+#include <cstdint>
+
 #include "../vmlib/vec3.hpp"
 #include "../vmlib/vec2.hpp"
 
+#include "material.hpp"
+#include "mesh_lod.hpp"
+#include "vertex_format.hpp"
+
 struct SimpleMeshData
 {
 	std::vector<Vec3f> positions;
-	std::vector<Vec3f> colors;
 	std::vector<Vec3f> normals;
 	std::vector<Vec2f> texcoords;
-	std::vector<float> shine;
+
+	// Per-vertex index into materials. Upload the table with
+	// create_material_buffer().
+	std::vector<std::uint16_t> materialIds;
+	std::vector<Material> materials;
+
+	// Interleaved, quantized vertices (see vertex_format.hpp). Filled by
+	// pack_vertices(), which clears the separate streams above. If non-empty,
+	// create_vao() uploads these instead of the separate streams.
+	std::vector<PackedVertex> packed;
+	PositionDequant dequant;
+
+	// Optional index buffer. Meshes without indices are drawn with
+	// glDrawArrays(); meshes with indices are drawn with glDrawElements().
+	std::vector<std::uint32_t> indices;
+
+	// Optional LOD chain (see mesh_lod.hpp). Each LOD is a range of indices;
+	// all LODs share the vertices.
+	std::vector<MeshLod> lods;
+};
+
+// Non-owning view of the same streams as SimpleMeshData. This lets
+// create_vao() upload data that lives elsewhere, e.g. in a memory-mapped
+// mesh cache, without copying it into std::vectors first.
+//
+// At most one of indices and shortIndices is non-empty.
+struct SimpleMeshView
+{
+	std::span<Vec3f const> positions;
+	std::span<Vec3f const> normals;
+	std::span<Vec2f const> texcoords;
+
+	std::span<std::uint16_t const> materialIds;
+	std::span<Material const> materials;
+
+	std::span<PackedVertex const> packed;
+	PositionDequant dequant;
+
+	std::span<std::uint32_t const> indices;
+	std::span<std::uint16_t const> shortIndices;
+
+	std::span<MeshLod const> lods;
 };
 
+// Material tables are merged; identical materials are shared.
 SimpleMeshData concatenate( SimpleMeshData, SimpleMeshData const& );
 
+// Use aMaterial for every vertex of the mesh
+void set_material( SimpleMeshData&, Material const& aMaterial );
+
+SimpleMeshView make_view( SimpleMeshData const& );
+
+// Convert the separate vertex streams into PackedVertex-es. Positions are
+// quantized relative to the mesh's bounding box; draw the result with
+// dequant_matrix(aMeshData.dequant) multiplied into the model matrix.
+void pack_vertices( SimpleMeshData& aMeshData );
+
+// As above, but quantize relative to aDequant, whose box must contain the
+// mesh. Meshes that share a dequant have bit-identical quantized positions
+// wherever their (unquantized) positions are equal.
+void pack_vertices( SimpleMeshData& aMeshData, PositionDequant const& aDequant );
+
+std::size_t vertex_count( SimpleMeshData const& );
+std::size_t vertex_count( SimpleMeshView const& );
+
 
 GLuint create_vao( SimpleMeshData const& );
+GLuint create_vao( SimpleMeshView const& );
+
+// Element type used by create_vao() for the mesh's index buffer. Indices are
+// uploaded as 16-bit values if they all fit, and as 32-bit values otherwise.
+GLenum index_type( SimpleMeshData const& );
+GLenum index_type( SimpleMeshView const& );
+
+// Number of indices in the mesh's index buffer (zero for non-indexed meshes)
+std::size_t index_count( SimpleMeshView const& );
+
+// The mesh's LOD chain. Meshes without one get a single LOD that covers the
+// whole index buffer.
+std::vector<MeshLod> mesh_lods( SimpleMeshView const& );
+
+// Draw one LOD of an indexed mesh with glDrawElements(). The mesh's VAO must
+// be bound.
+void draw_lod( MeshLod const&, GLenum aIndexType );
 
 #endif // SIMPLE_MESH_HPP_C6B749D6_C83B_434C_9E58_F05FC27FEFC9
@@ -0,0 +1,286 @@
+#include "terrain_streamer.hpp"
+
+#include <print>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+
+#include "simple_mesh.hpp"
+
+#include "../support/mapped_file.hpp"
+
+namespace
+{
+	// Finished tiles waiting for upload hold on to their file mapping. The
+	// loader stops once this many are waiting, which bounds the system
+	// memory used by tiles in flight.
+	constexpr std::size_t kMaxCompleted_ = 8;
+}
+
+TerrainStreamer::TerrainStreamer( TileSet aTileSet, TerrainStreamerConfig const& aConfig )
+	: mTileSet( std::move(aTileSet) )
+	, mConfig( aConfig )
+	, mSlots( mTileSet.tiles.size() )
+	, mWanted( mTileSet.tiles.size(), false )
+{
+	if( !mTileSet.tiles.empty() )
+	{
+		mBoundsMin = mTileSet.tiles.front().boundsMin;
+		mBoundsMax = mTileSet.tiles.front().boundsMax;
+		for( auto const& info : mTileSet.tiles )
+		{
+			mBoundsMin = Vec3f{ std::min( mBoundsMin.x, info.boundsMin.x ), std::min( mBoundsMin.y, info.boundsMin.y ), std::min( mBoundsMin.z, info.boundsMin.z ) };
+			mBoundsMax = Vec3f{ std::max( mBoundsMax.x, info.boundsMax.x ), std::max( mBoundsMax.y, info.boundsMax.y ), std::max( mBoundsMax.z, info.boundsMax.z ) };
+		}
+	}
+
+	mThread = std::thread( [this] { loader_(); } );
+}
+
+TerrainStreamer::~TerrainStreamer()
+{
+	{
+		std::lock_guard lock( mMutex );
+		mStop = true;
+	}
+	mWake.notify_all();
+	mThread.join();
+
+	for( std::size_t i = 0; i < mSlots.size(); ++i )
+		release_( i );
+}
+
+void TerrainStreamer::update( Vec3f aCameraPos )
+{
+	update_wanted_( aCameraPos );
+	upload_completed_( mConfig.uploadsPerFrame );
+}
+
+void TerrainStreamer::load_now( Vec3f aCameraPos )
+{
+	update_wanted_( aCameraPos );
+	while( mPending > 0 )
+	{
+		{
+			std::unique_lock lock( mMutex );
+			mDone.wait( lock, [this] { return !mCompleted.empty(); } );
+		}
+
+		upload_completed_( kMaxCompleted_ );
+	}
+}
+
+std::vector<TerrainStreamer::Tile const*> TerrainStreamer::resident() const
+{
+	std::vector<Tile const*> ret;
+	for( auto const& slot : mSlots )
+	{
+		if( State_::resident == slot.state )
+			ret.emplace_back( &*slot.tile );
+	}
+	return ret;
+}
+
+std::uint64_t TerrainStreamer::resident_bytes() const noexcept
+{
+	return mResidentBytes;
+}
+Vec3f TerrainStreamer::bounds_min() const noexcept
+{
+	return mBoundsMin;
+}
+Vec3f TerrainStreamer::bounds_max() const noexcept
+{
+	return mBoundsMax;
+}
+
+std::size_t TerrainStreamer::pending_count() const noexcept
+{
+	return mPending;
+}
+
+void TerrainStreamer::update_wanted_( Vec3f aCameraPos )
+{
+	auto const& tiles = mTileSet.tiles;
+
+	// Nearest tiles first
+	std::vector<float> distances( tiles.size() );
+	for( std::size_t i = 0; i < tiles.size(); ++i )
+		distances[i] = distance_to_box( aCameraPos, tiles[i].boundsMin, tiles[i].boundsMax );
+
+	std::vector<std::size_t> order( tiles.size() );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+	std::sort( order.begin(), order.end(), [&] ( std::size_t aA, std::size_t aB ) {
+		return distances[aA] < distances[aB];
+	} );
+
+	// Take tiles for as long as they fit into the budget. Stopping at the
+	// first tile that does not fit (instead of skipping it) keeps the
+	// resident region contiguous around the camera.
+	std::fill( mWanted.begin(), mWanted.end(), false );
+
+	std::uint64_t wantedBytes = 0;
+	for( auto const i : order )
+	{
+		if( distances[i] > mConfig.maxDistance )
+			break;
+		if( State_::failed == mSlots[i].state )
+			continue;
+		if( wantedBytes + tiles[i].residentBytes > mConfig.memoryBudget )
+			break;
+
+		wantedBytes += tiles[i].residentBytes;
+		mWanted[i] = true;
+	}
+
+	// Release tiles that are no longer wanted before anything new is
+	// uploaded, so that the budget holds at all times
+	for( std::size_t i = 0; i < mSlots.size(); ++i )
+	{
+		if( !mWanted[i] && State_::resident == mSlots[i].state )
+			release_( i );
+	}
+
+	// Re-issue the outstanding requests in the new order. Requests that the
+	// loader has already picked up stay queued; if they are no longer wanted,
+	// the result is discarded on arrival.
+	{
+		std::lock_guard lock( mMutex );
+
+		for( auto const i : mRequests )
+		{
+			assert( State_::queued == mSlots[i].state );
+			mSlots[i].state = State_::unloaded;
+			--mPending;
+		}
+		mRequests.clear();
+
+		for( auto const i : order )
+		{
+			if( mWanted[i] && State_::unloaded == mSlots[i].state )
+			{
+				mSlots[i].state = State_::queued;
+				++mPending;
+				mRequests.emplace_back( i );
+			}
+		}
+	}
+	mWake.notify_one();
+}
+
+std::size_t TerrainStreamer::upload_completed_( std::size_t aMaxUploads )
+{
+	std::vector<Completed_> completed;
+	{
+		std::lock_guard lock( mMutex );
+
+		std::size_t const count = std::min( aMaxUploads, mCompleted.size() );
+		completed.assign( std::make_move_iterator( mCompleted.begin() ), std::make_move_iterator( mCompleted.begin() + count ) );
+		mCompleted.erase( mCompleted.begin(), mCompleted.begin() + count );
+	}
+	mWake.notify_one();
+
+	std::size_t uploads = 0;
+	for( auto& done : completed )
+	{
+		auto& slot = mSlots[done.index];
+		assert( State_::queued == slot.state );
+		--mPending;
+
+		if( !done.mesh )
+		{
+			slot.state = State_::failed;
+			continue;
+		}
+
+		// The camera may have moved on while the tile was loading
+		if( !mWanted[done.index] )
+		{
+			slot.state = State_::unloaded;
+			continue;
+		}
+
+		auto const& info = mTileSet.tiles[done.index];
+		auto const& view = done.mesh->view();
+
+		slot.tile = Tile{
+			create_vao( view ),
+			index_type( view ),
+			mesh_lods( view ),
+			view.dequant,
+			info.boundsMin,
+			info.boundsMax
+		};
+		slot.state = State_::resident;
+		mResidentBytes += info.residentBytes;
+		++uploads;
+
+		// The file mapping is released here, at the end of the iteration
+		done.mesh.reset();
+	}
+
+	return uploads;
+}
+
+void TerrainStreamer::release_( std::size_t aIndex )
+{
+	auto& slot = mSlots[aIndex];
+	if( State_::resident != slot.state )
+		return;
+
+	// The buffers were flagged for deletion by create_vao() and go away
+	// together with the VAO
+	glDeleteVertexArrays( 1, &slot.tile->vao );
+
+	slot.tile.reset();
+	slot.state = State_::unloaded;
+	mResidentBytes -= mTileSet.tiles[aIndex].residentBytes;
+}
+
+void TerrainStreamer::loader_()
+{
+	while( true )
+	{
+		std::size_t index;
+		{
+			std::unique_lock lock( mMutex );
+			mWake.wait( lock, [this] {
+				return mStop || (!mRequests.empty() && mCompleted.size() < kMaxCompleted_);
+			} );
+
+			if( mStop )
+				return;
+
+			index = mRequests.front();
+			mRequests.pop_front();
+		}
+
+		// mTileSet is never modified after construction, so no lock is needed
+		auto const path = tile_mesh_path( mTileSet, mTileSet.tiles[index] );
+
+		MeshFileHeader header;
+		auto mesh = open_mesh_file( path.c_str(), &header );
+		if( mesh && kTileMeshFlags != header.flags )
+			mesh.reset();
+
+		if( mesh )
+		{
+			auto const& view = mesh->view();
+			prefault_pages( std::as_bytes( view.packed ) );
+			prefault_pages( std::as_bytes( view.indices ) );
+			prefault_pages( std::as_bytes( view.shortIndices ) );
+		}
+		else
+		{
+			std::print( stderr, "Note: unable to load terrain tile '{}'\n", path );
+		}
+
+		{
+			std::lock_guard lock( mMutex );
+			mCompleted.emplace_back( Completed_{ index, std::move(mesh) } );
+		}
+		mDone.notify_one();
+	}
+}
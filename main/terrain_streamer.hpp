@@ -0,0 +1,137 @@
+#ifndef TERRAIN_STREAMER_HPP_5B92E7D1_0C4A_4F38_9A6E_D31B8C47F025
+#define TERRAIN_STREAMER_HPP_5B92E7D1_0C4A_4F38_9A6E_D31B8C47F025
+
+#include <glad/glad.h>
+
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh_lod.hpp"
+#include "mesh_cache.hpp"
+#include "vertex_format.hpp"
+#include "terrain_tiles.hpp"
+
+#include "../vmlib/vec3.hpp"
+
+struct TerrainStreamerConfig
+{
+	// Upper bound for the vertex and index data of all resident tiles
+	std::uint64_t memoryBudget = 256ull << 20;
+
+	// Tiles further away than this (from the camera to the tile's bounds) are
+	// not loaded. Should match the far plane.
+	float maxDistance = 2000.f;
+
+	// Number of finished tiles that are uploaded per update(). Limits the
+	// time spent on uploads in a single frame.
+	std::size_t uploadsPerFrame = 2;
+};
+
+/* Streams the tiles of a TileSet (see terrain_tiles.hpp) based on the camera
+ * position.
+ *
+ * update() determines the tiles that should be resident: nearest first, up
+ * to maxDistance, for as long as they fit into the memory budget. Tiles that
+ * are no longer wanted are released immediately. Missing tiles are requested
+ * from a background thread, which maps the tile's mesh file and pages it in.
+ * The GL upload itself happens in update(), on the thread that owns the GL
+ * context.
+ *
+ * A tile's file data is released as soon as the tile is uploaded, so only
+ * the tiles in flight occupy system memory.
+ */
+class TerrainStreamer final
+{
+	public:
+		struct Tile
+		{
+			GLuint vao;
+			GLenum indexType;
+			std::vector<MeshLod> lods;
+			PositionDequant dequant;
+
+			Vec3f boundsMin;
+			Vec3f boundsMax;
+		};
+
+	public:
+		explicit TerrainStreamer( TileSet, TerrainStreamerConfig const& = {} );
+		~TerrainStreamer();
+
+		TerrainStreamer( TerrainStreamer const& ) = delete;
+		TerrainStreamer& operator= (TerrainStreamer const&) = delete;
+
+	public:
+		// Call once per frame, with the GL context current.
+		void update( Vec3f aCameraPos );
+
+		// Load all tiles wanted at aCameraPos and wait for them. Intended for
+		// start-up, so that the first frame is not missing any terrain.
+		void load_now( Vec3f aCameraPos );
+
+		// Resident tiles, in no particular order. Pointers are valid until the
+		// next update().
+		std::vector<Tile const*> resident() const;
+
+		std::uint64_t resident_bytes() const noexcept;
+		std::size_t pending_count() const noexcept;
+
+		// Bounds of the whole terrain, over all tiles (resident or not)
+		Vec3f bounds_min() const noexcept;
+		Vec3f bounds_max() const noexcept;
+
+	private:
+		enum class State_ : std::uint8_t
+		{
+			unloaded,
+			queued,
+			resident,
+			failed
+		};
+
+		struct Slot_
+		{
+			State_ state = State_::unloaded;
+			std::optional<Tile> tile;
+		};
+
+		struct Completed_
+		{
+			std::size_t index;
+			std::optional<LoadedMesh> mesh;
+		};
+
+		void update_wanted_( Vec3f aCameraPos );
+		std::size_t upload_completed_( std::size_t aMaxUploads );
+		void release_( std::size_t aIndex );
+
+		void loader_();
+
+		TileSet mTileSet;
+		TerrainStreamerConfig mConfig;
+
+		Vec3f mBoundsMin{};
+		Vec3f mBoundsMax{};
+
+		std::vector<Slot_> mSlots;
+		std::vector<bool> mWanted;
+		std::uint64_t mResidentBytes = 0;
+		std::size_t mPending = 0;
+
+		std::thread mThread;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mDone;
+		std::deque<std::size_t> mRequests;   // guarded by mMutex
+		std::vector<Completed_> mCompleted;  // guarded by mMutex
+		bool mStop = false;                  // guarded by mMutex
+};
+
+#endif // TERRAIN_STREAMER_HPP_5B92E7D1_0C4A_4F38_9A6E_D31B8C47F025
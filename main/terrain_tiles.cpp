@@ -0,0 +1,321 @@
+#include "terrain_tiles.hpp"
+
+#include <array>
+#include <print>
+#include <format>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#include "loadobj.hpp"
+
+#include "../support/error.hpp"
+#include "../support/thread_pool.hpp"
+
+namespace
+{
+	constexpr char kTileSetMagic_[8] = { 'T', 'I', 'L', 'E', 'S', 'E', 'T', '\0' };
+	constexpr char const* kTileSetIndexName_ = "index.bin";
+
+	std::string tile_file_name_( std::uint32_t aX, std::uint32_t aZ )
+	{
+		return std::format( "tile_{}_{}.mesh", aX, aZ );
+	}
+
+	bool write_index_( std::filesystem::path const& aPath, TileSetHeader const& aHeader, std::vector<TileInfo> const& aTiles )
+	{
+		auto const tempPath = aPath.string() + ".tmp";
+
+		std::FILE* fout = std::fopen( tempPath.c_str(), "wb" );
+		if( !fout )
+			return false;
+
+		bool ok = 1 == std::fwrite( &aHeader, sizeof(aHeader), 1, fout );
+		if( !aTiles.empty() )
+			ok = ok && aTiles.size() == std::fwrite( aTiles.data(), sizeof(TileInfo), aTiles.size(), fout );
+		ok = 0 == std::fclose( fout ) && ok;
+
+		std::error_code ec;
+		if( ok )
+			std::filesystem::rename( tempPath, aPath, ec );
+
+		if( !ok || ec )
+		{
+			std::filesystem::remove( tempPath, ec );
+			return false;
+		}
+
+		return true;
+	}
+
+	// Vertices that are shared by several tiles must dequantize to the
+	// same position in each of them (i.e., have the same quantized position
+	// and dequantization), so that the tiles are watertight.
+	bool check_tile_borders_( SimpleMeshData const& aMesh, std::vector<std::vector<std::uint32_t>> const& aCellTriangles, std::vector<std::vector<std::array<std::int16_t,3>>> const& aTilePositions, std::vector<PositionDequant> const& aTileDequants )
+	{
+		constexpr auto kNone = std::numeric_limits<std::uint32_t>::max();
+
+		auto const same_ = [] ( Vec3f aA, Vec3f aB ) {
+			return aA.x == aB.x && aA.y == aB.y && aA.z == aB.z;
+		};
+
+		// First tile that uses each vertex
+		std::vector<std::uint32_t> firstCell( aMesh.positions.size(), kNone );
+		for( std::size_t cell = 0; cell < aCellTriangles.size(); ++cell )
+		{
+			for( auto const t : aCellTriangles[cell] )
+			{
+				for( std::size_t k = 0; k < 3; ++k )
+				{
+					auto const v = aMesh.indices[t*3+k];
+					if( kNone == firstCell[v] )
+						firstCell[v] = std::uint32_t(cell);
+
+					if( cell == firstCell[v] )
+						continue;
+
+					auto const& ref = aTileDequants[firstCell[v]];
+					auto const& dequant = aTileDequants[cell];
+					if( !same_( ref.offset, dequant.offset ) || !same_( ref.scale, dequant.scale ) )
+						return false;
+
+					auto const q = quantize_position( aMesh.positions[v], dequant );
+					for( auto const c : { firstCell[v], std::uint32_t(cell) } )
+					{
+						if( !std::binary_search( aTilePositions[c].begin(), aTilePositions[c].end(), q ) )
+							return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+std::string tile_mesh_path( TileSet const& aTileSet, TileInfo const& aTile )
+{
+	return (std::filesystem::path( aTileSet.directory ) / tile_file_name_( aTile.x, aTile.z )).string();
+}
+
+std::optional<TileSet> open_tile_set( char const* aDirectory )
+{
+	auto const indexPath = std::filesystem::path( aDirectory ) / kTileSetIndexName_;
+
+	std::error_code ec;
+	if( !std::filesystem::exists( indexPath, ec ) )
+		return {};
+
+	std::FILE* fin = std::fopen( indexPath.string().c_str(), "rb" );
+	if( !fin )
+		return {};
+
+	TileSet ret;
+	ret.directory = aDirectory;
+
+	bool ok = 1 == std::fread( &ret.header, sizeof(TileSetHeader), 1, fin )
+		&& 0 == std::memcmp( ret.header.magic, kTileSetMagic_, sizeof(kTileSetMagic_) )
+		&& kTileSetVersion == ret.header.version
+		&& ret.header.tileCount <= std::uint64_t(ret.header.tilesX) * ret.header.tilesZ;
+
+	if( ok )
+	{
+		ret.tiles.resize( ret.header.tileCount );
+		if( !ret.tiles.empty() )
+			ok = ret.tiles.size() == std::fread( ret.tiles.data(), sizeof(TileInfo), ret.tiles.size(), fin );
+	}
+
+	std::fclose( fin );
+
+	if( !ok )
+		return {};
+
+	return ret;
+}
+
+bool write_tile_set( char const* aDirectory, std::string_view aSourcePath, AssetSourceKey const& aKey, SimpleMeshData const& aMesh, std::uint32_t aTilesPerSide )
+{
+	assert( aMesh.packed.empty() && !aMesh.indices.empty() );
+	assert( aTilesPerSide > 0 );
+
+	namespace fs = std::filesystem;
+	fs::path const directory( aDirectory );
+
+	// Start from an empty directory, so that no tiles from an earlier grid
+	// remain
+	std::error_code ec;
+	fs::remove_all( directory, ec );
+	fs::create_directories( directory, ec );
+	if( ec )
+	{
+		std::print( stderr, "Note: unable to create tile set directory '{}'\n", directory.string() );
+		return false;
+	}
+
+	// Assign triangles to tiles by their centroid
+	Vec3f lo = aMesh.positions.front(), hi = lo;
+	for( auto const& p : aMesh.positions )
+	{
+		lo = Vec3f{ std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) };
+		hi = Vec3f{ std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) };
+	}
+
+	auto const cell_ = [&] ( float aValue, float aMin, float aMax ) {
+		float const extent = aMax - aMin;
+		if( extent <= 0.f )
+			return 0u;
+		auto const cell = std::uint32_t( std::max( 0.f, (aValue - aMin) / extent * float(aTilesPerSide) ) );
+		return std::min( cell, aTilesPerSide-1 );
+	};
+
+	std::size_t const cellCount = std::size_t(aTilesPerSide) * aTilesPerSide;
+	std::vector<std::vector<std::uint32_t>> cellTriangles( cellCount );
+	for( std::size_t i = 0; i < aMesh.indices.size(); i += 3 )
+	{
+		Vec3f const c = (1.f/3.f) * (aMesh.positions[aMesh.indices[i]] + aMesh.positions[aMesh.indices[i+1]] + aMesh.positions[aMesh.indices[i+2]]);
+		auto const x = cell_( c.x, lo.x, hi.x );
+		auto const z = cell_( c.z, lo.z, hi.z );
+		cellTriangles[z * aTilesPerSide + x].push_back( std::uint32_t(i / 3) );
+	}
+
+	// All tiles are quantized relative to the bounds of the whole terrain.
+	// With per-tile bounds, a vertex on the border between two tiles would
+	// be quantized (and dequantized) differently in each, opening cracks.
+	auto const dequant = make_position_dequant( lo, hi );
+
+	// Build and write the tiles. Tiles are independent, so this runs in
+	// parallel.
+	bool const hasTexcoords = !aMesh.texcoords.empty();
+	std::vector<std::optional<TileInfo>> infos( cellCount );
+	std::vector<std::vector<std::array<std::int16_t,3>>> tilePositions( cellCount ); // sorted
+	std::vector<PositionDequant> tileDequants( cellCount );
+
+	default_thread_pool().parallel_for( cellCount, [&] ( std::size_t aCell ) {
+		auto const& triangles = cellTriangles[aCell];
+		if( triangles.empty() )
+			return;
+
+		// Extract the tile's vertices
+		SimpleMeshData tile;
+		tile.materials = aMesh.materials;
+
+		std::unordered_map<std::uint32_t, std::uint32_t> local;
+		local.reserve( triangles.size() );
+		for( auto const t : triangles )
+		{
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const v = aMesh.indices[t*3+k];
+				auto const [it, inserted] = local.try_emplace( v, std::uint32_t(tile.positions.size()) );
+				if( inserted )
+				{
+					tile.positions.push_back( aMesh.positions[v] );
+					tile.normals.push_back( aMesh.normals[v] );
+					tile.materialIds.push_back( aMesh.materialIds[v] );
+					if( hasTexcoords )
+						tile.texcoords.push_back( aMesh.texcoords[v] );
+				}
+				tile.indices.push_back( it->second );
+			}
+		}
+
+		TileInfo info{};
+		info.boundsMin = info.boundsMax = tile.positions.front();
+		for( auto const& p : tile.positions )
+		{
+			info.boundsMin = Vec3f{ std::min( info.boundsMin.x, p.x ), std::min( info.boundsMin.y, p.y ), std::min( info.boundsMin.z, p.z ) };
+			info.boundsMax = Vec3f{ std::max( info.boundsMax.x, p.x ), std::max( info.boundsMax.y, p.y ), std::max( info.boundsMax.z, p.z ) };
+		}
+		info.x = std::uint32_t(aCell % aTilesPerSide);
+		info.z = std::uint32_t(aCell / aTilesPerSide);
+
+		process_mesh( tile, kTileMeshFlags & ~kMeshFlagPacked );
+		pack_vertices( tile, dequant );
+
+		auto& positions = tilePositions[aCell];
+		for( auto const& v : tile.packed )
+			positions.push_back( { v.position[0], v.position[1], v.position[2] } );
+		std::sort( positions.begin(), positions.end() );
+		tileDequants[aCell] = tile.dequant;
+
+		std::size_t const indexSize = GL_UNSIGNED_SHORT == index_type( tile ) ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+		info.residentBytes = tile.packed.size() * sizeof(PackedVertex) + tile.indices.size() * indexSize;
+
+		auto const path = (directory / tile_file_name_( info.x, info.z )).string();
+		if( write_mesh_file( path.c_str(), aSourcePath, aKey, kTileMeshFlags, tile ) )
+			infos[aCell] = info;
+	} );
+
+	std::vector<TileInfo> tiles;
+	for( std::size_t i = 0; i < cellCount; ++i )
+	{
+		if( cellTriangles[i].empty() )
+			continue;
+		if( !infos[i] )
+			return false; // write_mesh_file() already printed a note
+
+		tiles.push_back( *infos[i] );
+	}
+
+	if( !check_tile_borders_( aMesh, cellTriangles, tilePositions, tileDequants ) )
+	{
+		std::print( stderr, "Note: vertices on the tile borders of '{}' do not match\n", aSourcePath );
+		return false;
+	}
+
+	// Write the index last: a tile set without an index is never used
+	TileSetHeader header{};
+	std::memcpy( header.magic, kTileSetMagic_, sizeof(kTileSetMagic_) );
+	header.version = kTileSetVersion;
+	header.meshFlags = kTileMeshFlags;
+	header.sourceSize = aKey.size;
+	header.sourceModTime = aKey.modTime;
+	header.tilesX = aTilesPerSide;
+	header.tilesZ = aTilesPerSide;
+	header.tileCount = std::uint32_t(tiles.size());
+
+	if( !write_index_( directory / kTileSetIndexName_, header, tiles ) )
+	{
+		std::print( stderr, "Note: unable to write tile set index in '{}'\n", directory.string() );
+		return false;
+	}
+
+	return true;
+}
+
+TileSet load_terrain_tiles( char const* aObjPath, std::uint32_t aTilesPerSide )
+{
+	// Baked tile sets are used as-is
+	auto const bakedDirectory = baked_asset_path( aObjPath, kBakedTileSetExtension );
+	if( auto baked = open_tile_set( bakedDirectory.c_str() ); baked && kTileMeshFlags == baked->header.meshFlags )
+		return std::move(*baked);
+
+	auto const key = asset_source_key( aObjPath );
+	if( !key )
+		throw Error( "Unable to query terrain '{}'", aObjPath );
+
+	auto const cacheDirectory = std::string(aObjPath) + kBakedTileSetExtension;
+	if( auto cached = open_tile_set( cacheDirectory.c_str() ) )
+	{
+		auto const& header = cached->header;
+		if( kTileMeshFlags == header.meshFlags && aTilesPerSide == header.tilesX && aTilesPerSide == header.tilesZ
+			&& *key == AssetSourceKey{ header.sourceSize, header.sourceModTime } )
+		{
+			return std::move(*cached);
+		}
+	}
+
+	auto const mesh = load_wavefront_obj( aObjPath, true );
+	if( !write_tile_set( cacheDirectory.c_str(), aObjPath, *key, mesh, aTilesPerSide ) )
+		throw Error( "Unable to create terrain tiles for '{}'", aObjPath );
+
+	auto ret = open_tile_set( cacheDirectory.c_str() );
+	if( !ret )
+		throw Error( "Unable to open terrain tiles '{}'", cacheDirectory );
+
+	return std::move(*ret);
+}
@@ -0,0 +1,91 @@
+#ifndef TERRAIN_TILES_HPP_C84E1F3B_7A92_4D06_B5E3_19F6D0A2C847
+#define TERRAIN_TILES_HPP_C84E1F3B_7A92_4D06_B5E3_19F6D0A2C847
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include <cstdint>
+
+#include "mesh_cache.hpp"
+#include "simple_mesh.hpp"
+#include "baked_assets.hpp"
+
+#include "../vmlib/vec3.hpp"
+
+/* Terrain tile sets
+ *
+ * Large terrains are split into a grid of tiles (in the XZ plane), so that
+ * only the tiles near the camera need to be in memory (see
+ * terrain_streamer.hpp). A tile set is a directory containing
+ *
+ *  - "index.bin": TileSetHeader followed by tileCount x TileInfo
+ *  - one mesh file (see mesh_cache.hpp) per non-empty tile, named
+ *    "tile_<x>_<z>.mesh", processed with kTileMeshFlags
+ *
+ * Each triangle is assigned to the tile that contains its centroid. Tiles
+ * are simplified independently, but vertices on a tile's border are never
+ * moved (see mesh_simplify.hpp), so neighbouring tiles stay watertight at
+ * any combination of LODs. For the same reason, all tiles are quantized
+ * relative to the bounds of the whole terrain (one PositionDequant), so a
+ * vertex on a border has the same packed position in every tile.
+ *
+ * As with single meshes, the asset-baker writes tile sets to
+ * "<dir>/baked/<name>.tiles"; otherwise they are cached in "<source>.tiles".
+ */
+constexpr std::uint32_t kTileSetVersion = 2;
+constexpr std::uint32_t kTerrainTilesPerSide = 8;
+constexpr char const* kBakedTileSetExtension = ".tiles";
+
+constexpr std::uint32_t kTileMeshFlags = kMeshFlagWeld | kMeshFlagOptimize | kMeshFlagLods | kMeshFlagPacked;
+
+struct TileSetHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t meshFlags;
+
+	std::uint64_t sourceSize;
+	std::int64_t sourceModTime;
+
+	std::uint32_t tilesX;
+	std::uint32_t tilesZ;
+	std::uint32_t tileCount; // non-empty tiles only
+	std::uint32_t reserved;
+};
+
+struct TileInfo
+{
+	Vec3f boundsMin;
+	Vec3f boundsMax;
+
+	std::uint32_t x;
+	std::uint32_t z;
+
+	std::uint64_t residentBytes; // vertex + index data once uploaded
+};
+
+struct TileSet
+{
+	std::string directory;
+	TileSetHeader header;
+	std::vector<TileInfo> tiles;
+};
+
+std::string tile_mesh_path( TileSet const&, TileInfo const& );
+
+// Returns an empty optional if the directory does not contain a valid tile
+// set of the current version.
+std::optional<TileSet> open_tile_set( char const* aDirectory );
+
+// Split aMesh (welded and indexed, not packed) into aTilesPerSide x
+// aTilesPerSide tiles and write them to aDirectory. Returns false (after
+// printing a note) if the tile set cannot be written.
+bool write_tile_set( char const* aDirectory, std::string_view aSourcePath, AssetSourceKey const&, SimpleMeshData const& aMesh, std::uint32_t aTilesPerSide );
+
+// Tile set for an OBJ file: the baked tile set, if present; otherwise the
+// cached tile set, if it is up to date; otherwise parses the OBJ and writes
+// the cache. Throws Error if no tile set can be produced.
+TileSet load_terrain_tiles( char const* aObjPath, std::uint32_t aTilesPerSide = kTerrainTilesPerSide );
+
+#endif // TERRAIN_TILES_HPP_C84E1F3B_7A92_4D06_B5E3_19F6D0A2C847
@@ -1,29 +1,300 @@
 #include "texture.hpp"
 
-GLuint load_texture_2d(char const* aPath)
+#include <bit>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <print>
+#include <numbers>
+#include <utility>
+#include <algorithm>
+
+#include <cstring>
+
+#include "baked_assets.hpp"
+#include "texture_cache.hpp"
+
+#include "../support/mapped_file.hpp"
+#include "../support/thread_pool.hpp"
+
+// The AVX2 kernels are used when the compiler targets AVX2 (e.g., with
+// -march=native); otherwise the scalar ones are.
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#	include <immintrin.h>
+#	define MIP_AVX2_ 1
+#else
+#	define MIP_AVX2_ 0
+#endif
+
+namespace
 {
-	assert(aPath);
-	stbi_set_flip_vertically_on_load(true);
-	int w, h, channels;
+	float srgb_to_linear_( float aValue ) noexcept
+	{
+		if (aValue <= 0.04045f)
+			return aValue / 12.92f;
+		return std::pow((aValue + 0.055f) / 1.055f, 2.4f);
+	}
 
-	unsigned char* data = stbi_load(aPath, &w, &h, &channels, 4);
+	// Mip generation
+	//
+	// Levels are produced from the previous level with a separable 2:1
+	// filter. Color is converted to linear through a table, filtered in float
+	// and converted back to sRGB with correct rounding, again through tables
+	// (see MipTables_). Alpha is filtered as-is.
+	//
+	// Every product-sum is evaluated with fused multiply-adds in a fixed
+	// order, and the sRGB conversions are table-driven, so the AVX2 and the
+	// scalar kernels produce identical results. Output rows are split into
+	// bands that are processed in parallel; a band's result does not depend
+	// on how bands are scheduled.
+	constexpr std::uint32_t kMipBandRows_ = 16;  // output rows per band
+	constexpr std::size_t kMaxMipTaps_ = 8;
+	constexpr std::size_t kMipPad_ = kMaxMipTaps_ / 2;  // clamped texels left/right of a row
 
-	if (!data)
+	// Linear values from 2^-13 to just below 1.0 are bucketed by their
+	// exponent and top 7 mantissa bits. A bucket spans less than one sRGB
+	// code, so the code is either the bucket's lowest code or the next one.
+	// (Everything below 2^-13 rounds to code 0.)
+	constexpr std::uint32_t kLinearBucketBase_ = (127u - 13u) << 23;
+	constexpr std::uint32_t kLinearBucketShift_ = 23 - 7;
+	constexpr std::size_t kLinearBucketCount_ = 13 << 7;
+	constexpr float kLinearMin_ = 0x1p-13f;
+	constexpr float kLinearMax_ = 0x1.fffffep-1f;
+
+	struct MipTables_
 	{
-		throw Error("Unable to load image '{}'\n", aPath);
+		alignas(32) float toLinear[256];
+		alignas(32) float roundUp[256];  // linear value halfway to the next code
+		alignas(32) std::int32_t bucketCode[kLinearBucketCount_];
+	};
+
+	struct MipTaps_
+	{
+		std::size_t count;
+		std::array<float, kMaxMipTaps_> weights;  // source offsets 1-count/2 ... count/2
+	};
+
+	MipTables_ const& mip_tables_()
+	{
+		static MipTables_ const tables = [] {
+			MipTables_ ret{};
+			for (std::size_t i = 0; i < 256; ++i)
+			{
+				ret.toLinear[i] = srgb_to_linear_(float(i) / 255.f);
+				ret.roundUp[i] = i < 255 ? srgb_to_linear_((float(i) + 0.5f) / 255.f) : std::numeric_limits<float>::infinity();
+			}
+
+			std::int32_t code = 0;
+			for (std::size_t i = 0; i < kLinearBucketCount_; ++i)
+			{
+				float const lowest = std::bit_cast<float>(kLinearBucketBase_ + std::uint32_t(i << kLinearBucketShift_));
+				while (lowest >= ret.roundUp[code])
+					++code;
+				ret.bucketCode[i] = code;
+			}
+			return ret;
+		}();
+		return tables;
 	}
 
-	GLuint texId = 0;
-	glGenTextures(1, &texId);
-	glBindTexture(GL_TEXTURE_2D, texId);
+	MipTaps_ mip_filter_taps_(MipFilter aFilter)
+	{
+		if (MipFilter::box == aFilter)
+			return { 2, { 0.5f, 0.5f } };
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8_ALPHA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		// Kaiser-windowed sinc, cut off at the new Nyquist frequency. Taps are
+		// at distances 0.5, 1.5, 2.5 and 3.5 source texels from the center
+		// of the output texel.
+		constexpr double kAlpha = 4.0;
+		constexpr double kRadius = 4.0;
+		constexpr double kPi = std::numbers::pi;
 
-	stbi_image_free(data);
+		auto const bessel_i0_ = [] (double aX) {
+			double sum = 1.0, term = 1.0;
+			for (int k = 1; k < 32; ++k)
+			{
+				term *= (aX / (2.0*k)) * (aX / (2.0*k));
+				sum += term;
+			}
+			return sum;
+		};
+
+		double weights[kMaxMipTaps_];
+		double total = 0.0;
+		for (std::size_t i = 0; i < kMaxMipTaps_; ++i)
+		{
+			double const d = double(i) - 3.5;
+			double const x = d / 2.0;
+			double const sinc = std::sin(kPi * x) / (kPi * x);
+			double const r = d / kRadius;
+			double const window = bessel_i0_(kAlpha * std::sqrt(1.0 - r*r)) / bessel_i0_(kAlpha);
+			weights[i] = sinc * window;
+			total += weights[i];
+		}
+
+		MipTaps_ ret{ kMaxMipTaps_, {} };
+		for (std::size_t i = 0; i < kMaxMipTaps_; ++i)
+			ret.weights[i] = float(weights[i] / total);
+		return ret;
+	}
+
+	std::uint8_t linear_to_srgb8_(float aValue, MipTables_ const& aTables) noexcept
+	{
+		float const v = std::min(std::max(aValue, kLinearMin_), kLinearMax_);
+		auto const bucket = (std::bit_cast<std::uint32_t>(v) - kLinearBucketBase_) >> kLinearBucketShift_;
+		auto const code = aTables.bucketCode[bucket];
+		return std::uint8_t(code + (v >= aTables.roundUp[code] ? 1 : 0));
+	}
+	std::uint8_t to_alpha8_(float aValue) noexcept
+	{
+		return std::uint8_t(std::min(std::max(aValue, 0.f), 255.f) + 0.5f);
+	}
+
+	// Convert aCount texels to linear RGB + raw alpha
+	void to_linear_row_(std::uint8_t const* aSrc, float* aDst, std::size_t aCount, MipTables_ const& aTables)
+	{
+		std::size_t i = 0;
+#		if MIP_AVX2_
+		__m256i const toLinearMask = _mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0);
+		for (; i + 2 <= aCount; i += 2)
+		{
+			__m256i const texels = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(aSrc + 4*i)));
+			__m256 const raw = _mm256_cvtepi32_ps(texels);
+			__m256 const linear = _mm256_mask_i32gather_ps(raw, aTables.toLinear, texels, _mm256_castsi256_ps(toLinearMask), 4);
+			_mm256_storeu_ps(aDst + 4*i, linear);
+		}
+#		endif // ~ MIP_AVX2_
+
+		for (; i < aCount; ++i)
+		{
+			for (std::size_t c = 0; c < 3; ++c)
+				aDst[4*i+c] = aTables.toLinear[aSrc[4*i+c]];
+			aDst[4*i+3] = float(aSrc[4*i+3]);
+		}
+	}
+
+	// aDst[i] = sum_k aTaps[k] * aRows[k][i]
+	void filter_vertical_(float const* const* aRows, MipTaps_ const& aTaps, float* aDst, std::size_t aCount)
+	{
+		std::size_t i = 0;
+#		if MIP_AVX2_
+		for (; i + 8 <= aCount; i += 8)
+		{
+			__m256 acc = _mm256_mul_ps(_mm256_set1_ps(aTaps.weights[0]), _mm256_loadu_ps(aRows[0] + i));
+			for (std::size_t k = 1; k < aTaps.count; ++k)
+				acc = _mm256_fmadd_ps(_mm256_set1_ps(aTaps.weights[k]), _mm256_loadu_ps(aRows[k] + i), acc);
+			_mm256_storeu_ps(aDst + i, acc);
+		}
+#		endif // ~ MIP_AVX2_
+
+		for (; i < aCount; ++i)
+		{
+			float acc = aTaps.weights[0] * aRows[0][i];
+			for (std::size_t k = 1; k < aTaps.count; ++k)
+				acc = std::fma(aTaps.weights[k], aRows[k][i], acc);
+			aDst[i] = acc;
+		}
+	}
+
+	// Filter a (padded) row horizontally and convert it back to RGBA8. aSrc
+	// points to the first texel that contributes to output texel 0.
+	void filter_horizontal_(float const* aSrc, MipTaps_ const& aTaps, std::uint8_t* aDst, std::size_t aCount, MipTables_ const& aTables)
+	{
+		std::size_t x = 0;
+#		if MIP_AVX2_
+		__m256i const alphaLanes = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+		for (; x + 2 <= aCount; x += 2)
+		{
+			// Two output texels; their taps are two source texels apart
+			float const* src = aSrc + 8*x;
+			__m256 acc = _mm256_mul_ps(_mm256_set1_ps(aTaps.weights[0]), _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src)), _mm_loadu_ps(src + 8), 1));
+			for (std::size_t k = 1; k < aTaps.count; ++k)
+			{
+				__m256 const v = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 4*k)), _mm_loadu_ps(src + 8 + 4*k), 1);
+				acc = _mm256_fmadd_ps(_mm256_set1_ps(aTaps.weights[k]), v, acc);
+			}
+
+			// Color: bucket lookup, then round up past the halfway point
+			__m256 const v = _mm256_min_ps(_mm256_max_ps(acc, _mm256_set1_ps(kLinearMin_)), _mm256_set1_ps(kLinearMax_));
+			__m256i const bucket = _mm256_srli_epi32(_mm256_sub_epi32(_mm256_castps_si256(v), _mm256_set1_epi32(std::int32_t(kLinearBucketBase_))), kLinearBucketShift_);
+			__m256i const code = _mm256_i32gather_epi32(aTables.bucketCode, bucket, 4);
+			__m256 const roundUp = _mm256_i32gather_ps(aTables.roundUp, code, 4);
+			__m256i const color = _mm256_sub_epi32(code, _mm256_castps_si256(_mm256_cmp_ps(v, roundUp, _CMP_GE_OQ)));
+
+			// Alpha: clamp and round
+			__m256 const a = _mm256_min_ps(_mm256_max_ps(acc, _mm256_setzero_ps()), _mm256_set1_ps(255.f));
+			__m256i const alpha = _mm256_cvttps_epi32(_mm256_add_ps(a, _mm256_set1_ps(0.5f)));
+
+			__m256i const result = _mm256_blendv_epi8(color, alpha, alphaLanes);
+			__m256i const words = _mm256_packus_epi32(result, result);
+			__m256i const bytes = _mm256_packus_epi16(words, words);
 
-	// Generate mip map
-	glGenerateMipmap(GL_TEXTURE_2D);
+			std::uint32_t const lo = std::uint32_t(_mm256_extract_epi32(bytes, 0));
+			std::uint32_t const hi = std::uint32_t(_mm256_extract_epi32(bytes, 4));
+			std::memcpy(aDst + 4*x, &lo, 4);
+			std::memcpy(aDst + 4*x + 4, &hi, 4);
+		}
+#		endif // ~ MIP_AVX2_
 
+		for (; x < aCount; ++x)
+		{
+			float const* src = aSrc + 8*x;
+			for (std::size_t c = 0; c < 4; ++c)
+			{
+				float acc = aTaps.weights[0] * src[c];
+				for (std::size_t k = 1; k < aTaps.count; ++k)
+					acc = std::fma(aTaps.weights[k], src[4*k + c], acc);
+
+				aDst[4*x + c] = c < 3 ? linear_to_srgb8_(acc, aTables) : to_alpha8_(acc);
+			}
+		}
+	}
+
+	// Compute output rows [aFirstRow, aFirstRow+kMipBandRows_) of aDst. For
+	// odd sizes, the last source row/column only contributes through the
+	// filter's support. Samples outside the image are clamped to the edge.
+	void downsample_band_(ImageRGBA8 const& aSrc, ImageRGBA8& aDst, std::uint32_t aFirstRow, MipTaps_ const& aTaps, MipTables_ const& aTables)
+	{
+		auto const lastRow = std::min(aDst.height, aFirstRow + kMipBandRows_);
+		auto const offset = std::int64_t(aTaps.count / 2) - 1;
+
+		// Source rows used by the band, converted to linear once
+		auto const srcLo = 2 * std::int64_t(aFirstRow) - offset;
+		auto const srcHi = 2 * std::int64_t(lastRow - 1) - offset + std::int64_t(aTaps.count);
+		auto const rowFloats = std::size_t(aSrc.width) * 4;
+
+		std::vector<float> linear(std::size_t(srcHi - srcLo) * rowFloats);
+		for (auto r = srcLo; r < srcHi; ++r)
+		{
+			auto const y = std::clamp<std::int64_t>(r, 0, aSrc.height - 1);
+			to_linear_row_(&aSrc.texels[std::size_t(y) * rowFloats], &linear[std::size_t(r - srcLo) * rowFloats], aSrc.width, aTables);
+		}
+
+		// Vertically filtered row, with clamped texels on both sides
+		std::vector<float> column((aSrc.width + 2*kMipPad_) * 4);
+		float* const columnRow = column.data() + kMipPad_ * 4;
+
+		for (auto y = aFirstRow; y < lastRow; ++y)
+		{
+			float const* rows[kMaxMipTaps_];
+			for (std::size_t k = 0; k < aTaps.count; ++k)
+				rows[k] = &linear[std::size_t(2 * std::int64_t(y) - offset + std::int64_t(k) - srcLo) * rowFloats];
+
+			filter_vertical_(rows, aTaps, columnRow, rowFloats);
+
+			for (std::size_t i = 0; i < kMipPad_; ++i)
+			{
+				std::copy_n(columnRow, 4, column.data() + 4*i);
+				std::copy_n(columnRow + rowFloats - 4, 4, columnRow + rowFloats + 4*i);
+			}
+
+			filter_horizontal_(columnRow - 4*offset, aTaps, &aDst.texels[std::size_t(y) * aDst.width * 4], aDst.width, aTables);
+		}
+	}
+}
+
+void configure_texture_sampler()
+{
 	// Configure texture
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -31,6 +302,142 @@ GLuint load_texture_2d(char const* aPath)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY, 6.f);
+}
+
+GLuint load_texture_2d(char const* aPath)
+{
+	return upload_texture_2d(read_texture_2d(aPath));
+}
+
+TextureSource read_texture_2d(char const* aPath, bool aPrefault)
+{
+	assert(aPath);
+
+	TextureSource ret;
+	auto const use_file_ = [&ret, aPrefault] (TextureFile aFile) {
+		// Page in the mapping here, rather than during the upload
+		if (aPrefault)
+			prefault_pages(aFile.file.bytes());
+		ret.baked = std::make_shared<TextureFile const>(std::move(aFile));
+	};
+
+	// Prefer the baked texture, which already contains all mip levels
+	auto const bakedPath = baked_asset_path(aPath, kBakedTextureExtension);
+	if (auto baked = open_texture_file(bakedPath.c_str()))
+	{
+		use_file_(std::move(*baked));
+		return ret;
+	}
+
+	// Then the cache, if it was created from this exact source
+	auto const key = asset_source_key(aPath);
+	auto const cachePath = texture_cache_path(aPath);
+	if (auto cached = open_texture_file(cachePath.c_str()))
+	{
+		auto const& header = cached->header;
+		if (key && *key == AssetSourceKey{ header.sourceSize, header.sourceModTime })
+		{
+			use_file_(std::move(*cached));
+			return ret;
+		}
+	}
+
+	auto chain = generate_mip_chain(load_image_rgba8(aPath));
+	if (key)
+	{
+		auto const levels = encode_mip_chain(chain, kCachedTextureFormat);
+		if (write_texture_file(cachePath.c_str(), *key, kCachedTextureFormat, levels))
+		{
+			if (auto cached = open_texture_file(cachePath.c_str()))
+			{
+				std::print("Note: compressed '{}' ({}x{}, {} levels)\n", aPath, chain.front().width, chain.front().height, levels.size());
+				use_file_(std::move(*cached));
+				return ret;
+			}
+		}
+	}
+
+	ret.levels = std::move(chain);
+	return ret;
+}
+
+GLuint upload_texture_2d(TextureSource const& aSource)
+{
+	if (aSource.baked)
+	{
+		GLuint texId = create_texture_2d(*aSource.baked);
+		configure_texture_sampler();
+		return texId;
+	}
+
+	auto const& levels = aSource.levels;
+	assert(!levels.empty());
+
+	GLuint texId = 0;
+	glGenTextures(1, &texId);
+	glBindTexture(GL_TEXTURE_2D, texId);
+
+	// Upload every level of the (CPU generated) mip chain
+	for (std::size_t i = 0; i < levels.size(); ++i)
+	{
+		auto const& level = levels[i];
+		glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_SRGB8_ALPHA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.texels.data());
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size() - 1));
+
+	configure_texture_sampler();
 
 	return texId;
 }
+
+ImageRGBA8 load_image_rgba8(char const* aPath)
+{
+	assert(aPath);
+	// (The per-thread setting, since images may be decoded concurrently.)
+	stbi_set_flip_vertically_on_load_thread(true);
+	int w, h, channels;
+
+	unsigned char* data = stbi_load(aPath, &w, &h, &channels, 4);
+
+	if (!data)
+	{
+		throw Error("Unable to load image '{}'\n", aPath);
+	}
+
+	ImageRGBA8 ret;
+	ret.width = std::uint32_t(w);
+	ret.height = std::uint32_t(h);
+	ret.texels.assign(data, data + std::size_t(w) * h * 4);
+
+	stbi_image_free(data);
+
+	return ret;
+}
+
+std::vector<ImageRGBA8> generate_mip_chain(ImageRGBA8 aBase, MipFilter aFilter)
+{
+	auto const& tables = mip_tables_();
+	auto const taps = mip_filter_taps_(aFilter);
+
+	std::vector<ImageRGBA8> chain;
+	chain.emplace_back(std::move(aBase));
+
+	while (chain.back().width > 1 || chain.back().height > 1)
+	{
+		auto const& src = chain.back();
+
+		ImageRGBA8 dst;
+		dst.width = std::max(1u, src.width / 2);
+		dst.height = std::max(1u, src.height / 2);
+		dst.texels.resize(std::size_t(dst.width) * dst.height * 4);
+
+		auto const bands = (dst.height + kMipBandRows_ - 1) / kMipBandRows_;
+		default_thread_pool().parallel_for(bands, [&] (std::size_t aBand) {
+			downsample_band_(src, dst, std::uint32_t(aBand) * kMipBandRows_, taps, tables);
+		});
+
+		chain.emplace_back(std::move(dst));
+	}
+
+	return chain;
+}
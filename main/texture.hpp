@@ -1,7 +1,77 @@
+#ifndef TEXTURE_HPP_0B7E5C3A_2D84_4F19_A6C1_93E8F2B5D704
+#define TEXTURE_HPP_0B7E5C3A_2D84_4F19_A6C1_93E8F2B5D704
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "../third_party/stb/include/stb_image.h"
 #include <cassert>
+#include <cstdint>
+#include <vector>
+#include <memory>
 #include "../support/error.hpp"
 
-GLuint load_texture_2d(char const* aPath);
\ No newline at end of file
+// 8-bit RGBA image, rows stored bottom-up (i.e. as OpenGL expects them)
+struct ImageRGBA8
+{
+	std::uint32_t width = 0;
+	std::uint32_t height = 0;
+	std::vector<std::uint8_t> texels;
+};
+
+struct TextureFile; // see texture_cache.hpp
+
+// CPU side of a texture load: a baked or cached texture file, or (if no
+// cache could be written) the decoded source image's mip chain.
+struct TextureSource
+{
+	std::shared_ptr<TextureFile const> baked;
+	std::vector<ImageRGBA8> levels;
+};
+
+// Load a texture. If asset-baker has produced a baked version of the
+// texture, that is used (including its precomputed mip chain). Otherwise,
+// the texture cache is used; on a cache miss, the image is decoded, its mip
+// chain generated and block compressed, and the cache written (see
+// texture_cache.hpp). If that fails, the generated mip chain is uploaded
+// uncompressed. (Mipmaps are never generated by the driver.)
+//
+// Each call creates a new GL texture; see TextureManager (texture_manager.hpp)
+// for shared textures.
+//
+// Equivalent to upload_texture_2d(read_texture_2d(aPath)).
+GLuint load_texture_2d(char const* aPath);
+
+// First half of load_texture_2d(): reads (and if necessary decodes) the
+// texture. Does not use GL, so it can run on any thread. Texture files are
+// paged in unless aPrefault is false (e.g., when the levels are streamed
+// later, see texture_streamer.hpp).
+TextureSource read_texture_2d(char const* aPath, bool aPrefault = true);
+
+// Second half of load_texture_2d(): creates the GL texture. Requires a
+// current GL context.
+GLuint upload_texture_2d(TextureSource const&);
+
+// Sampler state shared by all 2D textures (trilinear, repeating, 6x
+// anisotropic). Applies to the texture bound to GL_TEXTURE_2D.
+void configure_texture_sampler();
+
+// Decode an image file to RGBA8. Throws Error on failure.
+ImageRGBA8 load_image_rgba8(char const* aPath);
+
+// Downsampling filter used by generate_mip_chain()
+enum class MipFilter
+{
+	box,    // 2x2 average
+	kaiser  // 8x8 Kaiser-windowed sinc: sharper, 16 times the taps
+};
+
+// Generate a full mip chain (down to 1x1) from aBase. The returned vector
+// starts with aBase itself. Color channels are treated as sRGB encoded and
+// are filtered in linear space; alpha is filtered as-is.
+//
+// Rows are processed in parallel on the default thread pool, with AVX2
+// kernels where the compiler targets AVX2. The result is deterministic: it
+// does not depend on the number of threads or on whether AVX2 is used.
+std::vector<ImageRGBA8> generate_mip_chain(ImageRGBA8 aBase, MipFilter = MipFilter::box);
+
+#endif // TEXTURE_HPP_0B7E5C3A_2D84_4F19_A6C1_93E8F2B5D704
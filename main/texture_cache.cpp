@@ -0,0 +1,282 @@
+#include "texture_cache.hpp"
+
+#include <print>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <filesystem>
+#include <string_view>
+
+#include "texture_compress.hpp"
+
+#include "../support/error.hpp"
+
+namespace
+{
+	constexpr char kTextureFileMagic_[8] = { 'T', 'E', 'X', 'B', 'I', 'N', '\0', '\0' };
+
+	constexpr std::uint64_t align_up_( std::uint64_t aValue ) noexcept
+	{
+		return (aValue + kTextureFileAlignment-1) & ~std::uint64_t(kTextureFileAlignment-1);
+	}
+
+	// GL_COMPRESSED_SRGB_S3TC_DXT1_EXT (GL_EXT_texture_sRGB); the loader
+	// does not include the S3TC extensions.
+	constexpr GLenum kCompressedSrgbDxt1_ = 0x8C4C;
+
+	bool has_extension_( std::string_view aName )
+	{
+		GLint count = 0;
+		glGetIntegerv( GL_NUM_EXTENSIONS, &count );
+		for( GLint i = 0; i < count; ++i )
+		{
+			if( auto const* ext = reinterpret_cast<char const*>(glGetStringi( GL_EXTENSIONS, GLuint(i) )); ext && aName == ext )
+				return true;
+		}
+		return false;
+	}
+
+	bool has_srgb_s3tc_()
+	{
+		static bool const supported = has_extension_( "GL_EXT_texture_compression_s3tc" )
+			&& (has_extension_( "GL_EXT_texture_sRGB" ) || has_extension_( "GL_EXT_texture_compression_s3tc_srgb" ));
+		return supported;
+	}
+}
+
+std::uint64_t texture_level_bytes( TextureFileFormat aFormat, std::uint32_t aWidth, std::uint32_t aHeight ) noexcept
+{
+	std::uint64_t const blocks = std::uint64_t(block_count( aWidth )) * block_count( aHeight );
+
+	switch( aFormat )
+	{
+		case TextureFileFormat::srgb8_alpha8: return std::uint64_t(aWidth) * aHeight * 4;
+		case TextureFileFormat::bc1_srgb: return blocks * kBC1BlockBytes;
+		case TextureFileFormat::bc7_srgb: return blocks * kBC7BlockBytes;
+	}
+
+	return 0;
+}
+
+std::vector<EncodedLevel> encode_mip_chain( std::span<ImageRGBA8 const> aLevels, TextureFileFormat aFormat )
+{
+	std::vector<EncodedLevel> ret;
+	ret.reserve( aLevels.size() );
+
+	for( auto const& level : aLevels )
+	{
+		EncodedLevel& out = ret.emplace_back( EncodedLevel{ level.width, level.height, {} } );
+		switch( aFormat )
+		{
+			case TextureFileFormat::srgb8_alpha8: out.data = level.texels; break;
+			case TextureFileFormat::bc1_srgb: out.data = compress_bc1( level ); break;
+			case TextureFileFormat::bc7_srgb: out.data = compress_bc7( level ); break;
+		}
+
+		assert( out.data.size() == texture_level_bytes( aFormat, level.width, level.height ) );
+	}
+
+	return ret;
+}
+
+std::optional<TextureFile> open_texture_file( char const* aPath )
+{
+	std::error_code ec;
+	if( !std::filesystem::exists( aPath, ec ) )
+		return {};
+
+	TextureFile ret;
+	try
+	{
+		ret.file = MappedFile( aPath );
+	}
+	catch( std::exception const& eErr )
+	{
+		std::print( stderr, "Note: ignoring texture file: {}\n", eErr.what() );
+		return {};
+	}
+
+	auto const bytes = ret.file.bytes();
+	if( bytes.size() < sizeof(TextureFileHeader) )
+		return {};
+
+	auto& header = ret.header;
+	std::memcpy( &header, bytes.data(), sizeof(header) );
+
+	if( 0 != std::memcmp( header.magic, kTextureFileMagic_, sizeof(kTextureFileMagic_) ) )
+		return {};
+	if( kTextureFileVersion != header.version || 0 == header.levelCount )
+		return {};
+
+	std::size_t const tableSize = std::size_t(header.levelCount) * sizeof(TextureFileLevel);
+	if( tableSize > bytes.size() - sizeof(TextureFileHeader) )
+		return {};
+
+	for( std::uint32_t i = 0; i < header.levelCount; ++i )
+	{
+		TextureFileLevel level;
+		std::memcpy( &level, bytes.data() + sizeof(TextureFileHeader) + i*sizeof(TextureFileLevel), sizeof(level) );
+
+		if( level.size != texture_level_bytes( header.format, level.width, level.height ) )
+			return {};
+		if( level.offset > bytes.size() || level.size > bytes.size() - level.offset )
+			return {};
+
+		ret.levels.emplace_back( TextureFile::Level{
+			level.width, level.height,
+			bytes.subspan( std::size_t(level.offset), std::size_t(level.size) )
+		} );
+	}
+
+	return ret;
+}
+
+bool write_texture_file( char const* aPath, AssetSourceKey const& aKey, TextureFileFormat aFormat, std::span<EncodedLevel const> aLevels )
+{
+	assert( !aLevels.empty() );
+
+	TextureFileHeader header{};
+	std::memcpy( header.magic, kTextureFileMagic_, sizeof(kTextureFileMagic_) );
+	header.version = kTextureFileVersion;
+	header.format = aFormat;
+	header.width = aLevels.front().width;
+	header.height = aLevels.front().height;
+	header.levelCount = std::uint32_t(aLevels.size());
+	header.sourceSize = aKey.size;
+	header.sourceModTime = aKey.modTime;
+
+	std::vector<TextureFileLevel> table;
+	std::uint64_t end = sizeof(TextureFileHeader) + aLevels.size()*sizeof(TextureFileLevel);
+	for( auto const& level : aLevels )
+	{
+		auto const offset = align_up_( end );
+		table.emplace_back( TextureFileLevel{ level.width, level.height, offset, level.data.size() } );
+		end = offset + level.data.size();
+	}
+
+	// Write to a temporary file first, and move it into place once complete.
+	std::string const path( aPath );
+	auto const tempPath = path + ".tmp";
+
+	std::FILE* fout = std::fopen( tempPath.c_str(), "wb" );
+	if( !fout )
+	{
+		std::print( stderr, "Note: unable to write texture file '{}'\n", path );
+		return false;
+	}
+
+	std::uint64_t written = 0;
+	auto const write_ = [&] ( void const* aData, std::size_t aBytes ) {
+		if( aBytes )
+			written += std::fwrite( aData, 1, aBytes, fout );
+	};
+
+	write_( &header, sizeof(header) );
+	write_( table.data(), table.size() * sizeof(TextureFileLevel) );
+
+	for( std::size_t i = 0; i < aLevels.size(); ++i )
+	{
+		static constexpr std::byte kZeros[kTextureFileAlignment] = {};
+		if( table[i].offset > written )
+			write_( kZeros, std::size_t(table[i].offset - written) );
+
+		write_( aLevels[i].data.data(), aLevels[i].data.size() );
+	}
+
+	bool const ok = (0 == std::ferror( fout )) && written == end;
+	std::fclose( fout );
+
+	std::error_code ec;
+	if( ok )
+		std::filesystem::rename( tempPath, path, ec );
+
+	if( !ok || ec )
+	{
+		std::filesystem::remove( tempPath, ec );
+		std::print( stderr, "Note: unable to write texture file '{}'\n", path );
+		return false;
+	}
+
+	return true;
+}
+
+std::string texture_cache_path( char const* aSourcePath )
+{
+	return std::string(aSourcePath) + ".texcache";
+}
+
+TextureFileFormat texture_upload_format( TextureFileFormat aFormat )
+{
+	if( TextureFileFormat::bc1_srgb == aFormat && !has_srgb_s3tc_() )
+		return TextureFileFormat::srgb8_alpha8;
+
+	return aFormat;
+}
+
+void stage_texture_level( TextureFile::Level const& aLevel, TextureFileFormat aFrom, TextureFileFormat aTo, std::byte* aOut )
+{
+	if( aFrom == aTo )
+	{
+		std::memcpy( aOut, aLevel.data.data(), aLevel.data.size() );
+		return;
+	}
+
+	assert( TextureFileFormat::bc1_srgb == aFrom && TextureFileFormat::srgb8_alpha8 == aTo );
+	std::span<std::uint8_t const> const blocks( reinterpret_cast<std::uint8_t const*>(aLevel.data.data()), aLevel.data.size() );
+	auto const image = decompress_bc1( blocks, aLevel.width, aLevel.height );
+	std::memcpy( aOut, image.texels.data(), image.texels.size() );
+}
+
+void specify_texture_level( TextureFileFormat aFormat, GLint aLevel, std::uint32_t aWidth, std::uint32_t aHeight, void const* aData )
+{
+	auto const bytes = GLsizei(texture_level_bytes( aFormat, aWidth, aHeight ));
+
+	switch( aFormat )
+	{
+		case TextureFileFormat::srgb8_alpha8:
+			glTexImage2D(GL_TEXTURE_2D, aLevel, GL_SRGB8_ALPHA8, aWidth, aHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, aData);
+			break;
+		case TextureFileFormat::bc1_srgb:
+			glCompressedTexImage2D(GL_TEXTURE_2D, aLevel, kCompressedSrgbDxt1_, aWidth, aHeight, 0, bytes, aData);
+			break;
+		case TextureFileFormat::bc7_srgb:
+			glCompressedTexImage2D(GL_TEXTURE_2D, aLevel, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, aWidth, aHeight, 0, bytes, aData);
+			break;
+	}
+}
+
+GLuint create_texture_2d( TextureFile const& aTexture )
+{
+	assert( !aTexture.levels.empty() );
+
+	GLuint texId = 0;
+	glGenTextures(1, &texId);
+	glBindTexture(GL_TEXTURE_2D, texId);
+
+	auto const fileFormat = aTexture.header.format;
+	auto const uploadFormat = texture_upload_format( fileFormat );
+	auto const levelCount = GLsizei(aTexture.levels.size());
+
+	std::vector<std::byte> staging;
+	for (GLsizei i = 0; i < levelCount; ++i)
+	{
+		auto const& level = aTexture.levels[i];
+
+		// Levels in a format that GL understands go straight from the
+		// mapped file to GL
+		void const* data = level.data.data();
+		if (uploadFormat != fileFormat)
+		{
+			staging.resize(std::size_t(texture_level_bytes(uploadFormat, level.width, level.height)));
+			stage_texture_level(level, fileFormat, uploadFormat, staging.data());
+			data = staging.data();
+		}
+
+		specify_texture_level(uploadFormat, i, level.width, level.height, data);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	return texId;
+}
@@ -0,0 +1,132 @@
+#ifndef TEXTURE_CACHE_HPP_D2A95E71_3C08_4B6F_8E14_57C0B9A2F3D8
+#define TEXTURE_CACHE_HPP_D2A95E71_3C08_4B6F_8E14_57C0B9A2F3D8
+
+#include <glad/glad.h>
+
+#include <span>
+#include <string>
+#include <vector>
+#include <optional>
+
+#include <cstdint>
+
+#include "texture.hpp"
+#include "baked_assets.hpp"
+
+#include "../support/mapped_file.hpp"
+
+/* Binary texture files
+ *
+ * Stores a complete, precomputed mip chain so that a texture can be uploaded
+ * level by level without decoding the source image or generating mipmaps at
+ * run time. Levels are stored either uncompressed or block compressed (see
+ * texture_compress.hpp); compressed levels are uploaded as-is with
+ * glCompressedTexImage2D().
+ *
+ * As with meshes (see mesh_cache.hpp), texture files are used in two places:
+ *
+ *  - Baked textures: written by asset-baker to "<dir>/baked/<name>.tex".
+ *  - Texture cache: if there is no baked texture, the first load of a source
+ *    image writes "<source>.texcache" (in kCachedTextureFormat). The cache is
+ *    only used if the source's size and modification time match.
+ *
+ * File layout (native endianness):
+ *   - TextureFileHeader
+ *   - levelCount x TextureFileLevel
+ *   - level data, each level aligned to kTextureFileAlignment bytes
+ */
+constexpr std::uint32_t kTextureFileVersion = 2;
+constexpr std::size_t kTextureFileAlignment = 16;
+
+enum class TextureFileFormat : std::uint32_t
+{
+	srgb8_alpha8 = 1,
+	bc1_srgb,  // opaque only; requires S3TC (falls back to decoding on the CPU)
+	bc7_srgb
+};
+
+constexpr TextureFileFormat kCachedTextureFormat = TextureFileFormat::bc7_srgb;
+
+struct TextureFileHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	TextureFileFormat format;
+
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint32_t levelCount;
+	std::uint32_t reserved;
+
+	std::uint64_t sourceSize;
+	std::int64_t sourceModTime;
+};
+
+struct TextureFileLevel
+{
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint64_t offset; // from start of file
+	std::uint64_t size;   // in bytes
+};
+
+// A memory-mapped texture file
+struct TextureFile
+{
+	struct Level
+	{
+		std::uint32_t width;
+		std::uint32_t height;
+		std::span<std::byte const> data;
+	};
+
+	MappedFile file;
+	TextureFileHeader header;
+	std::vector<Level> levels;
+};
+
+// A mip level in one of the file formats
+struct EncodedLevel
+{
+	std::uint32_t width;
+	std::uint32_t height;
+	std::vector<std::uint8_t> data;
+};
+
+// Size of a level in the given format, in bytes
+std::uint64_t texture_level_bytes( TextureFileFormat, std::uint32_t aWidth, std::uint32_t aHeight ) noexcept;
+
+// Convert a mip chain (see generate_mip_chain()) to aFormat.
+std::vector<EncodedLevel> encode_mip_chain( std::span<ImageRGBA8 const>, TextureFileFormat aFormat );
+
+// Open a texture file. Returns an empty optional if the file does not exist
+// or is not a valid texture file of the current version.
+std::optional<TextureFile> open_texture_file( char const* aPath );
+
+// Write a texture file from an encoded mip chain. Returns false (after
+// printing a note) if the file cannot be written.
+bool write_texture_file( char const* aPath, AssetSourceKey const&, TextureFileFormat, std::span<EncodedLevel const> aLevels );
+
+std::string texture_cache_path( char const* aSourcePath );
+
+// Format in which levels of aFormat are passed to GL: aFormat itself, or
+// srgb8_alpha8 for BC1 if the GL implementation lacks S3TC support. Requires
+// a current GL context.
+TextureFileFormat texture_upload_format( TextureFileFormat aFormat );
+
+// Copy level aLevel (stored in aFrom) to aOut, converting it to aTo (either
+// aFrom or srgb8_alpha8). aOut must hold texture_level_bytes( aTo, ... )
+// bytes. Does not use GL, so it can run on any thread.
+void stage_texture_level( TextureFile::Level const& aLevel, TextureFileFormat aFrom, TextureFileFormat aTo, std::byte* aOut );
+
+// Specify mip level aLevel of the texture bound to GL_TEXTURE_2D from data
+// in aFormat (as returned by texture_upload_format()). aData may be an
+// offset into the bound GL_PIXEL_UNPACK_BUFFER.
+void specify_texture_level( TextureFileFormat aFormat, GLint aLevel, std::uint32_t aWidth, std::uint32_t aHeight, void const* aData );
+
+// Create a GL texture and upload all levels. Sampler state is left at the GL
+// defaults. BC1 textures are decoded on the CPU if the GL implementation
+// lacks S3TC support.
+GLuint create_texture_2d( TextureFile const& );
+
+#endif // TEXTURE_CACHE_HPP_D2A95E71_3C08_4B6F_8E14_57C0B9A2F3D8
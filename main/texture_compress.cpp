@@ -0,0 +1,510 @@
+#include "texture_compress.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <cassert>
+
+#include "../support/thread_pool.hpp"
+
+namespace
+{
+	using Texel_ = std::array<float, 4>;
+	using Block_ = std::array<Texel_, 16>;
+
+	void load_block_( ImageRGBA8 const& aImage, std::uint32_t aBlockX, std::uint32_t aBlockY, Block_& aOut ) noexcept
+	{
+		for( std::uint32_t y = 0; y < 4; ++y )
+		{
+			std::uint32_t const sy = std::min( aBlockY*4 + y, aImage.height-1 );
+			for( std::uint32_t x = 0; x < 4; ++x )
+			{
+				std::uint32_t const sx = std::min( aBlockX*4 + x, aImage.width-1 );
+				std::uint8_t const* src = &aImage.texels[(std::size_t(sy) * aImage.width + sx) * 4];
+				for( std::size_t c = 0; c < 4; ++c )
+					aOut[y*4 + x][c] = float(src[c]);
+			}
+		}
+	}
+
+	// Mean and principal axis of the first tChannels channels of the block.
+	// The axis is found by power iteration on the covariance matrix; it is
+	// zero if the block has (nearly) a single color.
+	template< std::size_t tChannels >
+	void principal_axis_( Block_ const& aBlock, std::array<float, tChannels>& aMean, std::array<float, tChannels>& aAxis ) noexcept
+	{
+		aMean.fill( 0.f );
+		for( auto const& texel : aBlock )
+		{
+			for( std::size_t c = 0; c < tChannels; ++c )
+				aMean[c] += texel[c];
+		}
+		for( auto& m : aMean )
+			m *= 1.f / 16.f;
+
+		float cov[tChannels][tChannels] = {};
+		for( auto const& texel : aBlock )
+		{
+			for( std::size_t c = 0; c < tChannels; ++c )
+			{
+				for( std::size_t d = c; d < tChannels; ++d )
+					cov[c][d] += (texel[c] - aMean[c]) * (texel[d] - aMean[d]);
+			}
+		}
+		for( std::size_t c = 0; c < tChannels; ++c )
+		{
+			for( std::size_t d = 0; d < c; ++d )
+				cov[c][d] = cov[d][c];
+		}
+
+		// Start with the row of the channel with the largest variance
+		std::size_t start = 0;
+		for( std::size_t c = 1; c < tChannels; ++c )
+		{
+			if( cov[c][c] > cov[start][start] )
+				start = c;
+		}
+
+		aAxis.fill( 0.f );
+		if( cov[start][start] < 1e-3f )
+			return;
+
+		std::array<float, tChannels> v;
+		for( std::size_t c = 0; c < tChannels; ++c )
+			v[c] = cov[start][c];
+
+		for( int iter = 0; iter < 8; ++iter )
+		{
+			std::array<float, tChannels> w{};
+			float maxAbs = 0.f;
+			for( std::size_t c = 0; c < tChannels; ++c )
+			{
+				for( std::size_t d = 0; d < tChannels; ++d )
+					w[c] += cov[c][d] * v[d];
+				maxAbs = std::max( maxAbs, std::abs( w[c] ) );
+			}
+
+			if( maxAbs <= 0.f )
+				return;
+			for( std::size_t c = 0; c < tChannels; ++c )
+				v[c] = w[c] / maxAbs;
+		}
+
+		float len2 = 0.f;
+		for( auto const x : v )
+			len2 += x*x;
+
+		float const invLen = 1.f / std::sqrt( len2 );
+		for( std::size_t c = 0; c < tChannels; ++c )
+			aAxis[c] = v[c] * invLen;
+	}
+
+	// Endpoints at the extremes of the texels' projections onto the axis
+	template< std::size_t tChannels >
+	void axis_endpoints_( Block_ const& aBlock, std::array<float, tChannels> const& aMean, std::array<float, tChannels> const& aAxis, std::array<float, tChannels>& aLow, std::array<float, tChannels>& aHigh ) noexcept
+	{
+		float tMin = 0.f, tMax = 0.f;
+		for( auto const& texel : aBlock )
+		{
+			float t = 0.f;
+			for( std::size_t c = 0; c < tChannels; ++c )
+				t += (texel[c] - aMean[c]) * aAxis[c];
+
+			tMin = std::min( tMin, t );
+			tMax = std::max( tMax, t );
+		}
+
+		for( std::size_t c = 0; c < tChannels; ++c )
+		{
+			aLow[c] = std::clamp( aMean[c] + tMin * aAxis[c], 0.f, 255.f );
+			aHigh[c] = std::clamp( aMean[c] + tMax * aAxis[c], 0.f, 255.f );
+		}
+	}
+
+	// Least-squares endpoints for fixed per-texel weights: texel i is
+	// approximated by (1-aWeights[i]) * low + aWeights[i] * high. Returns
+	// false if the system is singular (e.g., all texels use one weight).
+	template< std::size_t tChannels >
+	bool fit_endpoints_( Block_ const& aBlock, std::array<float, 16> const& aWeights, std::array<float, tChannels>& aLow, std::array<float, tChannels>& aHigh ) noexcept
+	{
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		std::array<float, tChannels> ap{}, bp{};
+		for( std::size_t i = 0; i < 16; ++i )
+		{
+			float const b = aWeights[i];
+			float const a = 1.f - b;
+			aa += a*a;
+			ab += a*b;
+			bb += b*b;
+			for( std::size_t c = 0; c < tChannels; ++c )
+			{
+				ap[c] += a * aBlock[i][c];
+				bp[c] += b * aBlock[i][c];
+			}
+		}
+
+		float const det = aa*bb - ab*ab;
+		if( std::abs( det ) < 1e-6f )
+			return false;
+
+		float const invDet = 1.f / det;
+		for( std::size_t c = 0; c < tChannels; ++c )
+		{
+			aLow[c] = std::clamp( (bb*ap[c] - ab*bp[c]) * invDet, 0.f, 255.f );
+			aHigh[c] = std::clamp( (aa*bp[c] - ab*ap[c]) * invDet, 0.f, 255.f );
+		}
+		return true;
+	}
+
+	// BC1
+	std::uint16_t to_565_( std::array<float, 3> const& aColor ) noexcept
+	{
+		auto const r = std::uint16_t(std::clamp( std::lround( aColor[0] * (31.f/255.f) ), 0l, 31l ));
+		auto const g = std::uint16_t(std::clamp( std::lround( aColor[1] * (63.f/255.f) ), 0l, 63l ));
+		auto const b = std::uint16_t(std::clamp( std::lround( aColor[2] * (31.f/255.f) ), 0l, 31l ));
+		return std::uint16_t(r << 11 | g << 5 | b);
+	}
+	std::array<int, 3> from_565_( std::uint16_t aColor ) noexcept
+	{
+		int const r = aColor >> 11, g = (aColor >> 5) & 63, b = aColor & 31;
+		return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+	}
+
+	// Four-color palette; requires aC0 > aC1 (or equal, in which case only
+	// the first entry is meaningful)
+	std::array<std::array<int, 3>, 4> bc1_palette_( std::uint16_t aC0, std::uint16_t aC1 ) noexcept
+	{
+		auto const p0 = from_565_( aC0 ), p1 = from_565_( aC1 );
+
+		std::array<std::array<int, 3>, 4> ret{ p0, p1, {}, {} };
+		for( std::size_t c = 0; c < 3; ++c )
+		{
+			ret[2][c] = (2*p0[c] + p1[c]) / 3;
+			ret[3][c] = (p0[c] + 2*p1[c]) / 3;
+		}
+		return ret;
+	}
+
+	struct BC1Fit_
+	{
+		std::uint16_t c0, c1;
+		std::uint32_t indices;
+		float error;
+	};
+
+	BC1Fit_ fit_bc1_( Block_ const& aBlock, std::uint16_t aC0, std::uint16_t aC1 ) noexcept
+	{
+		// c0 > c1 selects the four-color mode
+		if( aC0 < aC1 )
+			std::swap( aC0, aC1 );
+
+		auto const palette = bc1_palette_( aC0, aC1 );
+		std::size_t const entries = aC0 == aC1 ? 1 : 4;
+
+		BC1Fit_ ret{ aC0, aC1, 0, 0.f };
+		for( std::size_t i = 0; i < 16; ++i )
+		{
+			float bestError = 1e30f;
+			std::uint32_t best = 0;
+			for( std::size_t k = 0; k < entries; ++k )
+			{
+				float error = 0.f;
+				for( std::size_t c = 0; c < 3; ++c )
+				{
+					float const d = aBlock[i][c] - float(palette[k][c]);
+					error += d*d;
+				}
+				if( error < bestError )
+				{
+					bestError = error;
+					best = std::uint32_t(k);
+				}
+			}
+
+			ret.indices |= best << (2*i);
+			ret.error += bestError;
+		}
+		return ret;
+	}
+
+	void encode_bc1_block_( Block_ const& aBlock, std::uint8_t* aOut ) noexcept
+	{
+		std::array<float, 3> mean, axis, low, high;
+		principal_axis_( aBlock, mean, axis );
+		axis_endpoints_( aBlock, mean, axis, low, high );
+
+		auto best = fit_bc1_( aBlock, to_565_( high ), to_565_( low ) );
+
+		// Refine the endpoints for the chosen indices
+		if( best.c0 != best.c1 )
+		{
+			constexpr float kWeights[4] = { 0.f, 1.f, 1.f/3.f, 2.f/3.f }; // weight of c1
+			std::array<float, 16> weights;
+			for( std::size_t i = 0; i < 16; ++i )
+				weights[i] = kWeights[(best.indices >> (2*i)) & 3];
+
+			if( fit_endpoints_( aBlock, weights, high, low ) )
+			{
+				auto const refined = fit_bc1_( aBlock, to_565_( high ), to_565_( low ) );
+				if( refined.error < best.error )
+					best = refined;
+			}
+		}
+
+		std::memcpy( aOut + 0, &best.c0, 2 );
+		std::memcpy( aOut + 2, &best.c1, 2 );
+		std::memcpy( aOut + 4, &best.indices, 4 );
+	}
+
+	// BC7 mode 6
+	constexpr int kBC7Weights_[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BC7Fit_
+	{
+		std::array<int, 4> e0, e1; // 7 bits per channel
+		int p0, p1;
+		std::array<std::uint8_t, 16> indices;
+		float error;
+	};
+
+	BC7Fit_ fit_bc7_( Block_ const& aBlock, std::array<float, 4> const& aLow, std::array<float, 4> const& aHigh, int aP0, int aP1 ) noexcept
+	{
+		BC7Fit_ ret{ {}, {}, aP0, aP1, {}, 0.f };
+
+		std::array<int, 4> lo, hi;
+		for( std::size_t c = 0; c < 4; ++c )
+		{
+			ret.e0[c] = std::clamp( int(std::lround( (aLow[c] - float(aP0)) * 0.5f )), 0, 127 );
+			ret.e1[c] = std::clamp( int(std::lround( (aHigh[c] - float(aP1)) * 0.5f )), 0, 127 );
+			lo[c] = ret.e0[c] << 1 | aP0;
+			hi[c] = ret.e1[c] << 1 | aP1;
+		}
+
+		std::array<float, 4> palette[16];
+		for( std::size_t k = 0; k < 16; ++k )
+		{
+			for( std::size_t c = 0; c < 4; ++c )
+				palette[k][c] = float(((64 - kBC7Weights_[k]) * lo[c] + kBC7Weights_[k] * hi[c] + 32) >> 6);
+		}
+
+		float dir[4], len2 = 0.f;
+		for( std::size_t c = 0; c < 4; ++c )
+		{
+			dir[c] = float(hi[c] - lo[c]);
+			len2 += dir[c] * dir[c];
+		}
+		float const invLen2 = len2 > 0.f ? 1.f / len2 : 0.f;
+
+		for( std::size_t i = 0; i < 16; ++i )
+		{
+			// The weights are nearly uniform, so the projection onto the
+			// endpoint line finds the right index up to +/- 1
+			float t = 0.f;
+			for( std::size_t c = 0; c < 4; ++c )
+				t += (aBlock[i][c] - float(lo[c])) * dir[c];
+
+			int const guess = std::clamp( int(std::lround( t * invLen2 * 15.f )), 0, 15 );
+
+			float bestError = 1e30f;
+			int best = guess;
+			for( int k = std::max( guess-1, 0 ); k <= std::min( guess+1, 15 ); ++k )
+			{
+				float error = 0.f;
+				for( std::size_t c = 0; c < 4; ++c )
+				{
+					float const d = aBlock[i][c] - palette[k][c];
+					error += d*d;
+				}
+				if( error < bestError )
+				{
+					bestError = error;
+					best = k;
+				}
+			}
+
+			ret.indices[i] = std::uint8_t(best);
+			ret.error += bestError;
+		}
+
+		return ret;
+	}
+
+	BC7Fit_ fit_bc7_pbits_( Block_ const& aBlock, std::array<float, 4> const& aLow, std::array<float, 4> const& aHigh ) noexcept
+	{
+		BC7Fit_ best = fit_bc7_( aBlock, aLow, aHigh, 0, 0 );
+		for( int p = 1; p < 4; ++p )
+		{
+			auto const fit = fit_bc7_( aBlock, aLow, aHigh, p & 1, p >> 1 );
+			if( fit.error < best.error )
+				best = fit;
+		}
+		return best;
+	}
+
+	// 128-bit little-endian bit stream
+	struct BitWriter_
+	{
+		std::uint64_t lo = 0, hi = 0;
+		unsigned pos = 0;
+
+		void put( std::uint64_t aValue, unsigned aBits ) noexcept
+		{
+			if( pos >= 64 )
+				hi |= aValue << (pos - 64);
+			else
+			{
+				lo |= aValue << pos;
+				if( pos + aBits > 64 )
+					hi |= aValue >> (64 - pos);
+			}
+			pos += aBits;
+		}
+	};
+
+	void encode_bc7_block_( Block_ const& aBlock, std::uint8_t* aOut ) noexcept
+	{
+		std::array<float, 4> mean, axis, low, high;
+		principal_axis_( aBlock, mean, axis );
+		axis_endpoints_( aBlock, mean, axis, low, high );
+
+		auto best = fit_bc7_pbits_( aBlock, low, high );
+
+		// Refine the endpoints for the chosen indices
+		std::array<float, 16> weights;
+		for( std::size_t i = 0; i < 16; ++i )
+			weights[i] = float(kBC7Weights_[best.indices[i]]) / 64.f;
+
+		if( fit_endpoints_( aBlock, weights, low, high ) )
+		{
+			auto const refined = fit_bc7_pbits_( aBlock, low, high );
+			if( refined.error < best.error )
+				best = refined;
+		}
+
+		// The most significant index bit of the first texel is implicitly
+		// zero; swap the endpoints if necessary
+		if( best.indices[0] >= 8 )
+		{
+			std::swap( best.e0, best.e1 );
+			std::swap( best.p0, best.p1 );
+			for( auto& index : best.indices )
+				index = std::uint8_t(15 - index);
+		}
+
+		BitWriter_ bits;
+		bits.put( 1u << 6, 7 ); // mode 6
+		for( std::size_t c = 0; c < 4; ++c )
+		{
+			bits.put( std::uint64_t(best.e0[c]), 7 );
+			bits.put( std::uint64_t(best.e1[c]), 7 );
+		}
+		bits.put( std::uint64_t(best.p0), 1 );
+		bits.put( std::uint64_t(best.p1), 1 );
+
+		bits.put( best.indices[0], 3 );
+		for( std::size_t i = 1; i < 16; ++i )
+			bits.put( best.indices[i], 4 );
+
+		assert( 128 == bits.pos );
+		std::memcpy( aOut + 0, &bits.lo, 8 );
+		std::memcpy( aOut + 8, &bits.hi, 8 );
+	}
+
+	template< typename tEncode >
+	std::vector<std::uint8_t> compress_( ImageRGBA8 const& aImage, std::size_t aBlockBytes, tEncode const& aEncode )
+	{
+		assert( aImage.width > 0 && aImage.height > 0 );
+		assert( aImage.texels.size() == std::size_t(aImage.width) * aImage.height * 4 );
+
+		std::uint32_t const blocksX = block_count( aImage.width );
+		std::uint32_t const blocksY = block_count( aImage.height );
+
+		std::vector<std::uint8_t> ret( std::size_t(blocksX) * blocksY * aBlockBytes );
+		default_thread_pool().parallel_for( blocksY, [&] ( std::size_t aBlockY ) {
+			Block_ block;
+			for( std::uint32_t bx = 0; bx < blocksX; ++bx )
+			{
+				load_block_( aImage, bx, std::uint32_t(aBlockY), block );
+				aEncode( block, &ret[(aBlockY * blocksX + bx) * aBlockBytes] );
+			}
+		} );
+
+		return ret;
+	}
+}
+
+bool image_is_opaque( ImageRGBA8 const& aImage ) noexcept
+{
+	for( std::size_t i = 3; i < aImage.texels.size(); i += 4 )
+	{
+		if( 255 != aImage.texels[i] )
+			return false;
+	}
+	return true;
+}
+
+std::vector<std::uint8_t> compress_bc1( ImageRGBA8 const& aImage )
+{
+	return compress_( aImage, kBC1BlockBytes, encode_bc1_block_ );
+}
+
+std::vector<std::uint8_t> compress_bc7( ImageRGBA8 const& aImage )
+{
+	return compress_( aImage, kBC7BlockBytes, encode_bc7_block_ );
+}
+
+ImageRGBA8 decompress_bc1( std::span<std::uint8_t const> aData, std::uint32_t aWidth, std::uint32_t aHeight )
+{
+	std::uint32_t const blocksX = block_count( aWidth );
+	std::uint32_t const blocksY = block_count( aHeight );
+	assert( aData.size() == std::size_t(blocksX) * blocksY * kBC1BlockBytes );
+
+	ImageRGBA8 ret;
+	ret.width = aWidth;
+	ret.height = aHeight;
+	ret.texels.resize( std::size_t(aWidth) * aHeight * 4 );
+
+	for( std::uint32_t by = 0; by < blocksY; ++by )
+	{
+		for( std::uint32_t bx = 0; bx < blocksX; ++bx )
+		{
+			std::uint8_t const* block = &aData[(std::size_t(by) * blocksX + bx) * kBC1BlockBytes];
+
+			std::uint16_t c0, c1;
+			std::uint32_t indices;
+			std::memcpy( &c0, block + 0, 2 );
+			std::memcpy( &c1, block + 2, 2 );
+			std::memcpy( &indices, block + 4, 4 );
+
+			// Three-color mode (c0 <= c1): index 2 is the midpoint, index 3
+			// transparent black
+			auto palette = bc1_palette_( c0, c1 );
+			bool const threeColor = c0 <= c1;
+			if( threeColor )
+			{
+				auto const p0 = from_565_( c0 ), p1 = from_565_( c1 );
+				for( std::size_t c = 0; c < 3; ++c )
+				{
+					palette[2][c] = (p0[c] + p1[c]) / 2;
+					palette[3][c] = 0;
+				}
+			}
+
+			for( std::uint32_t y = 0; y < 4 && by*4 + y < aHeight; ++y )
+			{
+				for( std::uint32_t x = 0; x < 4 && bx*4 + x < aWidth; ++x )
+				{
+					auto const k = (indices >> (2*(y*4 + x))) & 3;
+					std::uint8_t* out = &ret.texels[(std::size_t(by*4 + y) * aWidth + bx*4 + x) * 4];
+					for( std::size_t c = 0; c < 3; ++c )
+						out[c] = std::uint8_t(palette[k][c]);
+					out[3] = (threeColor && 3 == k) ? 0 : 255;
+				}
+			}
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,49 @@
+#ifndef TEXTURE_COMPRESS_HPP_6E0D3B81_A4F7_4C29_8B53_F1C92E7A0D46
+#define TEXTURE_COMPRESS_HPP_6E0D3B81_A4F7_4C29_8B53_F1C92E7A0D46
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "texture.hpp"
+
+/* Block compression
+ *
+ * CPU encoders for the BCn formats used by the texture cache. Both work on
+ * 4x4 texel blocks; images whose size is not a multiple of four are padded by
+ * repeating the last row/column.
+ *
+ *  - BC1: 8 bytes per block (4 bits per texel). Two RGB565 endpoints and two
+ *    interpolated colors. Opaque images only.
+ *  - BC7: 16 bytes per block (8 bits per texel). Only mode 6 is used (one
+ *    subset, RGBA endpoints with 7 bits + shared-per-endpoint p-bit, 4-bit
+ *    indices), which handles smooth photographic content and alpha well.
+ *
+ * The texel values are encoded as-is. For the sRGB variants of the formats,
+ * interpolation happens on the sRGB encoded values, so no conversion is
+ * needed.
+ *
+ * The encoders split the image into rows of blocks, which are processed in
+ * parallel on the default thread pool.
+ */
+constexpr std::size_t kBC1BlockBytes = 8;
+constexpr std::size_t kBC7BlockBytes = 16;
+
+constexpr std::uint32_t block_count( std::uint32_t aTexels ) noexcept
+{
+	return (aTexels + 3) / 4;
+}
+
+// True if every texel has alpha 255, i.e., the image can be stored as BC1
+bool image_is_opaque( ImageRGBA8 const& ) noexcept;
+
+std::vector<std::uint8_t> compress_bc1( ImageRGBA8 const& );
+std::vector<std::uint8_t> compress_bc7( ImageRGBA8 const& );
+
+// Decode BC1 data (as produced by compress_bc1()) to RGBA8. Used when the GL
+// implementation does not support S3TC.
+ImageRGBA8 decompress_bc1( std::span<std::uint8_t const>, std::uint32_t aWidth, std::uint32_t aHeight );
+
+#endif // TEXTURE_COMPRESS_HPP_6E0D3B81_A4F7_4C29_8B53_F1C92E7A0D46
@@ -0,0 +1,313 @@
+#include "texture_manager.hpp"
+
+#include <print>
+#include <tuple>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <filesystem>
+
+#include <cassert>
+
+namespace
+{
+	std::string texture_key_( char const* aPath )
+	{
+		assert( aPath );
+		return std::filesystem::path( aPath ).lexically_normal().generic_string();
+	}
+
+	// GPU memory of the texture that upload_texture_2d( aSource ) creates,
+	// and the format it is stored in.
+	std::pair<TextureFileFormat, std::uint64_t> texture_size_( TextureSource const& aSource )
+	{
+		std::uint64_t bytes = 0;
+		if( aSource.baked )
+		{
+			auto const format = texture_upload_format( aSource.baked->header.format );
+			for( auto const& level : aSource.baked->levels )
+				bytes += texture_level_bytes( format, level.width, level.height );
+			return { format, bytes };
+		}
+
+		for( auto const& level : aSource.levels )
+			bytes += texture_level_bytes( TextureFileFormat::srgb8_alpha8, level.width, level.height );
+		return { TextureFileFormat::srgb8_alpha8, bytes };
+	}
+
+	char const* format_name_( TextureFileFormat aFormat ) noexcept
+	{
+		switch( aFormat )
+		{
+			case TextureFileFormat::srgb8_alpha8: return "RGBA8";
+			case TextureFileFormat::bc1_srgb: return "BC1";
+			case TextureFileFormat::bc7_srgb: return "BC7";
+		}
+		return "?";
+	}
+
+	constexpr double kMiB_ = 1024.0 * 1024.0;
+}
+
+// TextureHandle
+TextureHandle::TextureHandle( TextureManager* aManager, Entry_* aEntry, GLuint aSampler ) noexcept
+	: mManager( aManager )
+	, mEntry( aEntry )
+	, mSampler( aSampler )
+{
+	mManager->add_ref_( *mEntry );
+}
+
+TextureHandle::~TextureHandle()
+{
+	release_();
+}
+
+TextureHandle::TextureHandle( TextureHandle const& aOther ) noexcept
+	: mManager( aOther.mManager )
+	, mEntry( aOther.mEntry )
+	, mSampler( aOther.mSampler )
+{
+	if( mEntry )
+		mManager->add_ref_( *mEntry );
+}
+TextureHandle& TextureHandle::operator= (TextureHandle const& aOther) noexcept
+{
+	if( this != &aOther )
+	{
+		// (Reference the new texture first, in case both share it.)
+		if( aOther.mEntry )
+			aOther.mManager->add_ref_( *aOther.mEntry );
+
+		release_();
+		mManager = aOther.mManager;
+		mEntry = aOther.mEntry;
+		mSampler = aOther.mSampler;
+	}
+	return *this;
+}
+
+TextureHandle::TextureHandle( TextureHandle&& aOther ) noexcept
+	: mManager( std::exchange( aOther.mManager, nullptr ) )
+	, mEntry( std::exchange( aOther.mEntry, nullptr ) )
+	, mSampler( std::exchange( aOther.mSampler, 0 ) )
+{}
+TextureHandle& TextureHandle::operator= (TextureHandle&& aOther) noexcept
+{
+	if( this != &aOther )
+	{
+		release_();
+		mManager = std::exchange( aOther.mManager, nullptr );
+		mEntry = std::exchange( aOther.mEntry, nullptr );
+		mSampler = std::exchange( aOther.mSampler, 0 );
+	}
+	return *this;
+}
+
+TextureHandle::operator bool() const noexcept
+{
+	return nullptr != mEntry;
+}
+
+GLuint TextureHandle::texture() const noexcept
+{
+	return mEntry ? mEntry->texture : 0;
+}
+GLuint TextureHandle::sampler() const noexcept
+{
+	return mSampler;
+}
+
+void TextureHandle::bind( GLuint aUnit ) const
+{
+	glActiveTexture( GL_TEXTURE0 + aUnit );
+	glBindTexture( GL_TEXTURE_2D, texture() );
+	glBindSampler( aUnit, mSampler );
+}
+
+void TextureHandle::release_() noexcept
+{
+	if( mEntry )
+		mManager->release_( *mEntry );
+
+	mManager = nullptr;
+	mEntry = nullptr;
+	mSampler = 0;
+}
+
+// TextureManager
+TextureManager::TextureManager( TextureManagerConfig const& aConfig )
+	: mConfig( aConfig )
+{}
+
+TextureManager::~TextureManager()
+{
+	for( auto const& [path, entry] : mEntries )
+	{
+		assert( 0 == entry.refs ); // handles must not outlive the manager
+		glDeleteTextures( 1, &entry.texture );
+	}
+
+	for( auto const& [state, sampler] : mSamplers )
+		glDeleteSamplers( 1, &sampler );
+}
+
+TextureHandle TextureManager::acquire( char const* aPath, SamplerState const& aSampler )
+{
+	auto const it = mEntries.find( texture_key_( aPath ) );
+	if( mEntries.end() != it )
+		return make_handle_( it->second, aSampler );
+
+	return acquire( aPath, aSampler, read_texture_2d( aPath ) );
+}
+
+TextureHandle TextureManager::acquire( char const* aPath, SamplerState const& aSampler, TextureSource const& aSource )
+{
+	auto [it, inserted] = mEntries.try_emplace( texture_key_( aPath ) );
+	auto& entry = it->second;
+
+	if( inserted )
+	{
+		try
+		{
+			entry.texture = upload_texture_2d( aSource );
+		}
+		catch( ... )
+		{
+			mEntries.erase( it );
+			throw;
+		}
+
+		std::tie( entry.format, entry.bytes ) = texture_size_( aSource );
+		mBytesPerFormat[std::size_t(entry.format)] += entry.bytes;
+
+		// Counted as unused until the handle below references it
+		mUnusedBytes += entry.bytes;
+	}
+
+	return make_handle_( entry, aSampler );
+}
+
+bool TextureManager::contains( char const* aPath ) const
+{
+	return mEntries.contains( texture_key_( aPath ) );
+}
+
+void TextureManager::collect()
+{
+	while( mUnusedBytes > mConfig.unusedBudget )
+	{
+		// Least recently released. (There are few textures, so a linear
+		// search is fine.)
+		auto victim = mEntries.end();
+		for( auto it = mEntries.begin(); it != mEntries.end(); ++it )
+		{
+			if( 0 == it->second.refs && (mEntries.end() == victim || it->second.releasedAt < victim->second.releasedAt) )
+				victim = it;
+		}
+
+		assert( mEntries.end() != victim );
+		evict_( victim );
+	}
+}
+
+void TextureManager::evict_unused()
+{
+	for( auto it = mEntries.begin(); it != mEntries.end(); )
+	{
+		auto const next = std::next( it );
+		if( 0 == it->second.refs )
+			evict_( it );
+		it = next;
+	}
+}
+
+std::uint64_t TextureManager::resident_bytes() const noexcept
+{
+	std::uint64_t total = 0;
+	for( auto const bytes : mBytesPerFormat )
+		total += bytes;
+	return total;
+}
+std::uint64_t TextureManager::resident_bytes( TextureFileFormat aFormat ) const noexcept
+{
+	return mBytesPerFormat[std::size_t(aFormat)];
+}
+std::uint64_t TextureManager::unused_bytes() const noexcept
+{
+	return mUnusedBytes;
+}
+std::size_t TextureManager::resident_count() const noexcept
+{
+	return mEntries.size();
+}
+
+void TextureManager::add_external_bytes( TextureFileFormat aFormat, std::uint64_t aBytes ) noexcept
+{
+	mBytesPerFormat[std::size_t(aFormat)] += aBytes;
+}
+void TextureManager::remove_external_bytes( TextureFileFormat aFormat, std::uint64_t aBytes ) noexcept
+{
+	assert( mBytesPerFormat[std::size_t(aFormat)] >= aBytes );
+	mBytesPerFormat[std::size_t(aFormat)] -= aBytes;
+}
+
+void TextureManager::print_stats() const
+{
+	std::print( "Note: {} textures resident, {:.1f} MiB (", resident_count(), resident_bytes() / kMiB_ );
+	for( auto const format : { TextureFileFormat::srgb8_alpha8, TextureFileFormat::bc1_srgb, TextureFileFormat::bc7_srgb } )
+		std::print( "{} {:.1f} MiB, ", format_name_( format ), resident_bytes( format ) / kMiB_ );
+	std::print( "unused {:.1f} MiB)\n", unused_bytes() / kMiB_ );
+}
+
+TextureHandle TextureManager::make_handle_( Entry_& aEntry, SamplerState const& aSampler )
+{
+	return TextureHandle( this, &aEntry, sampler_( aSampler ) );
+}
+
+GLuint TextureManager::sampler_( SamplerState const& aState )
+{
+	// The default state is set on the textures themselves
+	if( SamplerState{} == aState )
+		return 0;
+
+	auto [it, inserted] = mSamplers.try_emplace( aState, 0 );
+	if( inserted )
+	{
+		glGenSamplers( 1, &it->second );
+		glSamplerParameteri( it->second, GL_TEXTURE_MIN_FILTER, GLint(aState.minFilter) );
+		glSamplerParameteri( it->second, GL_TEXTURE_MAG_FILTER, GLint(aState.magFilter) );
+		glSamplerParameteri( it->second, GL_TEXTURE_WRAP_S, GLint(aState.wrapS) );
+		glSamplerParameteri( it->second, GL_TEXTURE_WRAP_T, GLint(aState.wrapT) );
+		glSamplerParameterf( it->second, GL_TEXTURE_MAX_ANISOTROPY, aState.maxAnisotropy );
+	}
+
+	return it->second;
+}
+
+void TextureManager::add_ref_( Entry_& aEntry ) noexcept
+{
+	if( 0 == aEntry.refs++ )
+		mUnusedBytes -= aEntry.bytes;
+}
+void TextureManager::release_( Entry_& aEntry ) noexcept
+{
+	assert( aEntry.refs > 0 );
+	if( 0 == --aEntry.refs )
+	{
+		mUnusedBytes += aEntry.bytes;
+		aEntry.releasedAt = ++mReleaseCount;
+	}
+}
+
+void TextureManager::evict_( std::unordered_map<std::string, Entry_>::iterator aIt )
+{
+	auto const& entry = aIt->second;
+	assert( 0 == entry.refs );
+
+	glDeleteTextures( 1, &entry.texture );
+	mBytesPerFormat[std::size_t(entry.format)] -= entry.bytes;
+	mUnusedBytes -= entry.bytes;
+
+	mEntries.erase( aIt );
+}
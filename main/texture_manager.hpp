@@ -0,0 +1,168 @@
+#ifndef TEXTURE_MANAGER_HPP_A41E6F03_7C2D_4B95_8E1A_5D930C7B26F8
+#define TEXTURE_MANAGER_HPP_A41E6F03_7C2D_4B95_8E1A_5D930C7B26F8
+
+#include <glad/glad.h>
+
+#include <map>
+#include <array>
+#include <string>
+#include <compare>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "texture.hpp"
+#include "texture_cache.hpp"
+
+// Sampler state of a texture handle. The defaults match
+// configure_texture_sampler().
+struct SamplerState
+{
+	GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLenum magFilter = GL_LINEAR;
+	GLenum wrapS = GL_REPEAT;
+	GLenum wrapT = GL_REPEAT;
+	float maxAnisotropy = 6.f;
+
+	auto operator<=> (SamplerState const&) const = default;
+};
+
+struct TextureManagerConfig
+{
+	// Textures that are no longer referenced stay resident (so that they
+	// can be handed out again without reloading) until their total size
+	// exceeds this. Least recently released textures are evicted first.
+	std::uint64_t unusedBudget = 64ull << 20;
+};
+
+class TextureManager;
+
+// Shared reference to a texture owned by a TextureManager. Copying a handle
+// adds a reference. Handles must not outlive their manager.
+class TextureHandle final
+{
+	public:
+		TextureHandle() noexcept = default;
+		~TextureHandle();
+
+		TextureHandle( TextureHandle const& ) noexcept;
+		TextureHandle& operator= (TextureHandle const&) noexcept;
+
+		TextureHandle( TextureHandle&& ) noexcept;
+		TextureHandle& operator= (TextureHandle&&) noexcept;
+
+	public:
+		explicit operator bool() const noexcept;
+
+		GLuint texture() const noexcept;
+
+		// Sampler object, or zero for the default SamplerState (whose state
+		// is already set on the texture itself).
+		GLuint sampler() const noexcept;
+
+		// Bind the texture and sampler to texture unit aUnit
+		void bind( GLuint aUnit ) const;
+
+	private:
+		friend class TextureManager;
+		struct Entry_;
+
+		TextureHandle( TextureManager*, Entry_*, GLuint aSampler ) noexcept;
+
+		void release_() noexcept;
+
+		TextureManager* mManager = nullptr;
+		Entry_* mEntry = nullptr;
+		GLuint mSampler = 0;
+};
+
+struct TextureHandle::Entry_
+{
+	GLuint texture = 0;
+	TextureFileFormat format;
+	std::uint64_t bytes = 0;
+
+	std::size_t refs = 0;
+	std::uint64_t releasedAt = 0; // for eviction order
+};
+
+/* Texture deduplication and residency tracking
+ *
+ * Textures are keyed by their (normalized) path: however often a path is
+ * acquired, there is a single GL texture. Handles additionally carry a
+ * sampler state; sampler objects are shared between all handles with the same
+ * state, so different sampler states do not duplicate the texture.
+ *
+ * Textures are reference counted by their handles. A texture whose last
+ * handle is released is not deleted right away, but kept until collect()
+ * finds the unused textures over budget (lazy eviction).
+ *
+ * All methods require the GL context to be current.
+ */
+class TextureManager final
+{
+	public:
+		explicit TextureManager( TextureManagerConfig const& = {} );
+		~TextureManager();
+
+		TextureManager( TextureManager const& ) = delete;
+		TextureManager& operator= (TextureManager const&) = delete;
+
+	public:
+		// Texture for aPath, loaded with load_texture_2d() if it is not
+		// resident. Throws Error if the texture cannot be loaded.
+		TextureHandle acquire( char const* aPath, SamplerState const& = {} );
+
+		// As above, but on a miss, the texture is created from aSource (the
+		// result of read_texture_2d( aPath ), e.g., from an AssetLoader).
+		TextureHandle acquire( char const* aPath, SamplerState const&, TextureSource const& aSource );
+
+		bool contains( char const* aPath ) const;
+
+		// Evict unused textures until they fit into the unused budget
+		void collect();
+
+		// Delete all unused textures
+		void evict_unused();
+
+		// GPU memory of resident textures, including unused ones that have
+		// not been evicted yet.
+		std::uint64_t resident_bytes() const noexcept;
+		std::uint64_t resident_bytes( TextureFileFormat ) const noexcept;
+		std::uint64_t unused_bytes() const noexcept;
+		std::size_t resident_count() const noexcept;
+
+		// Account for the GPU memory of a texture that is owned elsewhere
+		// (e.g., by a TextureStreamer), so that the totals above include it.
+		// Resident counts only the textures owned by the manager.
+		void add_external_bytes( TextureFileFormat, std::uint64_t aBytes ) noexcept;
+		void remove_external_bytes( TextureFileFormat, std::uint64_t aBytes ) noexcept;
+
+		// Print a note with the residency stats
+		void print_stats() const;
+
+	private:
+		friend class TextureHandle;
+		using Entry_ = TextureHandle::Entry_;
+
+		TextureHandle make_handle_( Entry_&, SamplerState const& );
+		GLuint sampler_( SamplerState const& );
+
+		void add_ref_( Entry_& ) noexcept;
+		void release_( Entry_& ) noexcept;
+		void evict_( std::unordered_map<std::string, Entry_>::iterator );
+
+		TextureManagerConfig mConfig;
+
+		std::unordered_map<std::string, Entry_> mEntries;
+		std::map<SamplerState, GLuint> mSamplers;
+
+		// Indexed by TextureFileFormat
+		static constexpr std::size_t kFormatCount_ = std::size_t(TextureFileFormat::bc7_srgb) + 1;
+		std::array<std::uint64_t, kFormatCount_> mBytesPerFormat{};
+		std::uint64_t mUnusedBytes = 0;
+		std::uint64_t mReleaseCount = 0;
+};
+
+#endif // TEXTURE_MANAGER_HPP_A41E6F03_7C2D_4B95_8E1A_5D930C7B26F8
@@ -0,0 +1,226 @@
+#include "texture_streamer.hpp"
+
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+
+#include "texture.hpp"
+#include "texture_manager.hpp"
+
+TextureStreamer::TextureStreamer( std::shared_ptr<TextureFile const> aFile, TextureStreamerConfig const& aConfig, TextureManager* aAccounting )
+	: mFile( std::move(aFile) )
+	, mUploadFormat( texture_upload_format( mFile->header.format ) )
+	, mAccounting( aAccounting )
+{
+	auto const& levels = mFile->levels;
+	assert( !levels.empty() );
+
+	auto const upload_bytes_ = [&] ( std::uint32_t aLevel ) {
+		return texture_level_bytes( mUploadFormat, levels[aLevel].width, levels[aLevel].height );
+	};
+
+	// Finest level such that it and all coarser levels fit into the budget.
+	// The coarsest level is always allowed.
+	auto const levelCount = std::uint32_t(levels.size());
+	mFinestAllowed = levelCount - 1;
+
+	std::uint64_t total = upload_bytes_( mFinestAllowed );
+	while( mFinestAllowed > 0 && total + upload_bytes_( mFinestAllowed-1 ) <= aConfig.memoryBudget )
+		total += upload_bytes_( --mFinestAllowed );
+
+	// The mip tail is uploaded right away
+	std::uint32_t first = levelCount - 1;
+	while( first > mFinestAllowed && std::max( levels[first-1].width, levels[first-1].height ) <= aConfig.residentTailSize )
+		--first;
+
+	glGenTextures(1, &mTexture);
+	glBindTexture(GL_TEXTURE_2D, mTexture);
+
+	std::vector<std::byte> staging;
+	for( std::uint32_t i = first; i < levelCount; ++i )
+	{
+		staging.resize( std::size_t(upload_bytes_( i )) );
+		stage_texture_level( levels[i], mFile->header.format, mUploadFormat, staging.data() );
+		specify_texture_level( mUploadFormat, GLint(i), levels[i].width, levels[i].height, staging.data() );
+		account_( staging.size() );
+	}
+
+	// Levels below the base level are left unspecified
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(first));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levelCount - 1));
+	configure_texture_sampler();
+
+	mResidentLevel = first;
+
+	mThread = std::thread( [this] { stager_(); } );
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard lock( mMutex );
+		mStop = true;
+	}
+	mWake.notify_all();
+	mThread.join();
+
+	if( mPbo )
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbo);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &mPbo);
+	}
+
+	glDeleteTextures(1, &mTexture);
+
+	if( mAccounting )
+		mAccounting->remove_external_bytes( mUploadFormat, mResidentBytes );
+}
+
+GLuint TextureStreamer::texture() const noexcept
+{
+	return mTexture;
+}
+
+std::uint32_t TextureStreamer::width() const noexcept
+{
+	return mFile->header.width;
+}
+std::uint32_t TextureStreamer::height() const noexcept
+{
+	return mFile->header.height;
+}
+
+void TextureStreamer::update( float aRequiredLod )
+{
+	finish_level_();
+
+	auto const lastLevel = std::uint32_t(mFile->levels.size() - 1);
+	auto const target = std::uint32_t(std::clamp( std::floor( aRequiredLod ), float(mFinestAllowed), float(lastLevel) ));
+
+	if( !mPbo && mResidentLevel > target )
+		begin_level_( mResidentLevel - 1 );
+}
+
+std::uint32_t TextureStreamer::resident_level() const noexcept
+{
+	return mResidentLevel;
+}
+std::uint64_t TextureStreamer::resident_bytes() const noexcept
+{
+	return mResidentBytes;
+}
+
+void TextureStreamer::begin_level_( std::uint32_t aLevel )
+{
+	assert( !mPbo );
+
+	auto const& level = mFile->levels[aLevel];
+	auto const bytes = texture_level_bytes( mUploadFormat, level.width, level.height );
+
+	glGenBuffers(1, &mPbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(bytes), nullptr, GL_STREAM_DRAW);
+	void* target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if( !target )
+	{
+		glDeleteBuffers(1, &mPbo);
+		mPbo = 0;
+		return;
+	}
+
+	{
+		std::lock_guard lock( mMutex );
+		mStagingTarget = static_cast<std::byte*>(target);
+		mStagingLevel = aLevel;
+		mStaged = false;
+	}
+	mWake.notify_one();
+}
+
+void TextureStreamer::finish_level_()
+{
+	if( !mPbo )
+		return;
+
+	std::uint32_t levelIndex;
+	{
+		std::lock_guard lock( mMutex );
+		if( !mStaged )
+			return;
+
+		mStaged = false;
+		levelIndex = mStagingLevel;
+	}
+
+	auto const& level = mFile->levels[levelIndex];
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPbo);
+	bool const intact = GL_TRUE == glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	// If the buffer contents were lost (which the GL may do, e.g., on a
+	// mode switch), the level is requested again by the next update().
+	if( intact )
+	{
+		// (Leaves the texture bound to GL_TEXTURE_2D of the active unit.)
+		glBindTexture(GL_TEXTURE_2D, mTexture);
+		specify_texture_level( mUploadFormat, GLint(levelIndex), level.width, level.height, nullptr );
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(levelIndex));
+
+		mResidentLevel = levelIndex;
+		account_( texture_level_bytes( mUploadFormat, level.width, level.height ) );
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// The GL keeps the buffer alive until the upload has completed
+	glDeleteBuffers(1, &mPbo);
+	mPbo = 0;
+}
+
+void TextureStreamer::stager_()
+{
+	while( true )
+	{
+		std::byte* target;
+		std::uint32_t level;
+		{
+			std::unique_lock lock( mMutex );
+			mWake.wait( lock, [this] { return mStop || mStagingTarget; } );
+
+			if( mStop )
+				return;
+
+			target = mStagingTarget;
+			level = mStagingLevel;
+		}
+
+		// Reading the mapped file pages the level in; this is where the disk
+		// I/O happens.
+		stage_texture_level( mFile->levels[level], mFile->header.format, mUploadFormat, target );
+
+		{
+			std::lock_guard lock( mMutex );
+			mStagingTarget = nullptr;
+			mStaged = true;
+		}
+	}
+}
+
+void TextureStreamer::account_( std::uint64_t aBytes ) noexcept
+{
+	mResidentBytes += aBytes;
+	if( mAccounting )
+		mAccounting->add_external_bytes( mUploadFormat, aBytes );
+}
+
+float required_texture_lod( float aTexelsPerUnit, float aPixelsPerUnit ) noexcept
+{
+	return std::log2( std::max( aTexelsPerUnit / aPixelsPerUnit, 1e-6f ) );
+}
@@ -0,0 +1,103 @@
+#ifndef TEXTURE_STREAMER_HPP_2D7A51C8_94E3_4B06_A1F5_6C0E8B3D92A7
+#define TEXTURE_STREAMER_HPP_2D7A51C8_94E3_4B06_A1F5_6C0E8B3D92A7
+
+#include <glad/glad.h>
+
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "texture_cache.hpp"
+
+class TextureManager;
+
+struct TextureStreamerConfig
+{
+	// Upper bound for the texture's GPU memory. The finest levels that do
+	// not fit are never loaded.
+	std::uint64_t memoryBudget = 64ull << 20;
+
+	// Levels up to this size (largest dimension, in texels) are uploaded
+	// when the streamer is created, so the texture is usable right away.
+	std::uint32_t residentTailSize = 64;
+};
+
+/* Progressive streaming of a texture file's mip levels (see
+ * texture_cache.hpp).
+ *
+ * The texture is created with only its mip tail. Finer levels are loaded
+ * one at a time, coarsest first, down to the level that update() asks for:
+ * the GL thread maps a pixel unpack buffer (PBO), a background thread copies
+ * the level from the texture file into it (paging it in from disk, and
+ * decoding it if needed), and the next update() specifies the level from the
+ * PBO. GL_TEXTURE_BASE_LEVEL is advanced as levels arrive, so the texture
+ * is complete and usable at all times. (GL_TEXTURE_MIN_LOD is left alone:
+ * the LOD is relative to the base level, so clamping it as well would skip
+ * the finest loaded level.)
+ *
+ * Levels are specified individually (mutable storage), so GPU memory is only
+ * used for the levels that have been loaded. If a TextureManager is given,
+ * the loaded levels are included in its resident bytes.
+ */
+class TextureStreamer final
+{
+	public:
+		// Requires a current GL context. aAccounting (optional) must outlive
+		// the streamer.
+		explicit TextureStreamer( std::shared_ptr<TextureFile const>, TextureStreamerConfig const& = {}, TextureManager* aAccounting = nullptr );
+		~TextureStreamer();
+
+		TextureStreamer( TextureStreamer const& ) = delete;
+		TextureStreamer& operator= (TextureStreamer const&) = delete;
+
+	public:
+		GLuint texture() const noexcept;
+
+		std::uint32_t width() const noexcept;  // of level 0
+		std::uint32_t height() const noexcept;
+
+		// Continue streaming towards level floor(aRequiredLod). Call once per
+		// frame, with the GL context current.
+		void update( float aRequiredLod );
+
+		std::uint32_t resident_level() const noexcept; // finest loaded level
+		std::uint64_t resident_bytes() const noexcept;
+
+	private:
+		void begin_level_( std::uint32_t aLevel );
+		void finish_level_();
+
+		void stager_();
+
+		void account_( std::uint64_t aBytes ) noexcept;
+
+		std::shared_ptr<TextureFile const> mFile;
+		TextureFileFormat mUploadFormat;
+
+		GLuint mTexture = 0;
+		std::uint32_t mFinestAllowed = 0; // from the memory budget
+		std::uint32_t mResidentLevel = 0;
+		std::uint64_t mResidentBytes = 0;
+
+		TextureManager* mAccounting;
+
+		GLuint mPbo = 0; // level in flight, if any
+
+		std::thread mThread;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::byte* mStagingTarget = nullptr; // guarded by mMutex
+		std::uint32_t mStagingLevel = 0;     // guarded by mMutex
+		bool mStaged = false;                // guarded by mMutex
+		bool mStop = false;                  // guarded by mMutex
+};
+
+// Mip level at which aTexelsPerUnit texels (per world unit) project to one
+// texel per pixel, if a world unit covers aPixelsPerUnit pixels.
+float required_texture_lod( float aTexelsPerUnit, float aPixelsPerUnit ) noexcept;
+
+#endif // TEXTURE_STREAMER_HPP_2D7A51C8_94E3_4B06_A1F5_6C0E8B3D92A7
@@ -0,0 +1,117 @@
+#include "vertex_format.hpp"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+
+#include "../support/error.hpp"
+
+void check_vertex_inputs( GLuint aProgram, std::span<GLuint const> aLocations, char const* aProgramName )
+{
+	GLint inputCount = 0;
+	glGetProgramInterfaceiv( aProgram, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &inputCount );
+
+	std::string missing;
+	for( GLint i = 0; i < inputCount; ++i )
+	{
+		GLenum const props[] = { GL_LOCATION, GL_NAME_LENGTH };
+		GLint values[2] = { -1, 0 };
+		glGetProgramResourceiv( aProgram, GL_PROGRAM_INPUT, GLuint(i), 2, props, 2, nullptr, values );
+
+		// Built-in inputs (gl_VertexID etc) have no location
+		if( values[0] < 0 )
+			continue;
+
+		if( std::find( aLocations.begin(), aLocations.end(), GLuint(values[0]) ) != aLocations.end() )
+			continue;
+
+		std::vector<char> name( std::size_t(std::max(values[1], 1)), '\0' );
+		glGetProgramResourceName( aProgram, GL_PROGRAM_INPUT, GLuint(i), GLsizei(name.size()), nullptr, name.data() );
+
+		if( !missing.empty() )
+			missing += ", ";
+		missing += name.data();
+		missing += " (location " + std::to_string( values[0] ) + ")";
+	}
+
+	if( !missing.empty() )
+		throw Error( "Program '{}' expects vertex inputs that the vertex layout does not provide: {}", aProgramName, missing );
+}
+
+
+Mat44f dequant_matrix( PositionDequant const& aDequant ) noexcept
+{
+	return make_translation( aDequant.offset ) * make_scaling( aDequant.scale );
+}
+
+PositionDequant make_position_dequant( Vec3f aMin, Vec3f aMax ) noexcept
+{
+	auto const half_extent_ = [] ( float aLo, float aHi ) {
+		auto const h = 0.5f * (aHi - aLo);
+		return h > 0.f ? h : 1.f;
+	};
+
+	PositionDequant ret;
+	ret.offset = 0.5f * (aMin + aMax);
+	ret.scale = Vec3f{ half_extent_( aMin.x, aMax.x ), half_extent_( aMin.y, aMax.y ), half_extent_( aMin.z, aMax.z ) };
+	return ret;
+}
+
+std::array<std::int16_t, 3> quantize_position( Vec3f aPosition, PositionDequant const& aDequant ) noexcept
+{
+	auto const snorm16_ = [] ( float aValue ) {
+		return std::int16_t(std::lround( std::clamp( aValue, -1.f, 1.f ) * 32767.f ));
+	};
+
+	auto const p = aPosition - aDequant.offset;
+	return { snorm16_( p.x / aDequant.scale.x ), snorm16_( p.y / aDequant.scale.y ), snorm16_( p.z / aDequant.scale.z ) };
+}
+
+
+std::uint16_t float_to_half( float aValue ) noexcept
+{
+	std::uint32_t bits;
+	std::memcpy( &bits, &aValue, sizeof(bits) );
+
+	std::uint32_t const sign = (bits >> 16) & 0x8000u;
+	std::uint32_t const absBits = bits & 0x7fffffffu;
+
+	// NaN and infinity
+	if( absBits >= 0x7f800000u )
+		return std::uint16_t(sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0u));
+
+	// Overflow: values that round to or above 65520 become infinity
+	if( absBits >= 0x477ff000u )
+		return std::uint16_t(sign | 0x7c00u);
+
+	// Subnormal halves (and zero). Let the FPU do the rounding by adding a
+	// value that pushes the mantissa bits into place.
+	if( absBits < 0x38800000u )
+	{
+		float absValue;
+		std::memcpy( &absValue, &absBits, sizeof(absValue) );
+		float const shifted = absValue + 0.5f;
+
+		std::uint32_t shiftedBits;
+		std::memcpy( &shiftedBits, &shifted, sizeof(shiftedBits) );
+		return std::uint16_t(sign | (shiftedBits - 0x3f000000u));
+	}
+
+	// Normal halves: rebias the exponent and round to nearest even
+	std::uint32_t const oddMantissa = (absBits >> 13) & 1u;
+	std::uint32_t const rounded = absBits + 0xc8000fffu + oddMantissa; // 0xc8000000 = (15-127) << 23
+	return std::uint16_t(sign | (rounded >> 13));
+}
+
+std::uint32_t pack_snorm_2_10_10_10( Vec3f aValue ) noexcept
+{
+	auto const pack_ = [] ( float aX ) {
+		auto const q = std::int32_t(std::lround( std::clamp( aX, -1.f, 1.f ) * 511.f ));
+		return std::uint32_t(q) & 0x3ffu;
+	};
+
+	return pack_( aValue.x ) | (pack_( aValue.y ) << 10) | (pack_( aValue.z ) << 20);
+}
@@ -0,0 +1,174 @@
+#ifndef VERTEX_FORMAT_HPP_5B8C2E17_94D0_4A6B_B3F1_0E7A6C4D29F8
+#define VERTEX_FORMAT_HPP_5B8C2E17_94D0_4A6B_B3F1_0E7A6C4D29F8
+
+#include <glad/glad.h>
+
+#include <span>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+/* Compile-time vertex layouts
+ *
+ * A VertexLayout describes an interleaved vertex struct: for each attribute,
+ * the shader input location, the GL component type and count, and the offset
+ * and size of the corresponding C++ member. The attribute pointers are
+ * derived from this single description (VertexLayout::apply()), and
+ * static_asserts check that each member's size matches its GL type, that
+ * attributes do not overlap, and that locations are unique.
+ *
+ * check_vertex_inputs() closes the loop on the shader side: it verifies that
+ * every active vertex input of a linked program is provided by the layout.
+ */
+
+// How the shader sees an attribute's values
+enum class AttribMode
+{
+	value,      // converted to float as-is (e.g. GL_FLOAT, GL_HALF_FLOAT)
+	normalized, // integer mapped to [0,1] or [-1,1]
+	integer     // integer input (glVertexAttribIPointer)
+};
+
+// Size in bytes of an attribute with the given GL type and component count
+constexpr std::size_t attrib_size( GLenum aType, GLint aComponents ) noexcept
+{
+	switch( aType )
+	{
+		case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT:
+			return 4 * std::size_t(aComponents);
+		case GL_HALF_FLOAT: case GL_SHORT: case GL_UNSIGNED_SHORT:
+			return 2 * std::size_t(aComponents);
+		case GL_BYTE: case GL_UNSIGNED_BYTE:
+			return std::size_t(aComponents);
+		case GL_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_2_10_10_10_REV:
+			return 4 == aComponents ? 4 : 0;
+	}
+	return 0;
+}
+
+template< GLuint tLocation, GLenum tType, GLint tComponents, AttribMode tMode, std::size_t tOffset, std::size_t tMemberSize >
+struct VertexAttrib
+{
+	static constexpr GLuint location = tLocation;
+	static constexpr GLenum type = tType;
+	static constexpr GLint components = tComponents;
+	static constexpr AttribMode mode = tMode;
+	static constexpr std::size_t offset = tOffset;
+	static constexpr std::size_t size = tMemberSize;
+
+	static_assert( attrib_size( tType, tComponents ) == tMemberSize, "C++ member size does not match GL attribute type" );
+	static_assert( AttribMode::integer != tMode || (GL_FLOAT != tType && GL_HALF_FLOAT != tType), "Integer attributes need an integer type" );
+};
+
+template< typename tVertex, typename... tAttribs >
+struct VertexLayout
+{
+	using Vertex = tVertex;
+
+	static constexpr std::size_t stride = sizeof(tVertex);
+	static constexpr std::array<GLuint, sizeof...(tAttribs)> locations{ tAttribs::location... };
+
+	static_assert( ((tAttribs::offset + tAttribs::size <= stride) && ...), "Attribute extends past the end of the vertex" );
+	static_assert( []{
+		std::array<std::size_t, sizeof...(tAttribs)> const begins{ tAttribs::offset... };
+		std::array<std::size_t, sizeof...(tAttribs)> const ends{ (tAttribs::offset + tAttribs::size)... };
+		for( std::size_t i = 0; i < locations.size(); ++i )
+		{
+			for( std::size_t j = i+1; j < locations.size(); ++j )
+			{
+				if( locations[i] == locations[j] )
+					return false;
+				if( begins[i] < ends[j] && begins[j] < ends[i] )
+					return false;
+			}
+		}
+		return true;
+	}(), "Attributes must have unique locations and must not overlap" );
+
+	// Set up the attribute pointers of the currently bound VAO to source
+	// from aBuffer.
+	static void apply( GLuint aBuffer )
+	{
+		glBindBuffer( GL_ARRAY_BUFFER, aBuffer );
+		(apply_one_<tAttribs>(), ...);
+	}
+
+	private:
+		template< typename tAttrib >
+		static void apply_one_()
+		{
+			auto const* const offset = reinterpret_cast<void const*>(tAttrib::offset);
+			if constexpr( AttribMode::integer == tAttrib::mode )
+				glVertexAttribIPointer( tAttrib::location, tAttrib::components, tAttrib::type, GLsizei(stride), offset );
+			else
+				glVertexAttribPointer( tAttrib::location, tAttrib::components, tAttrib::type, AttribMode::normalized == tAttrib::mode ? GL_TRUE : GL_FALSE, GLsizei(stride), offset );
+
+			glEnableVertexAttribArray( tAttrib::location );
+		}
+};
+
+// Throws Error if the program has an active vertex input at a location that
+// is not in aLocations. aProgramName is used in the error message.
+void check_vertex_inputs( GLuint aProgram, std::span<GLuint const> aLocations, char const* aProgramName );
+
+template< typename tLayout >
+void check_vertex_inputs( GLuint aProgram, char const* aProgramName )
+{
+	check_vertex_inputs( aProgram, tLayout::locations, aProgramName );
+}
+
+
+/* Packed vertex format (16 bytes, down from 56 for the separate streams)
+ *
+ *  - position: snorm16 x3, relative to the mesh's bounding box; see
+ *    PositionDequant
+ *  - material: uint16 index into the mesh's material table (material.hpp)
+ *  - normal:   snorm 2_10_10_10 (w unused)
+ *  - texcoord: half float x2
+ *
+ * Shader inputs use the same locations as the separate streams.
+ */
+struct PackedVertex
+{
+	std::int16_t position[3];
+	std::uint16_t material;
+	std::uint32_t normal;
+	std::uint16_t texcoord[2];
+};
+
+static_assert( 16 == sizeof(PackedVertex) );
+
+using PackedVertexLayout = VertexLayout< PackedVertex,
+	VertexAttrib< 0, GL_SHORT, 3, AttribMode::normalized, offsetof(PackedVertex, position), sizeof(PackedVertex::position) >,
+	VertexAttrib< 1, GL_UNSIGNED_SHORT, 1, AttribMode::integer, offsetof(PackedVertex, material), sizeof(PackedVertex::material) >,
+	VertexAttrib< 2, GL_INT_2_10_10_10_REV, 4, AttribMode::normalized, offsetof(PackedVertex, normal), sizeof(PackedVertex::normal) >,
+	VertexAttrib< 3, GL_HALF_FLOAT, 2, AttribMode::value, offsetof(PackedVertex, texcoord), sizeof(PackedVertex::texcoord) >
+>;
+
+// Maps quantized positions (in [-1,1]) back to model space:
+//   position = offset + scale * quantized
+struct PositionDequant
+{
+	Vec3f offset{ 0.f, 0.f, 0.f };
+	Vec3f scale{ 1.f, 1.f, 1.f };
+};
+
+// Matrix form of PositionDequant. Multiply into the model matrix (but not
+// into the normal matrix!) when drawing packed meshes.
+Mat44f dequant_matrix( PositionDequant const& ) noexcept;
+
+// PositionDequant that maps [-1,1] onto the box [aMin, aMax]
+PositionDequant make_position_dequant( Vec3f aMin, Vec3f aMax ) noexcept;
+
+// Quantized (snorm16) position of aPosition, which must be inside the box of
+// aDequant. Equal positions and dequants give bit-identical results.
+std::array<std::int16_t, 3> quantize_position( Vec3f aPosition, PositionDequant const& aDequant ) noexcept;
+
+// Encoding helpers
+std::uint16_t float_to_half( float ) noexcept;
+std::uint32_t pack_snorm_2_10_10_10( Vec3f ) noexcept;
+
+#endif // VERTEX_FORMAT_HPP_5B8C2E17_94D0_4A6B_B3F1_0E7A6C4D29F8
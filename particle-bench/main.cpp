@@ -0,0 +1,255 @@
+// Micro-benchmark: particle spawn + update + packing, array-of-structs (the
+// loops ParticleSystem used before particle_kernels.hpp) vs. the dense
+// structure-of-arrays ParticleSimulation, and the latter's scaling with the
+// number of threads.
+//
+// Usage: particle-bench [frames]
+//
+// Each case emits a fixed number of particles per frame into a pool of the
+// given capacity, and reports the time per frame once the number of live
+// particles has settled.
+
+#include <print>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+#include <typeinfo>
+#include <algorithm>
+#include <exception>
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+#include "../support/thread_pool.hpp"
+
+#include "../main/particle_kernels.hpp"
+#include "../main/particle_simulation.hpp"
+
+namespace
+{
+	using Clock_ = std::chrono::steady_clock;
+
+	constexpr float kDt_ = 1.f / 60.f;
+
+	// Frames simulated before timing starts, so that the live count has
+	// reached its steady state (particles live 1-1.5 s)
+	constexpr std::size_t kWarmupFrames_ = 120;
+
+	struct Particle_
+	{
+		Vec3f position;
+		Vec3f velocity;
+		float life = -1.f;
+		float maxLife = 1.f;
+	};
+
+	// New particles for one frame. Both versions draw from the same sequence,
+	// so they simulate exactly the same particles.
+	struct Spawner_
+	{
+		std::mt19937 rng{ 1234 };
+		std::uniform_real_distribution<float> dir{ -1.f, 1.f };
+		std::uniform_real_distribution<float> life{ 1.f, 1.5f };
+
+		template< class tFn >
+		void operator() ( std::size_t aCount, tFn&& aSpawn )
+		{
+			for( std::size_t i = 0; i < aCount; ++i )
+			{
+				float const l = life( rng );
+				float const vx = dir( rng ), vz = dir( rng );
+				if( !aSpawn( Vec3f{ 0.f, 10.f, 0.f }, Vec3f{ vx, -3.f, vz }, l ) )
+					break;
+			}
+		}
+	};
+
+	struct Result_
+	{
+		double nsPerFrame;
+		double averageLive;
+	};
+
+	// ParticleSystem before particle_kernels.hpp: array-of-structs, spawning
+	// by searching for dead slots, updating and packing all slots
+	Result_ bench_aos_( std::size_t aCapacity, std::size_t aSpawnPerFrame, std::size_t aFrames )
+	{
+		std::vector<Particle_> particles( aCapacity );
+		std::vector<float> out( aCapacity * kPackedParticleFloats );
+
+		Spawner_ spawner;
+		std::size_t liveTotal = 0;
+		Clock_::time_point t0;
+
+		for( std::size_t frame = 0; frame < kWarmupFrames_ + aFrames; ++frame )
+		{
+			if( kWarmupFrames_ == frame )
+				t0 = Clock_::now();
+
+			std::size_t next = 0;
+			spawner( aSpawnPerFrame, [&] (Vec3f aPos, Vec3f aVel, float aLife) {
+				for( ; next < particles.size(); ++next )
+				{
+					if( particles[next].life < 0.f )
+					{
+						particles[next] = Particle_{ aPos, aVel, aLife, aLife };
+						return true;
+					}
+				}
+				return false;
+			} );
+
+			for( auto& p : particles )
+			{
+				if( p.life > 0.f )
+				{
+					p.position += p.velocity * kDt_;
+					p.life -= kDt_;
+				}
+			}
+
+			float* gpuData = out.data();
+			std::size_t live = 0;
+			for( auto const& p : particles )
+			{
+				if( p.life > 0.f )
+				{
+					gpuData[0] = p.position.x;
+					gpuData[1] = p.position.y;
+					gpuData[2] = p.position.z;
+					gpuData[3] = p.life / p.maxLife;
+					gpuData += kPackedParticleFloats;
+					++live;
+				}
+			}
+
+			if( frame >= kWarmupFrames_ )
+				liveTotal += live;
+		}
+
+		auto const t1 = Clock_::now();
+		return { std::chrono::duration<double, std::nano>(t1-t0).count() / aFrames, double(liveTotal) / aFrames };
+	}
+
+	// ParticleSystem now: dense structure-of-arrays pool, updated in parallel
+	// chunks. Without a pool, everything is a single chunk, which runs on the
+	// calling thread only. Also returns a hash of the packed particles of the
+	// last frame.
+	Result_ bench_soa_( std::size_t aCapacity, std::size_t aSpawnPerFrame, std::size_t aFrames, ThreadPool* aPool, std::uint64_t& aHash )
+	{
+		ParticleSimulationConfig config{ .capacity = aCapacity, .seed = 1234 };
+		if( !aPool )
+			config.chunkSize = aCapacity;
+
+		ParticleSimulation sim( config, aPool );
+		sim.add_emitter( { .position = { 0.f, 10.f, 0.f }, .spawnPerSecond = float(aSpawnPerFrame) / kDt_ } );
+
+		std::vector<float> out( sim.capacity() * kPackedParticleFloats );
+
+		std::size_t liveTotal = 0;
+		Clock_::time_point t0;
+
+		for( std::size_t frame = 0; frame < kWarmupFrames_ + aFrames; ++frame )
+		{
+			if( kWarmupFrames_ == frame )
+				t0 = Clock_::now();
+
+			sim.update( kDt_, out.data() );
+
+			if( frame >= kWarmupFrames_ )
+				liveTotal += sim.packed_count();
+		}
+
+		auto const t1 = Clock_::now();
+
+		// FNV-1a over the packed ranges
+		aHash = 14695981039346656037ull;
+		auto const firsts = sim.packed_firsts();
+		auto const counts = sim.packed_counts();
+		for( std::size_t i = 0; i < counts.size(); ++i )
+		{
+			auto const* bytes = reinterpret_cast<unsigned char const*>(out.data() + std::size_t(firsts[i]) * kPackedParticleFloats);
+			for( std::size_t j = 0; j < std::size_t(counts[i]) * kPackedParticleFloats * sizeof(float); ++j )
+				aHash = (aHash ^ bytes[j]) * 1099511628211ull;
+		}
+
+		return { std::chrono::duration<double, std::nano>(t1-t0).count() / aFrames, double(liveTotal) / aFrames };
+	}
+}
+
+int main( int aArgc, char* aArgv[] ) try
+{
+	std::size_t const frames = aArgc > 1 ? std::stoul( aArgv[1] ) : 1000;
+
+	struct Case_
+	{
+		std::size_t capacity;
+		std::size_t spawnPerFrame;
+	};
+
+	// The last cases have a pool sized for a peak that is rarely reached
+	Case_ const cases[] = {
+		{ 1000, 2 },               // ParticleSystem's defaults
+		{ 100'000, 1000 },
+		{ 1'000'000, 10'000 },
+		{ 100'000, 50 },
+		{ 1'000'000, 500 }
+	};
+
+	// Single thread: AoS vs SoA
+	std::print( "{:>10} {:>10} {:>14} {:>14} {:>8}\n", "capacity", "live", "AoS (us/frame)", "SoA (us/frame)", "speedup" );
+
+	for( auto const& c : cases )
+	{
+		std::uint64_t hash = 0;
+		auto const aos = bench_aos_( c.capacity, c.spawnPerFrame, frames );
+		auto const soa = bench_soa_( c.capacity, c.spawnPerFrame, frames, nullptr, hash );
+
+		std::print( "{:>10} {:>10.0f} {:>14.2f} {:>14.2f} {:>7.2f}x\n", c.capacity, soa.averageLive, aos.nsPerFrame / 1000.0, soa.nsPerFrame / 1000.0, aos.nsPerFrame / soa.nsPerFrame );
+	}
+
+	// Thread scaling of the largest case. The results must not depend on
+	// the number of threads.
+	std::size_t const capacity = 4'000'000, spawnPerFrame = 40'000;
+	std::size_t const maxThreads = std::max( 1u, std::thread::hardware_concurrency() );
+
+	std::print( "\n{:>10} {:>10} {:>14} {:>8}\n", "threads", "live", "SoA (us/frame)", "speedup" );
+
+	double baseline = 0.0;
+	std::uint64_t baselineHash = 0;
+	for( std::size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min( threads*2, maxThreads ) : threads+1 )
+	{
+		// (The calling thread works as well. A pool with zero threads would get
+		// one per hardware thread, so one thread is handled separately.)
+		std::unique_ptr<ThreadPool> pool;
+		if( threads > 1 )
+			pool = std::make_unique<ThreadPool>( threads-1 );
+
+		std::uint64_t hash = 0;
+		auto const soa = bench_soa_( capacity, spawnPerFrame, frames / 10 + 1, pool.get(), hash );
+
+		if( 1 == threads )
+		{
+			baseline = soa.nsPerFrame;
+			baselineHash = hash;
+		}
+		else if( hash != baselineHash )
+			std::print( "Warning: results with {} threads differ from 1 thread\n", threads );
+
+		std::print( "{:>10} {:>10.0f} {:>14.2f} {:>7.2f}x\n", threads, soa.averageLive, soa.nsPerFrame / 1000.0, baseline / soa.nsPerFrame );
+	}
+
+	return 0;
+}
+catch( std::exception const& eErr )
+{
+	std::print( stderr, "Top-level Exception ({}):\n", typeid(eErr).name() );
+	std::print( stderr, "{}\n", eErr.what() );
+	return 1;
+}
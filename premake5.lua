@@ -135,6 +135,65 @@ project "vmlib-test"
 
 	links "x-catch2"
 
+project "asset-baker"
+	local sources = { 
+		"asset-baker/**.cpp",
+		"asset-baker/**.hpp",
+		"asset-baker/**.hxx",
+		"asset-baker/**.inl"
+	}
+
+	kind "ConsoleApp"
+	location "asset-baker"
+
+	files( sources )
+
+	-- The baker reuses the runtime's loaders and file formats, so that baked
+	-- files are guaranteed to match what "main" expects.
+	files {
+		"main/loadobj.cpp",
+		"main/simple_mesh.cpp",
+		"main/vertex_format.cpp",
+		"main/material.cpp",
+		"main/mesh_optimize.cpp",
+		"main/mesh_simplify.cpp",
+		"main/mesh_lod.cpp",
+		"main/mesh_cache.cpp",
+		"main/terrain_tiles.cpp",
+		"main/baked_assets.cpp",
+		"main/texture.cpp",
+		"main/texture_cache.cpp",
+		"main/texture_compress.cpp"
+	}
+
+	dependson "x-rapidobj"
+
+	links "vmlib"
+	links "support"
+
+	links "x-stb"
+	links "x-glad"
+
+project "particle-bench"
+	local sources = { 
+		"particle-bench/**.cpp",
+		"particle-bench/**.hpp"
+	}
+
+	kind "ConsoleApp"
+	location "particle-bench"
+
+	files( sources )
+
+	-- Benchmarks the runtime's particle simulation against an AoS version
+	files {
+		"main/particle_kernels.cpp",
+		"main/particle_simulation.cpp"
+	}
+
+	links "vmlib"
+	links "support"
+
 project "support"
 	local sources = { 
 		"support/**.cpp",
@@ -0,0 +1,168 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#include "error.hpp"
+
+MappedFile::MappedFile() noexcept
+	: mData( nullptr )
+	, mSize( 0 )
+#	if defined(_WIN32)
+	, mMapping( nullptr )
+#	endif
+{}
+
+#if defined(_WIN32)
+MappedFile::MappedFile( char const* aPath )
+	: MappedFile()
+{
+	HANDLE file = CreateFileA( aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if( INVALID_HANDLE_VALUE == file )
+		throw Error( "MappedFile: unable to open '{}' ({})", aPath, GetLastError() );
+
+	LARGE_INTEGER size{};
+	if( !GetFileSizeEx( file, &size ) )
+	{
+		auto const err = GetLastError();
+		CloseHandle( file );
+		throw Error( "MappedFile: unable to query size of '{}' ({})", aPath, err );
+	}
+
+	mSize = std::size_t(size.QuadPart);
+	if( 0 == mSize )
+	{
+		// Empty files cannot be mapped. Treat them as an empty range.
+		CloseHandle( file );
+		return;
+	}
+
+	mMapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( file ); // the mapping keeps its own reference
+
+	if( !mMapping )
+		throw Error( "MappedFile: unable to create mapping for '{}' ({})", aPath, GetLastError() );
+
+	mData = MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 );
+	if( !mData )
+	{
+		auto const err = GetLastError();
+		CloseHandle( mMapping );
+		throw Error( "MappedFile: unable to map '{}' ({})", aPath, err );
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if( mData )
+		UnmapViewOfFile( mData );
+	if( mMapping )
+		CloseHandle( mMapping );
+}
+
+MappedFile::MappedFile( MappedFile&& aOther ) noexcept
+	: mData( std::exchange( aOther.mData, nullptr ) )
+	, mSize( std::exchange( aOther.mSize, 0 ) )
+	, mMapping( std::exchange( aOther.mMapping, nullptr ) )
+{}
+MappedFile& MappedFile::operator= (MappedFile&& aOther) noexcept
+{
+	std::swap( mData, aOther.mData );
+	std::swap( mSize, aOther.mSize );
+	std::swap( mMapping, aOther.mMapping );
+	return *this;
+}
+
+#else // POSIX
+MappedFile::MappedFile( char const* aPath )
+	: MappedFile()
+{
+	int const fd = ::open( aPath, O_RDONLY );
+	if( -1 == fd )
+		throw Error( "MappedFile: unable to open '{}'", aPath );
+
+	struct stat st{};
+	if( -1 == ::fstat( fd, &st ) )
+	{
+		::close( fd );
+		throw Error( "MappedFile: unable to stat '{}'", aPath );
+	}
+
+	mSize = std::size_t(st.st_size);
+	if( 0 == mSize )
+	{
+		// Empty files cannot be mapped. Treat them as an empty range.
+		::close( fd );
+		return;
+	}
+
+	void* ptr = ::mmap( nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+	::close( fd ); // the mapping keeps its own reference
+
+	if( MAP_FAILED == ptr )
+	{
+		mSize = 0;
+		throw Error( "MappedFile: unable to map '{}'", aPath );
+	}
+
+	mData = ptr;
+}
+
+MappedFile::~MappedFile()
+{
+	if( mData )
+		::munmap( mData, mSize );
+}
+
+MappedFile::MappedFile( MappedFile&& aOther ) noexcept
+	: mData( std::exchange( aOther.mData, nullptr ) )
+	, mSize( std::exchange( aOther.mSize, 0 ) )
+{}
+MappedFile& MappedFile::operator= (MappedFile&& aOther) noexcept
+{
+	std::swap( mData, aOther.mData );
+	std::swap( mSize, aOther.mSize );
+	return *this;
+}
+#endif // ~ POSIX
+
+std::byte const* MappedFile::data() const noexcept
+{
+	return static_cast<std::byte const*>(mData);
+}
+std::size_t MappedFile::size() const noexcept
+{
+	return mSize;
+}
+
+std::span<std::byte const> MappedFile::bytes() const noexcept
+{
+	return { data(), mSize };
+}
+
+MappedFile::operator bool() const noexcept
+{
+	return nullptr != mData;
+}
+
+void prefault_pages( std::span<std::byte const> aBytes ) noexcept
+{
+	// 4 KiB is the smallest page size on the supported platforms
+	constexpr std::size_t kPageSize = 4096;
+
+	unsigned char sum = 0;
+	for( std::size_t i = 0; i < aBytes.size(); i += kPageSize )
+		sum ^= static_cast<unsigned char>(aBytes[i]);
+
+	[[maybe_unused]] unsigned char volatile sink = sum;
+}
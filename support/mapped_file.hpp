@@ -0,0 +1,51 @@
+#ifndef MAPPED_FILE_HPP_3A0E6B1C_5D2F_4C8E_9B61_7F4E2D1A8C53
+#define MAPPED_FILE_HPP_3A0E6B1C_5D2F_4C8E_9B61_7F4E2D1A8C53
+
+#include <span>
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file.
+//
+// The mapping stays valid for the lifetime of the object. The contents are
+// paged in on demand by the OS, so data can be passed directly to e.g.
+// glBufferData() without first copying it into a std::vector.
+class MappedFile final
+{
+	public:
+		MappedFile() noexcept;
+
+		// Throws Error if the file cannot be opened or mapped.
+		explicit MappedFile( char const* aPath );
+
+		~MappedFile();
+
+		MappedFile( MappedFile const& ) = delete;
+		MappedFile& operator= (MappedFile const&) = delete;
+
+		MappedFile( MappedFile&& ) noexcept;
+		MappedFile& operator= (MappedFile&&) noexcept;
+
+	public:
+		std::byte const* data() const noexcept;
+		std::size_t size() const noexcept;
+
+		std::span<std::byte const> bytes() const noexcept;
+
+		explicit operator bool() const noexcept;
+
+	private:
+		void* mData;
+		std::size_t mSize;
+
+#		if defined(_WIN32)
+		void* mMapping;
+#		endif // ~ _WIN32
+};
+
+// Touch every page of aBytes (typically part of a mapping), so that later
+// reads do not stall on disk I/O. Used to page in data on a loader thread
+// before it is uploaded on the GL thread.
+void prefault_pages( std::span<std::byte const> aBytes ) noexcept;
+
+#endif // MAPPED_FILE_HPP_3A0E6B1C_5D2F_4C8E_9B61_7F4E2D1A8C53
@@ -0,0 +1,145 @@
+#include "stream_buffer.hpp"
+
+#include <cassert>
+
+#include "error.hpp"
+
+namespace
+{
+	// Timeout of a single glClientWaitSync(); the wait is repeated until the
+	// fence signals.
+	constexpr GLuint64 kFenceWaitNs_ = 1'000'000; // 1 ms
+}
+
+StreamBuffer::StreamBuffer( std::size_t aRegionBytes, std::size_t aRegionCount )
+	: mRegionBytes( aRegionBytes )
+	, mFences( aRegionCount, nullptr )
+	, mCurrent( aRegionCount - 1 ) // first begin_region() moves to region 0
+{
+	assert( aRegionBytes > 0 && aRegionCount > 0 );
+
+	auto const totalBytes = GLsizeiptr(aRegionBytes * aRegionCount);
+
+	glGenBuffers( 1, &mBuffer );
+	glBindBuffer( GL_ARRAY_BUFFER, mBuffer );
+
+	if( GLAD_GL_VERSION_4_4 )
+	{
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage( GL_ARRAY_BUFFER, totalBytes, nullptr, flags );
+		mMapped = static_cast<std::byte*>(glMapBufferRange( GL_ARRAY_BUFFER, 0, totalBytes, flags ));
+
+		if( !mMapped )
+		{
+			glBindBuffer( GL_ARRAY_BUFFER, 0 );
+			glDeleteBuffers( 1, &mBuffer );
+			throw Error( "StreamBuffer: unable to map {} bytes persistently", totalBytes );
+		}
+	}
+	else
+	{
+		glBufferData( GL_ARRAY_BUFFER, totalBytes, nullptr, GL_STREAM_DRAW );
+		mStaging.resize( aRegionBytes );
+	}
+
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for( auto const fence : mFences )
+	{
+		if( fence )
+			glDeleteSync( fence );
+	}
+
+	if( mMapped )
+	{
+		glBindBuffer( GL_ARRAY_BUFFER, mBuffer );
+		glUnmapBuffer( GL_ARRAY_BUFFER );
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	}
+
+	glDeleteBuffers( 1, &mBuffer );
+}
+
+GLuint StreamBuffer::buffer() const noexcept
+{
+	return mBuffer;
+}
+
+std::size_t StreamBuffer::region_bytes() const noexcept
+{
+	return mRegionBytes;
+}
+std::size_t StreamBuffer::region_count() const noexcept
+{
+	return mFences.size();
+}
+
+std::span<std::byte> StreamBuffer::begin_region()
+{
+	if( !mMapped )
+	{
+		mCurrent = (mCurrent + 1) % mFences.size();
+		return mStaging;
+	}
+
+	// The draws reading the previous region have been issued by now; the
+	// region may be reused once the GPU has passed this point.
+	if( mFences[mCurrent] )
+		glDeleteSync( mFences[mCurrent] );
+	mFences[mCurrent] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+	mCurrent = (mCurrent + 1) % mFences.size();
+
+	if( auto& fence = mFences[mCurrent] )
+	{
+		GLenum result = glClientWaitSync( fence, 0, 0 );
+		if( GL_TIMEOUT_EXPIRED == result )
+		{
+			++mStalls;
+			do
+			{
+				result = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceWaitNs_ );
+			} while( GL_TIMEOUT_EXPIRED == result );
+		}
+
+		if( GL_WAIT_FAILED == result )
+			throw Error( "StreamBuffer: glClientWaitSync() failed" );
+
+		glDeleteSync( fence );
+		fence = nullptr;
+	}
+
+	return { mMapped + mCurrent * mRegionBytes, mRegionBytes };
+}
+
+void StreamBuffer::end_region( std::size_t aBytes )
+{
+	assert( aBytes <= mRegionBytes );
+
+	// The mapping is coherent, so writes are visible to the GPU without an
+	// explicit flush.
+	if( mMapped || 0 == aBytes )
+		return;
+
+	glBindBuffer( GL_ARRAY_BUFFER, mBuffer );
+	glBufferSubData( GL_ARRAY_BUFFER, GLintptr(region_offset()), GLsizeiptr(aBytes), mStaging.data() );
+	glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+std::size_t StreamBuffer::region_offset() const noexcept
+{
+	return mCurrent * mRegionBytes;
+}
+
+bool StreamBuffer::persistent() const noexcept
+{
+	return nullptr != mMapped;
+}
+
+std::size_t StreamBuffer::stall_count() const noexcept
+{
+	return mStalls;
+}
@@ -0,0 +1,78 @@
+#ifndef STREAM_BUFFER_HPP_E6B03D2A_91C4_4F7E_A85D_0C2F7B64E913
+#define STREAM_BUFFER_HPP_E6B03D2A_91C4_4F7E_A85D_0C2F7B64E913
+
+#include <glad/glad.h>
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+
+// Buffer for data that is rewritten every frame (e.g., particles or other
+// dynamic geometry).
+//
+// The buffer is split into aRegionCount regions of aRegionBytes each, which
+// are used round-robin: while the GPU reads one region, the CPU writes the
+// next. With GL 4.4, the buffer is created with glBufferStorage() and mapped
+// once, persistently and coherently, so data is written straight into
+// GPU-visible memory. A fence is placed after each region's draws; reusing a
+// region waits on its fence, which only blocks if the GPU is more than
+// aRegionCount-1 uses behind.
+//
+// On older GL versions, begin_region() returns CPU-side memory instead,
+// which end_region() uploads with glBufferSubData().
+//
+// Example:
+//
+//	auto region = stream.begin_region();
+//	std::size_t const bytes = write_vertices( region );
+//	stream.end_region( bytes );
+//	glDrawArrays( GL_POINTS, GLint(stream.region_offset() / kStride), count );
+//
+class StreamBuffer final
+{
+	public:
+		// Requires a current GL context. Throws Error on failure.
+		explicit StreamBuffer( std::size_t aRegionBytes, std::size_t aRegionCount = 3 );
+		~StreamBuffer();
+
+		StreamBuffer( StreamBuffer const& ) = delete;
+		StreamBuffer& operator= (StreamBuffer const&) = delete;
+
+	public:
+		GLuint buffer() const noexcept;
+
+		std::size_t region_bytes() const noexcept;
+		std::size_t region_count() const noexcept;
+
+		// Switch to the next region and return its memory for writing. Must
+		// be followed by end_region() before the region's contents are used.
+		// The draws that used the previous region must have been issued.
+		std::span<std::byte> begin_region();
+
+		// Finish writing aBytes (from the start of the region).
+		void end_region( std::size_t aBytes );
+
+		// Offset of the current region, in bytes from the start of buffer()
+		std::size_t region_offset() const noexcept;
+
+		// True if the buffer is persistently mapped (rather than updated with
+		// glBufferSubData())
+		bool persistent() const noexcept;
+
+		// Number of times begin_region() had to wait for the GPU
+		std::size_t stall_count() const noexcept;
+
+	private:
+		GLuint mBuffer = 0;
+		std::size_t mRegionBytes;
+
+		std::byte* mMapped = nullptr;
+		std::vector<std::byte> mStaging; // without persistent mapping
+
+		std::vector<GLsync> mFences;
+		std::size_t mCurrent;
+		std::size_t mStalls = 0;
+};
+
+#endif // STREAM_BUFFER_HPP_E6B03D2A_91C4_4F7E_A85D_0C2F7B64E913
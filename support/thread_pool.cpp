@@ -0,0 +1,147 @@
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+	// State of one parallel_for() call. Helper tasks hold a reference to it,
+	// since they may only get to run after the call has already returned
+	// (in which case they find no work left and exit immediately).
+	struct ParallelJob_
+	{
+		std::size_t count;
+		std::function<void(std::size_t)> const* func;
+
+		std::atomic<std::size_t> next{ 0 };
+		std::atomic<std::size_t> done{ 0 };
+
+		std::mutex errorMutex;
+		std::exception_ptr error;
+
+		void run()
+		{
+			for( std::size_t i; (i = next.fetch_add( 1, std::memory_order_relaxed )) < count; )
+			{
+				try
+				{
+					(*func)( i );
+				}
+				catch( ... )
+				{
+					std::scoped_lock lock( errorMutex );
+					if( !error )
+						error = std::current_exception();
+				}
+
+				if( done.fetch_add( 1, std::memory_order_acq_rel ) + 1 == count )
+					done.notify_all();
+			}
+		}
+	};
+}
+
+ThreadPool::ThreadPool( std::size_t aThreadCount )
+	: mStop( false )
+{
+	if( 0 == aThreadCount )
+	{
+		auto const hw = std::thread::hardware_concurrency();
+		aThreadCount = hw > 1 ? hw-1 : 0;
+	}
+
+	mThreads.reserve( aThreadCount );
+	for( std::size_t i = 0; i < aThreadCount; ++i )
+		mThreads.emplace_back( [this] { worker_(); } );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::scoped_lock lock( mMutex );
+		mStop = true;
+	}
+	mWake.notify_all();
+
+	for( auto& thread : mThreads )
+		thread.join();
+}
+
+std::size_t ThreadPool::thread_count() const noexcept
+{
+	return mThreads.size();
+}
+
+void ThreadPool::parallel_for( std::size_t aCount, std::function<void(std::size_t)> const& aFunc )
+{
+	if( 0 == aCount )
+		return;
+
+	auto job = std::make_shared<ParallelJob_>();
+	job->count = aCount;
+	job->func = &aFunc;
+
+	// One helper per worker at most; the calling thread takes part as well.
+	auto const helpers = std::min( aCount-1, mThreads.size() );
+	if( helpers )
+	{
+		{
+			std::scoped_lock lock( mMutex );
+			for( std::size_t i = 0; i < helpers; ++i )
+				mQueue.emplace_back( [job] { job->run(); } );
+		}
+		mWake.notify_all();
+	}
+
+	job->run();
+
+	for( auto done = job->done.load( std::memory_order_acquire ); done != aCount; done = job->done.load( std::memory_order_acquire ) )
+		job->done.wait( done, std::memory_order_acquire );
+
+	if( job->error )
+		std::rethrow_exception( job->error );
+}
+
+void ThreadPool::submit( std::function<void()> aTask )
+{
+	if( mThreads.empty() )
+	{
+		aTask();
+		return;
+	}
+
+	{
+		std::scoped_lock lock( mMutex );
+		mQueue.emplace_back( std::move(aTask) );
+	}
+	mWake.notify_one();
+}
+
+void ThreadPool::worker_()
+{
+	for( ;; )
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock lock( mMutex );
+			mWake.wait( lock, [this] { return mStop || !mQueue.empty(); } );
+
+			if( mStop && mQueue.empty() )
+				return;
+
+			task = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+
+		task();
+	}
+}
+
+ThreadPool& default_thread_pool()
+{
+	static ThreadPool pool;
+	return pool;
+}
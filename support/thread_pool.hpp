@@ -0,0 +1,65 @@
+#ifndef THREAD_POOL_HPP_6C1F0B94_2E7D_4A38_B5C9_8D3E4A71F265
+#define THREAD_POOL_HPP_6C1F0B94_2E7D_4A38_B5C9_8D3E4A71F265
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+
+// Fixed-size pool of worker threads.
+//
+// parallel_for() splits an index range across the workers and the calling
+// thread, and returns once all indices have been processed. Work items must
+// not call parallel_for() on the same pool themselves.
+//
+// submit() queues a single task and returns immediately. Tasks still queued
+// when the pool is destroyed are run before the workers exit.
+//
+// Example:
+//
+//	default_thread_pool().parallel_for( chunks.size(), [&] (std::size_t aI) {
+//		process( chunks[aI] );
+//	} );
+//
+class ThreadPool final
+{
+	public:
+		// Zero threads means one per hardware thread, minus the caller
+		explicit ThreadPool( std::size_t aThreadCount = 0 );
+		~ThreadPool();
+
+		ThreadPool( ThreadPool const& ) = delete;
+		ThreadPool& operator= (ThreadPool const&) = delete;
+
+	public:
+		// Number of worker threads (not counting the calling thread)
+		std::size_t thread_count() const noexcept;
+
+		// Call aFunc(i) for every i in [0, aCount). Blocks until all calls
+		// have completed. If a call throws, the first exception is rethrown
+		// here once the remaining calls have finished.
+		void parallel_for( std::size_t aCount, std::function<void(std::size_t)> const& aFunc );
+
+		// Run aTask on a worker thread. With no worker threads, aTask runs
+		// immediately on the calling thread. aTask must not throw.
+		void submit( std::function<void()> aTask );
+
+	private:
+		void worker_();
+
+		std::vector<std::thread> mThreads;
+
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::deque<std::function<void()>> mQueue;
+		bool mStop;
+};
+
+// Process-wide pool, created on first use
+ThreadPool& default_thread_pool();
+
+#endif // THREAD_POOL_HPP_6C1F0B94_2E7D_4A38_B5C9_8D3E4A71F265
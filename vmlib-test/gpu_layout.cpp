@@ -0,0 +1,86 @@
+#include <catch2/catch_amalgamated.hpp>
+
+#include <cstring>
+
+#include "../vmlib/gpu_layout.hpp"
+
+namespace
+{
+	template< typename T >
+	T read_( std::byte const* aBytes, std::size_t aOffset )
+	{
+		T ret;
+		std::memcpy( &ret, aBytes + aOffset, sizeof(T) );
+		return ret;
+	}
+}
+
+TEST_CASE( "std140 block layout", "[gpu_layout]" )
+{
+	// Offsets as reported by glGetActiveUniformsiv( GL_UNIFORM_OFFSET ) for
+	//
+	//   struct Light { vec3 position; vec3 color; bool enabled; };
+	//   layout(std140) uniform Block {
+	//       float a; vec2 b; vec3 c; float d; float e[2]; mat3 f; Light g[3]; vec4 h;
+	//   };
+	using Light = GpuStruct<Vec3f, Vec3f, bool>;
+	using Block = GpuBlock<GpuLayout::std140, GpuStruct<
+		float, Vec2f, Vec3f, float, GpuArray<float,2>, Mat33f, GpuArray<Light,3>, Vec4f
+	>>;
+
+	SECTION( "Offsets" )
+	{
+		STATIC_REQUIRE( 0 == Block::offset<0> );
+		STATIC_REQUIRE( 8 == Block::offset<1> );
+		STATIC_REQUIRE( 16 == Block::offset<2> );
+		STATIC_REQUIRE( 28 == Block::offset<3> );
+		STATIC_REQUIRE( 32 == Block::offset<4> );  // array: 16 byte stride
+		STATIC_REQUIRE( 64 == Block::offset<5> );
+		STATIC_REQUIRE( 112 == Block::offset<6> ); // struct size: 32
+		STATIC_REQUIRE( 208 == Block::offset<7> );
+		STATIC_REQUIRE( 224 == Block::size() );
+	}
+
+	SECTION( "Array elements" )
+	{
+		Block block;
+		block.set<4>( 1, 5.f );
+		block.set<6,1>( 2, Vec3f{ 1.f, 2.f, 3.f } );
+		block.set<6,2>( 2, true );
+
+		REQUIRE( 5.f == read_<float>( block.data(), 32 + 16 ) );
+		REQUIRE( 0.f == read_<float>( block.data(), 32 ) );
+		REQUIRE( 2.f == read_<float>( block.data(), 112 + 2*32 + 16 + 4 ) );
+		REQUIRE( 1u == read_<std::uint32_t>( block.data(), 112 + 2*32 + 28 ) );
+	}
+}
+
+TEST_CASE( "std430 block layout", "[gpu_layout]" )
+{
+	using Light = GpuStruct<Vec3f, float>;
+	using Block = GpuBlock<GpuLayout::std430, GpuStruct<
+		float, GpuArray<float,3>, Vec2f, GpuArray<Light,2>, std::uint32_t
+	>>;
+
+	STATIC_REQUIRE( 4 == Block::offset<1> );   // no padding of arrays
+	STATIC_REQUIRE( 16 == Block::offset<2> );
+	STATIC_REQUIRE( 32 == Block::offset<3> );
+	STATIC_REQUIRE( 64 == Block::offset<4> );
+	STATIC_REQUIRE( 80 == Block::size() );
+}
+
+TEST_CASE( "Matrices are column major", "[gpu_layout]" )
+{
+	using Block = GpuBlock<GpuLayout::std140, GpuStruct<Vec3f, Mat44f>>;
+
+	Mat44f const translation = make_translation( { 1.f, 2.f, 3.f } );
+
+	Block block;
+	block.set<1>( translation );
+
+	REQUIRE( 16 == Block::offset<1> );
+	REQUIRE( 1.f == read_<float>( block.data(), 16 ) );       // column 0, row 0
+	REQUIRE( 0.f == read_<float>( block.data(), 16 + 12 ) );  // column 0, row 3
+	REQUIRE( 1.f == read_<float>( block.data(), 16 + 48 ) );  // column 3, row 0
+	REQUIRE( 3.f == read_<float>( block.data(), 16 + 56 ) );  // column 3, row 2
+}
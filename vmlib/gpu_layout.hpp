@@ -0,0 +1,303 @@
+#ifndef GPU_LAYOUT_HPP_3C8E51A2_9D07_4B6F_8E24_F1A6C05B7D93
+#define GPU_LAYOUT_HPP_3C8E51A2_9D07_4B6F_8E24_F1A6C05B7D93
+
+#include <array>
+#include <tuple>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include <cassert>
+
+#include "vec2.hpp"
+#include "vec3.hpp"
+#include "vec4.hpp"
+#include "mat33.hpp"
+#include "mat44.hpp"
+
+/** GPU block layouts (std140 and std430)
+ *
+ * Describes the layout of a GLSL uniform or shader storage block at compile
+ * time, and stores the block's contents as a single blob of bytes that can
+ * be uploaded with one glBufferSubData() / memcpy().
+ *
+ * A block is described by the GLSL types of its members, in declaration
+ * order. For example,
+ *
+ *   struct PointLight { vec3 position; vec3 color; bool enabled; };
+ *   layout(std140) uniform FrameData
+ *   {
+ *       mat4 uProjCamera;
+ *       PointLight uPointLights[3];
+ *   };
+ *
+ * corresponds to
+ *
+ *   using PointLight = GpuStruct<Vec3f, Vec3f, bool>;
+ *   using FrameData = GpuBlock<GpuLayout::std140, GpuStruct<
+ *       Mat44f,
+ *       GpuArray<PointLight, 3>
+ *   >>;
+ *
+ * Members are selected by their index, which is easiest to keep readable
+ * with an enum next to the description:
+ *
+ *   FrameData data;
+ *   data.set<0>( projCamera );                   // uProjCamera
+ *   data.set<1,0>( 2, Vec3f{ 1.f, 0.f, 0.f } );  // uPointLights[2].position
+ *
+ * Offsets follow the rules in Section 7.6.2.2 of the OpenGL 4.6 spec:
+ *  - scalars (float, int32, uint32, bool) are 4 bytes
+ *  - vec2 is aligned to 8 bytes, vec3 and vec4 to 16 bytes
+ *  - a matN is stored as N column vectors (column major), like an array of
+ *    vecN (the matrices in vmlib are row major; set() transposes them)
+ *  - in std140 arrays and structs are aligned to (and array elements are
+ *    padded to) a multiple of 16 bytes; std430 does not do that
+ *
+ * Padding in the blob is zero.
+ */
+enum class GpuLayout
+{
+	std140,
+	std430
+};
+
+// Array member: T name[tCount]
+template< typename T, std::size_t tCount >
+struct GpuArray
+{
+	static_assert( tCount > 0 );
+};
+
+// Struct member (and the top level of a block)
+template< typename... tMembers >
+struct GpuStruct
+{
+	static_assert( sizeof...(tMembers) > 0 );
+};
+
+
+// Layout rules per type. Each specialization has the base alignment and the
+// size (in bytes), and the types that are not aggregates can write() a value
+// to the blob.
+template< GpuLayout tLayout, typename T >
+struct GpuLayoutTraits; // not defined: T is not supported
+
+constexpr
+std::size_t gpu_round_up_( std::size_t aValue, std::size_t aAlignment ) noexcept
+{
+	return (aValue + aAlignment - 1) / aAlignment * aAlignment;
+}
+
+template< typename T, std::size_t tAlignment, std::size_t tSize >
+struct GpuScalarTraits_
+{
+	static constexpr std::size_t alignment = tAlignment;
+	static constexpr std::size_t size = tSize;
+
+	static void write( std::byte* aDst, T const& aValue ) noexcept
+	{
+		static_assert( sizeof(T) == tSize );
+		std::memcpy( aDst, &aValue, sizeof(T) );
+	}
+};
+
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, float> : GpuScalarTraits_<float,4,4> {};
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, std::int32_t> : GpuScalarTraits_<std::int32_t,4,4> {};
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, std::uint32_t> : GpuScalarTraits_<std::uint32_t,4,4> {};
+
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, Vec2f> : GpuScalarTraits_<Vec2f,8,8> {};
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, Vec3f> : GpuScalarTraits_<Vec3f,16,12> {};
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, Vec4f> : GpuScalarTraits_<Vec4f,16,16> {};
+
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, bool>
+{
+	static constexpr std::size_t alignment = 4;
+	static constexpr std::size_t size = 4;
+
+	static void write( std::byte* aDst, bool aValue ) noexcept
+	{
+		std::uint32_t const value = aValue ? 1 : 0;
+		std::memcpy( aDst, &value, sizeof(value) );
+	}
+};
+
+// Matrices: N columns, each column a vec3/vec4 (16 byte stride in both
+// std140 and std430)
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, Mat33f>
+{
+	static constexpr std::size_t alignment = 16;
+	static constexpr std::size_t size = 3*16;
+
+	static void write( std::byte* aDst, Mat33f const& aValue ) noexcept
+	{
+		for( std::size_t col = 0; col < 3; ++col )
+		{
+			float const column[3] = { aValue[0,col], aValue[1,col], aValue[2,col] };
+			std::memcpy( aDst + col*16, column, sizeof(column) );
+		}
+	}
+};
+template< GpuLayout tLayout >
+struct GpuLayoutTraits<tLayout, Mat44f>
+{
+	static constexpr std::size_t alignment = 16;
+	static constexpr std::size_t size = 4*16;
+
+	static void write( std::byte* aDst, Mat44f const& aValue ) noexcept
+	{
+		for( std::size_t col = 0; col < 4; ++col )
+		{
+			float const column[4] = { aValue[0,col], aValue[1,col], aValue[2,col], aValue[3,col] };
+			std::memcpy( aDst + col*16, column, sizeof(column) );
+		}
+	}
+};
+
+template< GpuLayout tLayout, typename T, std::size_t tCount >
+struct GpuLayoutTraits<tLayout, GpuArray<T,tCount>>
+{
+	using Element = T;
+	using ElementTraits = GpuLayoutTraits<tLayout,T>;
+
+	static constexpr std::size_t alignment = GpuLayout::std140 == tLayout
+		? gpu_round_up_( ElementTraits::alignment, 16 )
+		: ElementTraits::alignment
+	;
+	static constexpr std::size_t stride = GpuLayout::std140 == tLayout
+		? gpu_round_up_( gpu_round_up_( ElementTraits::size, ElementTraits::alignment ), 16 )
+		: gpu_round_up_( ElementTraits::size, ElementTraits::alignment )
+	;
+	static constexpr std::size_t size = stride * tCount;
+	static constexpr std::size_t count = tCount;
+};
+
+template< GpuLayout tLayout, typename... tMembers >
+struct GpuLayoutTraits<tLayout, GpuStruct<tMembers...>>
+{
+	template< std::size_t tIndex >
+	using Member = std::tuple_element_t<tIndex, std::tuple<tMembers...>>;
+
+	static constexpr std::size_t count = sizeof...(tMembers);
+
+	static constexpr std::size_t alignment = [] {
+		std::size_t const align = std::max( { GpuLayoutTraits<tLayout,tMembers>::alignment... } );
+		return GpuLayout::std140 == tLayout ? gpu_round_up_( align, 16 ) : align;
+	}();
+
+	static constexpr std::array<std::size_t, count> offsets = [] {
+		constexpr std::size_t alignments[] = { GpuLayoutTraits<tLayout,tMembers>::alignment... };
+		constexpr std::size_t sizes[] = { GpuLayoutTraits<tLayout,tMembers>::size... };
+
+		std::array<std::size_t, count> ret{};
+		std::size_t offset = 0;
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			ret[i] = gpu_round_up_( offset, alignments[i] );
+			offset = ret[i] + sizes[i];
+		}
+		return ret;
+	}();
+
+	// The member following a struct starts at a multiple of its alignment
+	static constexpr std::size_t size = gpu_round_up_(
+		offsets[count-1] + GpuLayoutTraits<tLayout,Member<count-1>>::size,
+		alignment
+	);
+};
+
+
+/** GpuBlock: contents of a block, with the layout tStruct (a GpuStruct<>)
+ *
+ * The blob is trivially copyable; upload it with
+ *
+ *   glBufferSubData( target, offset, block.size(), block.data() );
+ */
+template< GpuLayout tLayout, typename tStruct >
+class GpuBlock; // not defined: tStruct must be a GpuStruct<>
+
+template< GpuLayout tLayout, typename... tMembers >
+class GpuBlock<tLayout, GpuStruct<tMembers...>> final
+{
+	public:
+		using Traits = GpuLayoutTraits<tLayout, GpuStruct<tMembers...>>;
+
+		template< std::size_t tIndex >
+		using Member = typename Traits::template Member<tIndex>;
+
+		static constexpr std::size_t kSize = Traits::size;
+
+		// Byte offset of member tIndex, as queried with glGetActiveUniformsiv(
+		// ..., GL_UNIFORM_OFFSET, ... ) / GL_OFFSET for buffer variables
+		template< std::size_t tIndex >
+		static constexpr std::size_t offset = Traits::offsets[tIndex];
+
+	public:
+		// Member tIndex (not an array or struct)
+		template< std::size_t tIndex >
+		void set( Member<tIndex> const& aValue ) noexcept
+		{
+			GpuLayoutTraits<tLayout, Member<tIndex>>::write( mBytes.data() + offset<tIndex>, aValue );
+		}
+
+		// Element aElement of the array member tIndex (elements that are not
+		// structs)
+		template< std::size_t tIndex >
+		void set( std::size_t aElement, typename GpuLayoutTraits<tLayout, Member<tIndex>>::Element const& aValue ) noexcept
+		{
+			using Array_ = GpuLayoutTraits<tLayout, Member<tIndex>>;
+			assert( aElement < Array_::count );
+
+			auto* const dst = mBytes.data() + offset<tIndex> + aElement * Array_::stride;
+			Array_::ElementTraits::write( dst, aValue );
+		}
+
+		// Member tField of element aElement of the array-of-structs member tIndex
+		template< std::size_t tIndex, std::size_t tField >
+		void set( std::size_t aElement, typename GpuLayoutTraits<tLayout, Member<tIndex>>::ElementTraits::template Member<tField> const& aValue ) noexcept
+		{
+			using Array_ = GpuLayoutTraits<tLayout, Member<tIndex>>;
+			using Struct_ = typename Array_::ElementTraits;
+			using Field_ = typename Struct_::template Member<tField>;
+			assert( aElement < Array_::count );
+
+			auto* const dst = mBytes.data() + offset<tIndex> + aElement * Array_::stride + Struct_::offsets[tField];
+			GpuLayoutTraits<tLayout, Field_>::write( dst, aValue );
+		}
+
+		// Member tField of the struct member tIndex
+		template< std::size_t tIndex, std::size_t tField >
+		void set( typename GpuLayoutTraits<tLayout, Member<tIndex>>::template Member<tField> const& aValue ) noexcept
+		{
+			using Struct_ = GpuLayoutTraits<tLayout, Member<tIndex>>;
+			using Field_ = typename Struct_::template Member<tField>;
+
+			auto* const dst = mBytes.data() + offset<tIndex> + Struct_::offsets[tField];
+			GpuLayoutTraits<tLayout, Field_>::write( dst, aValue );
+		}
+
+		std::byte const* data() const noexcept
+		{
+			return mBytes.data();
+		}
+
+		static constexpr std::size_t size() noexcept
+		{
+			return kSize;
+		}
+
+	private:
+		alignas(16) std::array<std::byte, kSize> mBytes{};
+};
+
+#endif // GPU_LAYOUT_HPP_3C8E51A2_9D07_4B6F_8E24_F1A6C05B7D93